@@ -0,0 +1,659 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the QNX calls the driver makes, and the client side of
+ * host/host.h. The message passing is a copy: the request is copied into the
+ * receive buffer of the calling thread (msg_max_size bytes, the rest is read
+ * with resmgr_msgread), the reply parts are copied into the client buffers.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+#include <sys/iofunc.h>
+#include <sys/dispatch.h>
+#include "host.h"
+#include "../vt1211_hw.h"
+
+#define HOST_NAMES_MAX  64
+#define HOST_FDS_MAX    4096
+#define HOST_FD_BASE    0x100           // not to be mistaken for a host descriptor
+
+struct _dispatch {
+  int dummy;
+};
+
+struct _thread_pool {
+  int dummy;
+};
+
+typedef struct {
+  char                          path[64];
+  const resmgr_connect_funcs_t  *connect;
+  const resmgr_io_funcs_t       *io;
+  void                          *handle;
+} host_name_t;
+
+typedef struct {
+  iofunc_ocb_t                  *ocb;
+  const resmgr_io_funcs_t       *io;
+} host_fd_t;
+
+// One message in flight: the context the handler gets and the client buffers
+typedef struct {
+  resmgr_context_t  ctp;
+  const uint8_t     *smsg;
+  size_t            slen;
+  uint8_t           *rmsg;
+  size_t            rlen;
+} host_xfer_t;
+
+// The simulated chip is the only backend on the host, there is no vt1211_gpio
+const vt1211_hw_t   *vt1211_hw = &vt1211_hw_sim;
+__thread uint32_t   vt1211_hw_calls;
+
+struct qtime_entry  host_qtime = { 1000000000ULL };
+
+static struct _dispatch     dispatch;
+static struct _thread_pool  pool;
+static unsigned             msg_max_size = 4096;
+
+static host_name_t          names[HOST_NAMES_MAX];
+static int                  names_count;
+
+static host_fd_t            fds[HOST_FDS_MAX];
+static pthread_mutex_t      fds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int (*pulse_func)(message_context_t *ctp, int code, unsigned flags, void *handle);
+static int                  pulse_code;
+static void                 *pulse_handle;
+
+static __thread pid_t       client_pid;
+static __thread uint8_t     *receive_buf;
+static __thread iofunc_ocb_t *attached;
+
+extern int vt1211_nto_main(int argc, char **argv);
+
+// Clock
+
+uint64_t ClockCycles(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+int ClockPeriod(clockid_t id, const struct _clockperiod *new, struct _clockperiod *old, int reserved) {
+  struct timespec res;
+
+  if (old != NULL) {
+    clock_getres(id, &res);
+    old->nsec  = res.tv_nsec ? res.tv_nsec : 1;
+    old->fract = 0;
+  }
+
+  return 0;
+}
+
+// Dispatch layer: the names are kept for host_open, nothing is received
+
+dispatch_t *dispatch_create(void) {
+  return &dispatch;
+}
+
+int resmgr_attach(dispatch_t *dpp, resmgr_attr_t *attr, const char *path, int file_type, unsigned flags,
+                  const resmgr_connect_funcs_t *connect_funcs, const resmgr_io_funcs_t *io_funcs,
+                  void *handle) {
+  host_name_t *name;
+
+  if (names_count == HOST_NAMES_MAX || strlen(path) >= sizeof(name->path)) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if (attr != NULL && attr->msg_max_size > msg_max_size)
+    msg_max_size = attr->msg_max_size;
+
+  name = &names[names_count];
+  strcpy(name->path, path);
+  name->connect = connect_funcs;
+  name->io      = io_funcs;
+  name->handle  = handle;
+
+  return names_count++;
+}
+
+int pulse_attach(dispatch_t *dpp, int flags, int code,
+                 int (*func)(message_context_t *ctp, int code, unsigned flags, void *handle), void *handle) {
+  pulse_func    = func;
+  pulse_code    = code;
+  pulse_handle  = handle;
+  return code;
+}
+
+int resmgr_msgread(resmgr_context_t *ctp, void *msg, int size, int offset) {
+  host_xfer_t *xfer = (host_xfer_t *) ctp;
+
+  if (offset < 0 || (size_t) offset > xfer->slen) {
+    errno = EFAULT;
+    return -1;
+  }
+
+  if ((size_t) size > xfer->slen - offset)
+    size = xfer->slen - offset;
+
+  memcpy(msg, xfer->smsg + offset, size);
+  return size;
+}
+
+int resmgr_msgwrite(resmgr_context_t *ctp, const void *msg, int size, int offset) {
+  host_xfer_t *xfer = (host_xfer_t *) ctp;
+
+  if (offset < 0 || (size_t) offset > xfer->rlen) {
+    errno = EFAULT;
+    return -1;
+  }
+
+  if ((size_t) size > xfer->rlen - offset)
+    size = xfer->rlen - offset;
+
+  memcpy(xfer->rmsg + offset, msg, size);
+  return size;
+}
+
+dispatch_context_t *dispatch_context_alloc(dispatch_t *dpp) {
+  return NULL;
+}
+
+void dispatch_context_free(dispatch_context_t *ctp) {
+}
+
+dispatch_context_t *dispatch_block(dispatch_context_t *ctp) {
+  return ctp;
+}
+
+void dispatch_unblock(dispatch_context_t *ctp) {
+}
+
+int dispatch_handler(dispatch_context_t *ctp) {
+  return 0;
+}
+
+thread_pool_t *thread_pool_create(thread_pool_attr_t *attr, unsigned flags) {
+  return &pool;
+}
+
+// The client threads are the pool, main returns
+int thread_pool_start(void *pool) {
+  return 0;
+}
+
+// iofunc layer
+
+void iofunc_func_init(unsigned nconnect, resmgr_connect_funcs_t *connect, unsigned nio, resmgr_io_funcs_t *io) {
+  memset(connect, 0, sizeof(*connect));
+  memset(io, 0, sizeof(*io));
+  connect->nfuncs = nconnect;
+  io->nfuncs      = nio;
+
+  connect->open   = iofunc_open_default;
+  io->close_ocb   = iofunc_close_ocb_default;
+  io->lock_ocb    = iofunc_lock_ocb_default;
+  io->unlock_ocb  = iofunc_unlock_ocb_default;
+}
+
+// The attribute lock is recursive, as on QNX: the handlers call the helpers with it held
+void iofunc_attr_init(iofunc_attr_t *attr, mode_t mode, iofunc_attr_t *dattr, void *info) {
+  pthread_mutexattr_t mattr;
+
+  memset(attr, 0, sizeof(*attr));
+
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&attr->lock, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+
+  attr->mode = mode;
+}
+
+int iofunc_attr_lock(iofunc_attr_t *attr) {
+  return pthread_mutex_lock(&attr->lock);
+}
+
+int iofunc_attr_unlock(iofunc_attr_t *attr) {
+  return pthread_mutex_unlock(&attr->lock);
+}
+
+int iofunc_open(resmgr_context_t *ctp, io_open_t *msg, iofunc_attr_t *attr, iofunc_attr_t *dattr, void *info) {
+  if ((msg->connect.ioflag & _IO_FLAG_WR) && !(attr->mode & 0222))
+    return EACCES;
+
+  return EOK;
+}
+
+int iofunc_ocb_attach(resmgr_context_t *ctp, io_open_t *msg, IOFUNC_OCB_T *ocb, iofunc_attr_t *attr,
+                      const resmgr_io_funcs_t *io_funcs) {
+  ocb->attr   = attr;
+  ocb->ioflag = msg->connect.ioflag;
+  ocb->offset = 0;
+  attached    = ocb;
+
+  iofunc_attr_lock(attr);
+  ++attr->count;
+  iofunc_attr_unlock(attr);
+
+  return EOK;
+}
+
+int iofunc_close_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb) {
+  iofunc_attr_t *attr = ocb->attr;
+
+  iofunc_attr_lock(attr);
+  --attr->count;
+  iofunc_attr_unlock(attr);
+
+  if (attr->mount != NULL && attr->mount->funcs != NULL) {
+    attr->mount->funcs->ocb_free(ocb);
+  } else {
+    free(ocb);
+  }
+
+  return EOK;
+}
+
+int iofunc_open_default(resmgr_context_t *ctp, io_open_t *msg, iofunc_attr_t *attr, void *extra) {
+  iofunc_ocb_t  *ocb;
+  int           rc;
+
+  if ((rc = iofunc_open(ctp, msg, attr, NULL, NULL)) != EOK)
+    return rc;
+
+  if (attr->mount != NULL && attr->mount->funcs != NULL) {
+    ocb = attr->mount->funcs->ocb_calloc(ctp, attr);
+  } else {
+    ocb = calloc(1, sizeof(*ocb));
+  }
+
+  if (ocb == NULL)
+    return ENOMEM;
+
+  return iofunc_ocb_attach(ctp, msg, ocb, attr, NULL);
+}
+
+// The default OCB lock is the attribute lock
+int iofunc_lock_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb) {
+  return iofunc_attr_lock(ocb->attr);
+}
+
+int iofunc_unlock_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb) {
+  return iofunc_attr_unlock(ocb->attr);
+}
+
+int iofunc_read_verify(resmgr_context_t *ctp, io_read_t *msg, iofunc_ocb_t *ocb, int *nonblock) {
+  if (!(ocb->ioflag & _IO_FLAG_RD))
+    return EBADF;
+
+  if (nonblock != NULL)
+    *nonblock = ocb->ioflag & O_NONBLOCK;
+
+  return EOK;
+}
+
+int iofunc_write_verify(resmgr_context_t *ctp, io_write_t *msg, iofunc_ocb_t *ocb, int *nonblock) {
+  if (!(ocb->ioflag & _IO_FLAG_WR))
+    return EBADF;
+
+  if (nonblock != NULL)
+    *nonblock = ocb->ioflag & O_NONBLOCK;
+
+  return EOK;
+}
+
+// No events are armed on the host, the conditions are only reported
+int iofunc_notify(resmgr_context_t *ctp, io_notify_t *msg, iofunc_notify_t *notify, int trig,
+                  const int *notifycounts, int *armed) {
+  int flags = msg->i.flags & trig;
+
+  if (armed != NULL)
+    *armed = 0;
+
+  memset(&msg->o, 0, sizeof(msg->o));
+  msg->o.flags = flags;
+
+  return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o));
+}
+
+void iofunc_notify_trigger(iofunc_notify_t *notify, int count, int index) {
+}
+
+void iofunc_notify_remove(resmgr_context_t *ctp, iofunc_notify_t *notify) {
+}
+
+// Client side
+
+int host_start(int argc, char **argv) {
+  // The simulated accesses sleep, the default slack of 50 us would swamp them.
+  // Threads created from here on inherit it.
+  prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+  return vt1211_nto_main(argc, argv);
+}
+
+void host_client(pid_t pid) {
+  client_pid = pid;
+}
+
+static pid_t host_pid(void) {
+  return client_pid ? client_pid : getpid();
+}
+
+/*
+ * Sets up the context of a message from the calling client: the first
+ * msg_max_size bytes are in the receive buffer, like a MsgReceive would leave
+ * them
+ */
+static int host_xfer_init(host_xfer_t *xfer, const void *smsg, size_t slen, void *rmsg, size_t rlen) {
+  if (receive_buf == NULL && (receive_buf = malloc(msg_max_size)) == NULL)
+    return ENOMEM;
+
+  memset(xfer, 0, sizeof(*xfer));
+
+  xfer->smsg  = smsg;
+  xfer->slen  = slen;
+  xfer->rmsg  = rmsg;
+  xfer->rlen  = rlen;
+
+  xfer->ctp.msg               = receive_buf;
+  xfer->ctp.msg_max_size      = msg_max_size;
+  xfer->ctp.dpp               = &dispatch;
+  xfer->ctp.info.pid          = host_pid();
+  xfer->ctp.info.scoid        = host_pid();
+  xfer->ctp.info.srcmsglen    = slen;
+  xfer->ctp.info.dstmsglen    = rlen;
+  xfer->ctp.info.msglen       = slen < msg_max_size ? slen : msg_max_size;
+
+  memcpy(receive_buf, smsg, xfer->ctp.info.msglen);
+  return EOK;
+}
+
+/*
+ * Replies the way the resource manager library does it for the handler's
+ * return value: an error status, the parts set up by the handler or nothing
+ * (the handler wrote the reply itself). Returns the status or -1 with errno.
+ */
+static int host_reply(host_xfer_t *xfer, int rc) {
+  if (rc >= 0 && rc != EOK) {
+    errno = rc;
+    return -1;
+  }
+
+  if (rc < 0 && rc != _RESMGR_NOREPLY && rc != _RESMGR_DEFAULT && rc != _RESMGR_NPARTS(0)) {
+    size_t len = GETIOVLEN(xfer->ctp.iov);
+
+    memmove(xfer->rmsg, GETIOVBASE(xfer->ctp.iov), len < xfer->rlen ? len : xfer->rlen);
+  }
+
+  return xfer->ctp.status;
+}
+
+static host_fd_t *host_fd(int fd) {
+  if (fd < HOST_FD_BASE || fd >= HOST_FD_BASE + HOST_FDS_MAX || fds[fd - HOST_FD_BASE].ocb == NULL)
+    return NULL;
+
+  return &fds[fd - HOST_FD_BASE];
+}
+
+void *host_ocb(int fd) {
+  host_fd_t *entry = host_fd(fd);
+
+  return entry != NULL ? entry->ocb : NULL;
+}
+
+int host_open(const char *path, int oflag) {
+  host_xfer_t xfer;
+  io_open_t   msg;
+  host_name_t *name = NULL;
+  int         rc;
+  int         fd;
+
+  for (int i = 0; i < names_count; ++i) {
+    if (strcmp(names[i].path, path) == 0)
+      name = &names[i];
+  }
+
+  if (name == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.connect.type   = _IO_CONNECT;
+  msg.connect.ioflag = (oflag & ~O_ACCMODE) | ((oflag & O_ACCMODE) + 1);
+
+  if ((rc = host_xfer_init(&xfer, &msg, sizeof(msg), NULL, 0)) == EOK) {
+    attached = NULL;
+    rc = name->connect->open(&xfer.ctp, xfer.ctp.msg, name->handle, NULL);
+  }
+
+  if (rc != EOK) {
+    errno = rc;
+    return -1;
+  }
+
+  pthread_mutex_lock(&fds_lock);
+
+  for (fd = 0; fd < HOST_FDS_MAX && fds[fd].ocb != NULL; ++fd)
+    ;
+
+  if (fd < HOST_FDS_MAX) {
+    fds[fd].ocb = attached;
+    fds[fd].io  = name->io;
+  }
+
+  pthread_mutex_unlock(&fds_lock);
+
+  if (fd == HOST_FDS_MAX) {
+    name->io->close_ocb(&xfer.ctp, NULL, (void *) attached);
+    errno = EMFILE;
+    return -1;
+  }
+
+  return HOST_FD_BASE + fd;
+}
+
+int host_close(int fd) {
+  host_xfer_t     xfer;
+  host_fd_t       *entry = host_fd(fd);
+  host_fd_t       closed;
+  io_close_t      msg = { .i.type = _IO_CLOSE };
+  int             rc;
+
+  if (entry == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+
+  pthread_mutex_lock(&fds_lock);
+  closed = *entry;
+  entry->ocb = NULL;
+  pthread_mutex_unlock(&fds_lock);
+
+  if ((rc = host_xfer_init(&xfer, &msg, sizeof(msg), NULL, 0)) == EOK)
+    rc = closed.io->close_ocb(&xfer.ctp, NULL, (void *) closed.ocb);
+
+  if (rc != EOK) {
+    errno = rc;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * The message is the header and the data to the driver (DEVDIR_TO), the
+ * reply is the header and the data from the driver (DEVDIR_FROM), the way
+ * the QNX library sends it. Returns EOK or the error status, like devctl().
+ */
+int devctl(int fd, int dcmd, void *data, size_t nbytes, int *info) {
+  host_xfer_t *xfer;
+  host_fd_t   *entry = host_fd(fd);
+  io_devctl_t *msg;
+  size_t      slen   = sizeof(msg->i) + (dcmd & DEVDIR_TO ? nbytes : 0);
+  size_t      rlen   = sizeof(msg->o) + (dcmd & DEVDIR_FROM ? nbytes : 0);
+  uint8_t     *buf;
+  int         rc;
+
+  if (entry == NULL)
+    return EBADF;
+
+  // The request and the reply share the buffer, as with a single-part MsgSend
+  if ((buf = malloc(sizeof(host_xfer_t) + (slen > rlen ? slen : rlen))) == NULL)
+    return ENOMEM;
+
+  xfer = (host_xfer_t *) buf;
+  msg  = (io_devctl_t *) (buf + sizeof(host_xfer_t));
+
+  memset(&msg->i, 0, sizeof(msg->i));
+  msg->i.type   = _IO_DEVCTL;
+  msg->i.dcmd   = dcmd;
+  msg->i.nbytes = nbytes;
+
+  if (dcmd & DEVDIR_TO)
+    memcpy(_DEVCTL_DATA(msg->i), data, nbytes);
+
+  if ((rc = host_xfer_init(xfer, msg, slen, msg, rlen)) == EOK) {
+    entry->io->lock_ocb(&xfer->ctp, NULL, (void *) entry->ocb);
+    rc = entry->io->devctl(&xfer->ctp, xfer->ctp.msg, (void *) entry->ocb);
+    entry->io->unlock_ocb(&xfer->ctp, NULL, (void *) entry->ocb);
+
+    rc = host_reply(xfer, rc) == -1 ? errno : EOK;
+  }
+
+  if (rc == EOK) {
+    if (dcmd & DEVDIR_FROM)
+      memcpy(data, _DEVCTL_DATA(msg->o), nbytes);
+
+    if (info != NULL)
+      *info = msg->o.ret_val;
+  }
+
+  free(buf);
+  return rc;
+}
+
+ssize_t host_read(int fd, void *buf, size_t nbytes) {
+  host_xfer_t xfer;
+  host_fd_t   *entry = host_fd(fd);
+  io_read_t   msg;
+  int         rc;
+
+  if (entry == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.i.type   = _IO_READ;
+  msg.i.nbytes = nbytes;
+  msg.i.xtype  = _IO_XTYPE_NONE;
+
+  if ((rc = host_xfer_init(&xfer, &msg, sizeof(msg), buf, nbytes)) != EOK) {
+    errno = rc;
+    return -1;
+  }
+
+  entry->io->lock_ocb(&xfer.ctp, NULL, (void *) entry->ocb);
+  rc = entry->io->read(&xfer.ctp, xfer.ctp.msg, (void *) entry->ocb);
+  entry->io->unlock_ocb(&xfer.ctp, NULL, (void *) entry->ocb);
+
+  return host_reply(&xfer, rc);
+}
+
+ssize_t host_write(int fd, const void *buf, size_t nbytes) {
+  host_xfer_t xfer;
+  host_fd_t   *entry = host_fd(fd);
+  io_write_t  *msg;
+  int         rc;
+
+  if (entry == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if ((msg = malloc(sizeof(*msg) + nbytes)) == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  memset(msg, 0, sizeof(*msg));
+  msg->i.type   = _IO_WRITE;
+  msg->i.nbytes = nbytes;
+  msg->i.xtype  = _IO_XTYPE_NONE;
+  memcpy(msg + 1, buf, nbytes);
+
+  if ((rc = host_xfer_init(&xfer, msg, sizeof(*msg) + nbytes, NULL, 0)) == EOK) {
+    entry->io->lock_ocb(&xfer.ctp, NULL, (void *) entry->ocb);
+    rc = entry->io->write(&xfer.ctp, xfer.ctp.msg, (void *) entry->ocb);
+    entry->io->unlock_ocb(&xfer.ctp, NULL, (void *) entry->ocb);
+
+    rc = host_reply(&xfer, rc);
+  } else {
+    errno = rc;
+    rc = -1;
+  }
+
+  free(msg);
+  return rc;
+}
+
+int host_pulse(int code, int value) {
+  host_xfer_t   xfer;
+  struct _pulse pulse;
+  int           rc;
+
+  if (pulse_func == NULL || code != pulse_code) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  memset(&pulse, 0, sizeof(pulse));
+  pulse.code            = code;
+  pulse.value.sival_int = value;
+  pulse.scoid           = host_pid();
+
+  if ((rc = host_xfer_init(&xfer, &pulse, sizeof(pulse), NULL, 0)) != EOK) {
+    errno = rc;
+    return -1;
+  }
+
+  pulse_func(&xfer.ctp, code, 0, pulse_handle);
+  return 0;
+}
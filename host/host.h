@@ -0,0 +1,57 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the driver runs in the process of the test or benchmark, on
+ * the simulated chip. The calling thread is the client and the thread of the
+ * pool at once, every call is handed to the attached handler the way the
+ * dispatch layer would do it with the received message. The descriptors are
+ * the driver's OCBs, they are not file descriptors of the host.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <devctl.h>
+
+// Starts the driver with the command line of vt1211_nto. The simulated chip
+// is the only backend, -S only sets its latency.
+int     host_start(int argc, char **argv);
+
+// The calling thread sends as the process pid from now on, its connection is pid too
+void    host_client(pid_t pid);
+
+int     host_open(const char *path, int oflag);
+int     host_close(int fd);
+ssize_t host_read(int fd, void *buf, size_t nbytes);
+ssize_t host_write(int fd, const void *buf, size_t nbytes);
+
+// The driver's OCB behind a descriptor, for calls straight into the driver
+void    *host_ocb(int fd);
+
+// A pulse of the calling client to the driver channel
+int     host_pulse(int code, int value);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: device control commands, with the QNX encoding. devctl() is
+ * served by the in-process resource manager of the host build.
+ */
+
+#ifndef HOST_DEVCTL_H
+#define HOST_DEVCTL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define _DCMD_MISC    0x05
+
+#define DEVDIR_NONE   0x00000000
+#define DEVDIR_TO     0x80000000
+#define DEVDIR_FROM   0x40000000
+#define DEVDIR_TOFROM (DEVDIR_TO | DEVDIR_FROM)
+
+#define __DION(_class, _cmd)          (((_class) << 8) + (_cmd) + DEVDIR_NONE)
+#define __DIOF(_class, _cmd, _data)   ((sizeof(_data) << 16) + ((_class) << 8) + (_cmd) + DEVDIR_FROM)
+#define __DIOT(_class, _cmd, _data)   ((sizeof(_data) << 16) + ((_class) << 8) + (_cmd) + DEVDIR_TO)
+#define __DIOTF(_class, _cmd, _data)  ((sizeof(_data) << 16) + ((_class) << 8) + (_cmd) + DEVDIR_TOFROM)
+
+#define get_device_direction(_cmd)    ((unsigned) (_cmd) & DEVDIR_TOFROM)
+
+int devctl(int fd, int dcmd, void *data, size_t nbytes, int *info);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the C library errno values plus the QNX EOK.
+ */
+
+#ifndef HOST_ERRNO_H
+#define HOST_ERRNO_H
+
+#include_next <errno.h>
+
+#define EOK 0
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the dispatch and resource manager layer the driver uses, on
+ * Linux. The messages are not received from a channel: the host client
+ * calls (host/host.h) hand them to the attached handlers in the calling
+ * thread, as a thread of the pool would.
+ */
+
+#ifndef HOST_SYS_DISPATCH_H
+#define HOST_SYS_DISPATCH_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/neutrino.h>
+
+#ifndef RESMGR_HANDLE_T
+#define RESMGR_HANDLE_T void
+#endif
+
+#ifndef RESMGR_OCB_T
+#define RESMGR_OCB_T void
+#endif
+
+#ifndef THREAD_POOL_PARAM_T
+#define THREAD_POOL_PARAM_T void
+#endif
+
+typedef struct _dispatch dispatch_t;
+
+struct _msg_info {
+  uint32_t  nd;
+  uint32_t  srcnd;
+  pid_t     pid;
+  int32_t   tid;
+  int32_t   chid;
+  int32_t   scoid;
+  int32_t   coid;
+  int32_t   msglen;                     // bytes in the receive buffer
+  int32_t   srcmsglen;                  // bytes sent
+  int32_t   dstmsglen;                  // reply buffer size
+  int16_t   priority;
+  int16_t   flags;
+  uint32_t  reserved;
+};
+
+typedef struct _resmgr_context {
+  int               rcvid;
+  struct _msg_info  info;
+  void              *msg;               // receive buffer, msg_max_size bytes
+  dispatch_t        *dpp;
+  int               id;
+  unsigned          tid;
+  unsigned          msg_max_size;
+  int               status;
+  int               offset;
+  int               size;
+  iov_t             iov[1];
+} resmgr_context_t;
+
+typedef resmgr_context_t  message_context_t;
+typedef resmgr_context_t  dispatch_context_t;
+
+typedef struct _resmgr_attr {
+  unsigned  flags;
+  unsigned  nparts_max;
+  unsigned  msg_max_size;
+  int       (*other_func)(resmgr_context_t *ctp, void *msg);
+  unsigned  reserved[4];
+} resmgr_attr_t;
+
+#define _RESMGR_NOREPLY       INT32_MIN
+#define _RESMGR_DEFAULT       (INT32_MIN + 1)
+#define _RESMGR_ERRNO(_err)   (_err)
+#define _RESMGR_NPARTS(_n)    (-(_n))
+#define _RESMGR_PTR(_ctp, _addr, _len) (SETIOV((_ctp)->iov, (_addr), (_len)), _RESMGR_NPARTS(1))
+
+// Messages
+
+#define _IO_CONNECT           0x100
+#define _IO_READ              0x101
+#define _IO_WRITE             0x102
+#define _IO_CLOSE             0x103
+#define _IO_NOTIFY            0x104
+#define _IO_DEVCTL            0x105
+
+#define _IO_XTYPE_NONE        0x00000000
+#define _IO_XTYPE_MASK        0x000000FF
+
+#define _IO_FLAG_RD           0x00000001
+#define _IO_FLAG_WR           0x00000002
+
+#define _FTYPE_ANY            0
+
+#define _IO_SET_READ_NBYTES(_ctp, _nbytes)  ((_ctp)->status = (_nbytes))
+#define _IO_SET_WRITE_NBYTES(_ctp, _nbytes) ((_ctp)->status = (_nbytes))
+
+struct _io_connect {
+  uint16_t  type;
+  uint16_t  subtype;
+  uint32_t  file_type;
+  uint16_t  reply_max;
+  uint16_t  entry_max;
+  uint32_t  key;
+  uint32_t  handle;
+  uint32_t  ioflag;                     // O_* with the access mode + 1 (_IO_FLAG_RD, _IO_FLAG_WR)
+  uint32_t  mode;
+  uint16_t  sflag;
+  uint16_t  access;
+  uint16_t  zero;
+  uint16_t  path_len;
+  uint8_t   eflag;
+  uint8_t   extra_type;
+  uint16_t  extra_len;
+  char      path[1];
+};
+
+typedef union {
+  struct _io_connect connect;
+} io_open_t;
+
+struct _io_read {
+  uint16_t  type;
+  uint16_t  combine_len;
+  int32_t   nbytes;
+  uint32_t  xtype;
+  uint32_t  zero;
+};
+
+typedef union {
+  struct _io_read i;
+} io_read_t;
+
+struct _io_write {
+  uint16_t  type;
+  uint16_t  combine_len;
+  int32_t   nbytes;
+  uint32_t  xtype;
+  uint32_t  zero;
+};
+
+typedef union {
+  struct _io_write i;
+} io_write_t;
+
+struct _io_close {
+  uint16_t  type;
+  uint16_t  combine_len;
+};
+
+typedef union {
+  struct _io_close i;
+} io_close_t;
+
+struct _io_devctl {
+  uint16_t  type;
+  uint16_t  combine_len;
+  int32_t   dcmd;
+  int32_t   nbytes;
+  int32_t   zero;
+};
+
+struct _io_devctl_reply {
+  uint32_t  zero;
+  int32_t   ret_val;
+  int32_t   nbytes;
+  int32_t   zero2;
+};
+
+typedef union {
+  struct _io_devctl       i;
+  struct _io_devctl_reply o;
+} io_devctl_t;
+
+#define _DEVCTL_DATA(_msg)    ((void *) (sizeof(_msg) + (char *) &(_msg)))
+
+struct _io_notify {
+  uint16_t        type;
+  uint16_t        combine_len;
+  int32_t         action;
+  int32_t         flags;
+  struct sigevent event;
+};
+
+struct _io_notify_reply {
+  uint32_t  zero;
+  uint32_t  flags;
+};
+
+typedef union {
+  struct _io_notify       i;
+  struct _io_notify_reply o;
+} io_notify_t;
+
+typedef struct {
+  unsigned  nfuncs;
+  int       (*open)(resmgr_context_t *ctp, io_open_t *msg, RESMGR_HANDLE_T *handle, void *extra);
+} resmgr_connect_funcs_t;
+
+typedef struct {
+  unsigned  nfuncs;
+  int       (*read)(resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb);
+  int       (*write)(resmgr_context_t *ctp, io_write_t *msg, RESMGR_OCB_T *ocb);
+  int       (*close_ocb)(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb);
+  int       (*notify)(resmgr_context_t *ctp, io_notify_t *msg, RESMGR_OCB_T *ocb);
+  int       (*devctl)(resmgr_context_t *ctp, io_devctl_t *msg, RESMGR_OCB_T *ocb);
+  int       (*lock_ocb)(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb);
+  int       (*unlock_ocb)(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb);
+} resmgr_io_funcs_t;
+
+#define _RESMGR_CONNECT_NFUNCS  1
+#define _RESMGR_IO_NFUNCS       7
+
+dispatch_t  *dispatch_create(void);
+int         resmgr_attach(dispatch_t *dpp, resmgr_attr_t *attr, const char *path, int file_type, unsigned flags,
+                          const resmgr_connect_funcs_t *connect_funcs, const resmgr_io_funcs_t *io_funcs,
+                          void *handle);
+int         resmgr_msgread(resmgr_context_t *ctp, void *msg, int size, int offset);
+int         resmgr_msgwrite(resmgr_context_t *ctp, const void *msg, int size, int offset);
+int         pulse_attach(dispatch_t *dpp, int flags, int code,
+                         int (*func)(message_context_t *ctp, int code, unsigned flags, void *handle), void *handle);
+
+dispatch_context_t  *dispatch_context_alloc(dispatch_t *dpp);
+void                dispatch_context_free(dispatch_context_t *ctp);
+dispatch_context_t  *dispatch_block(dispatch_context_t *ctp);
+void                dispatch_unblock(dispatch_context_t *ctp);
+int                 dispatch_handler(dispatch_context_t *ctp);
+
+typedef struct _thread_pool_attr {
+  dispatch_t          *handle;
+  THREAD_POOL_PARAM_T *(*block_func)(THREAD_POOL_PARAM_T *ctp);
+  void                (*unblock_func)(THREAD_POOL_PARAM_T *ctp);
+  int                 (*handler_func)(THREAD_POOL_PARAM_T *ctp);
+  THREAD_POOL_PARAM_T *(*context_alloc)(dispatch_t *handle);
+  void                (*context_free)(THREAD_POOL_PARAM_T *ctp);
+  pthread_attr_t      *attr;
+  unsigned short      lo_water;
+  unsigned short      increment;
+  unsigned short      hi_water;
+  unsigned short      maximum;
+} thread_pool_attr_t;
+
+typedef struct _thread_pool thread_pool_t;
+
+#define POOL_FLAG_EXIT_SELF   0x00000001
+
+thread_pool_t *thread_pool_create(thread_pool_attr_t *attr, unsigned flags);
+int           thread_pool_start(void *pool);
+
+#endif
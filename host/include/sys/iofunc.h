@@ -0,0 +1,137 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the POSIX layer helpers (iofunc) the driver uses, on Linux
+ */
+
+#ifndef HOST_SYS_IOFUNC_H
+#define HOST_SYS_IOFUNC_H
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct _iofunc_attr;
+struct _iofunc_ocb;
+
+#ifndef IOFUNC_ATTR_T
+#define IOFUNC_ATTR_T   struct _iofunc_attr
+#endif
+
+#ifndef IOFUNC_OCB_T
+#define IOFUNC_OCB_T    struct _iofunc_ocb
+#endif
+
+#ifndef RESMGR_HANDLE_T
+#define RESMGR_HANDLE_T IOFUNC_ATTR_T
+#endif
+
+#ifndef RESMGR_OCB_T
+#define RESMGR_OCB_T    IOFUNC_OCB_T
+#endif
+
+#include <sys/dispatch.h>
+
+#ifndef S_IFNAM
+#define S_IFNAM         0050000
+#endif
+
+typedef struct _iofunc_funcs {
+  unsigned      nfuncs;
+  IOFUNC_OCB_T  *(*ocb_calloc)(resmgr_context_t *ctp, IOFUNC_ATTR_T *attr);
+  void          (*ocb_free)(IOFUNC_OCB_T *ocb);
+} iofunc_funcs_t;
+
+#define _IOFUNC_NFUNCS  2
+
+typedef struct _iofunc_mount {
+  uint32_t        flags;
+  uint32_t        conf;
+  dev_t           dev;
+  int32_t         blocksize;
+  iofunc_funcs_t  *funcs;
+} iofunc_mount_t;
+
+typedef struct _iofunc_attr {
+  pthread_mutex_t lock;
+  uint32_t        flags;
+  int32_t         count;
+  uint32_t        rcount;
+  uint32_t        wcount;
+  off_t           nbytes;
+  mode_t          mode;
+  uid_t           uid;
+  gid_t           gid;
+  iofunc_mount_t  *mount;
+} iofunc_attr_t;
+
+typedef struct _iofunc_ocb {
+  IOFUNC_ATTR_T   *attr;
+  int32_t         ioflag;
+  off_t           offset;
+  uint16_t        sflag;
+  uint16_t        flags;
+} iofunc_ocb_t;
+
+// Notification: the host build keeps no armed events, triggers are dropped
+
+typedef struct {
+  int             cnt;
+  void            *list;
+} iofunc_notify_t;
+
+#define IOFUNC_NOTIFY_INPUT   0
+#define IOFUNC_NOTIFY_OUTPUT  1
+#define IOFUNC_NOTIFY_OBAND   2
+
+#define IOFUNC_NOTIFY_INIT(_notify) \
+  ((_notify)[IOFUNC_NOTIFY_INPUT].list = (_notify)[IOFUNC_NOTIFY_OUTPUT].list = (_notify)[IOFUNC_NOTIFY_OBAND].list = NULL)
+
+#define _NOTIFY_COND_INPUT    0x10000000
+#define _NOTIFY_COND_OUTPUT   0x20000000
+#define _NOTIFY_COND_OBAND    0x40000000
+
+void  iofunc_func_init(unsigned nconnect, resmgr_connect_funcs_t *connect, unsigned nio, resmgr_io_funcs_t *io);
+void  iofunc_attr_init(iofunc_attr_t *attr, mode_t mode, iofunc_attr_t *dattr, void *info);
+int   iofunc_attr_lock(iofunc_attr_t *attr);
+int   iofunc_attr_unlock(iofunc_attr_t *attr);
+int   iofunc_open(resmgr_context_t *ctp, io_open_t *msg, iofunc_attr_t *attr, iofunc_attr_t *dattr, void *info);
+int   iofunc_ocb_attach(resmgr_context_t *ctp, io_open_t *msg, IOFUNC_OCB_T *ocb, iofunc_attr_t *attr,
+                        const resmgr_io_funcs_t *io_funcs);
+int   iofunc_close_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb);
+int   iofunc_read_verify(resmgr_context_t *ctp, io_read_t *msg, iofunc_ocb_t *ocb, int *nonblock);
+int   iofunc_write_verify(resmgr_context_t *ctp, io_write_t *msg, iofunc_ocb_t *ocb, int *nonblock);
+int   iofunc_notify(resmgr_context_t *ctp, io_notify_t *msg, iofunc_notify_t *notify, int trig,
+                    const int *notifycounts, int *armed);
+void  iofunc_notify_trigger(iofunc_notify_t *notify, int count, int index);
+void  iofunc_notify_remove(resmgr_context_t *ctp, iofunc_notify_t *notify);
+
+// The defaults iofunc_func_init sets
+int   iofunc_open_default(resmgr_context_t *ctp, io_open_t *msg, iofunc_attr_t *attr, void *extra);
+int   iofunc_lock_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb);
+int   iofunc_unlock_ocb_default(resmgr_context_t *ctp, void *reserved, iofunc_ocb_t *ocb);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: the part of <sys/neutrino.h> the driver uses, on Linux
+ */
+
+#ifndef HOST_SYS_NEUTRINO_H
+#define HOST_SYS_NEUTRINO_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+typedef struct iovec iov_t;
+
+#define SETIOV(_iov, _addr, _len) ((_iov)->iov_base = (void *) (_addr), (_iov)->iov_len = (_len))
+#define GETIOVBASE(_iov)          ((_iov)->iov_base)
+#define GETIOVLEN(_iov)           ((_iov)->iov_len)
+
+struct _clockperiod {
+  uint32_t nsec;
+  int32_t  fract;
+};
+
+struct _pulse {
+  uint16_t      type;
+  uint16_t      subtype;
+  int8_t        code;
+  uint8_t       zero[3];
+  union sigval  value;
+  int32_t       scoid;
+};
+
+// Cycles are nanoseconds of CLOCK_MONOTONIC on the host
+uint64_t  ClockCycles(void);
+int       ClockPeriod(clockid_t id, const struct _clockperiod *new, struct _clockperiod *old, int reserved);
+
+/*
+ * Real-time priorities need privileges on Linux. The driver threads run with
+ * the scheduling of the process there, their priorities are only asked for.
+ */
+#define pthread_attr_setinheritsched(_attr, _inherit) pthread_attr_setinheritsched((_attr), PTHREAD_INHERIT_SCHED)
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Request benchmark on the simulated chip: every devctl is sent through
+ * io_devctl n times and reported as requests per second and as simulated I/O
+ * port accesses (inb/outb) per request. A case with an undo is measured as a
+ * pair, e.g. REQ_PIN with the FREE_PIN that gives the pin back.
+ *
+ *   vt1211_bench [-n requests] [-l latency_ns]
+ *
+ * -l is the cost of one simulated I/O access, 1000 ns (an ISA cycle) by
+ * default, 0 measures the driver alone.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/neutrino.h>
+#include "../vt1211_ipc.h"
+#include "../vt1211_hw.h"
+#include "host.h"
+#include "vt1211_cases.h"
+
+static int bench_case(const vt1211_case_t *c, uint32_t count) {
+  uint8_t   data[CASE_DATA_MAX];
+  uint64_t  reads[2];
+  uint64_t  writes[2];
+  uint64_t  start;
+  uint64_t  elapsed;
+  uint32_t  errors = 0;
+  char      name[48];
+
+  vt1211_sim_counters(&reads[0], &writes[0]);
+  start = ClockCycles();
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (vt1211_case_send(c, data) != EOK)
+      ++errors;
+
+    if (c->undo != NULL && vt1211_case_send(c->undo, data) != EOK)
+      ++errors;
+  }
+
+  elapsed = ClockCycles() - start;
+  vt1211_sim_counters(&reads[1], &writes[1]);
+
+  if (c->undo != NULL) {
+    snprintf(name, sizeof(name), "%s + %s", c->name, c->undo->name);
+  } else {
+    snprintf(name, sizeof(name), "%s", c->name);
+  }
+
+  printf("%-28s %12.0f %10.1f %9.2f %9.2f %8u\n", name,
+         count * 1e9 / elapsed, (double) elapsed / count,
+         (double) (reads[1] - reads[0]) / count, (double) (writes[1] - writes[0]) / count, errors);
+
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  uint32_t  count   = 100000;
+  char      latency[16] = "1000";
+  char      *args[] = { "vt1211_nto", "-p", "-f", "1", "-S", latency, NULL };
+  int       errors  = 0;
+  int       opt;
+  int       rc;
+
+  while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+    switch (opt) {
+      case 'n': {
+        count = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'l': {
+        snprintf(latency, sizeof(latency), "%s", optarg);
+        break;
+      }
+      default: {
+        fprintf(stderr, "usage: %s [-n requests] [-l latency_ns]\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (count == 0)
+    count = 1;
+
+  optind = 1;
+
+  if (host_start(6, args) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: the driver didn't start\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((rc = vt1211_cases_setup()) != EOK) {
+    fprintf(stderr, "%s: setup failed: %s (%d)\n", argv[0], strerror(rc), rc);
+    return EXIT_FAILURE;
+  }
+
+  printf("%u requests per case, simulated I/O access %s ns\n\n", count, latency);
+  printf("%-28s %12s %10s %9s %9s %8s\n", "request", "req/s", "ns/req", "inb/req", "outb/req", "errors");
+
+  for (int i = 0; i < vt1211_cases_count; ++i) {
+    errors += bench_case(&vt1211_cases[i], count);
+  }
+
+  return errors != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,410 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include "../vt1211_ipc.h"
+#include "host.h"
+#include "vt1211_cases.h"
+
+#define CASE_BATCH_OPS  8
+
+int vt1211_cases_fds[CASE_FDS];
+
+static uint32_t group_id;
+
+static size_t fill_none(void *data) {
+  return 0;
+}
+
+static size_t fill_info(void *data) {
+  memset(data, 0, sizeof(gpio_portsinfo_t));
+  return sizeof(gpio_portsinfo_t);
+}
+
+static size_t fill_data(void *data, uint8_t port, uint8_t pin, uint8_t value) {
+  gpio_data_t *d = data;
+
+  d->port = port;
+  d->pin  = pin;
+  d->data = value;
+  return sizeof(gpio_data_t);
+}
+
+static size_t fill_config_pin(void *data) {
+  return fill_data(data, VT1211_PORT_1, VT1211_PIN_0, VT1211_PIN_OUTPUT);
+}
+
+static size_t fill_set_pin(void *data) {
+  return fill_data(data, VT1211_PORT_1, VT1211_PIN_0, 1);
+}
+
+static size_t fill_get_pin(void *data) {
+  return fill_data(data, VT1211_PORT_1, VT1211_PIN_7, 0);
+}
+
+static size_t fill_config_port(void *data) {
+  return fill_data(data, VT1211_PORT_1, 0, 0x0F);
+}
+
+static size_t fill_set_port(void *data) {
+  return fill_data(data, VT1211_PORT_1, 0, 0x05);
+}
+
+static size_t fill_get_port(void *data) {
+  return fill_data(data, VT1211_PORT_1, 0, 0);
+}
+
+static size_t fill_pin_3(void *data) {
+  return fill_data(data, VT1211_PORT_3, VT1211_PIN_0, 0);
+}
+
+static size_t fill_port_4(void *data) {
+  return fill_data(data, VT1211_PORT_4, 0, 0);
+}
+
+static size_t fill_port_5(void *data) {
+  return fill_data(data, VT1211_PORT_5, 0, 0);
+}
+
+static size_t fill_batch(void *data) {
+  gpio_batch_t *batch = data;
+
+  batch->count = CASE_BATCH_OPS;
+  batch->done  = 0;
+
+  for (int i = 0; i < CASE_BATCH_OPS; ++i) {
+    batch->ops[i].op     = i & 1 ? VT1211_OP_GET_PIN : VT1211_OP_SET_PIN;
+    batch->ops[i].port   = VT1211_PORT_1;
+    batch->ops[i].pin    = 1 << (i >> 1);
+    batch->ops[i].data   = i >> 1 & 1;
+    batch->ops[i].result = 0;
+  }
+
+  return sizeof(gpio_batch_t) + CASE_BATCH_OPS * sizeof(gpio_batch_op_t);
+}
+
+static size_t fill_ports(void *data) {
+  gpio_ports_t *ports = data;
+
+  memset(ports, 0, sizeof(gpio_ports_t));
+  ports->mask                 = 1 << VT1211_PORT_1;
+  ports->data[VT1211_PORT_1]  = 0x0A;
+  return sizeof(gpio_ports_t);
+}
+
+static size_t fill_dirs(void *data) {
+  gpio_dirs_t *dirs = data;
+
+  memset(dirs, 0, sizeof(gpio_dirs_t));
+  dirs->mask                = 1 << VT1211_PORT_1;
+  dirs->pins[VT1211_PORT_1] = 0xFF;
+  dirs->dir[VT1211_PORT_1]  = 0x0F;
+  return sizeof(gpio_dirs_t);
+}
+
+static size_t fill_modify(void *data) {
+  gpio_modify_t *modify = data;
+
+  modify->port  = VT1211_PORT_1;
+  modify->op    = VT1211_MODIFY_TOGGLE;
+  modify->mask  = VT1211_PIN_1;
+  modify->value = 0;
+  return sizeof(gpio_modify_t);
+}
+
+static size_t fill_bind(void *data) {
+  gpio_bind_t *bind = data;
+
+  bind->mode = VT1211_BIND_NONE;
+  bind->port = 0;
+  return sizeof(gpio_bind_t);
+}
+
+static size_t fill_bind_sampler(void *data) {
+  gpio_bind_t *bind = data;
+
+  bind->mode = VT1211_BIND_SAMPLER;
+  bind->port = 0;
+  return sizeof(gpio_bind_t);
+}
+
+static size_t fill_samples(void *data) {
+  gpio_samples_t *samples = data;
+
+  samples->count    = 16;
+  samples->overflow = 0;
+  return sizeof(gpio_samples_t) + 16 * sizeof(gpio_sample_t);
+}
+
+static size_t fill_watch(void *data, uint8_t mask) {
+  gpio_watch_t *watch = data;
+
+  watch->port      = VT1211_PORT_1;
+  watch->mask      = mask;
+  watch->edge      = VT1211_EDGE_BOTH;
+  watch->period_us = 0;
+  return sizeof(gpio_watch_t);
+}
+
+static size_t fill_watch_on(void *data) {
+  return fill_watch(data, VT1211_PIN_7);
+}
+
+static size_t fill_watch_off(void *data) {
+  return fill_watch(data, 0);
+}
+
+static size_t fill_events(void *data) {
+  memset(data, 0, sizeof(gpio_events_t));
+  return sizeof(gpio_events_t);
+}
+
+static size_t fill_pattern(void *data) {
+  gpio_pattern_t *pattern = data;
+
+  memset(pattern, 0, sizeof(gpio_pattern_t) + 2 * sizeof(gpio_pattern_step_t));
+  pattern->port   = VT1211_PORT_1;
+  pattern->repeat = 1;
+  pattern->count  = 2;
+  pattern->steps[0].mask  = VT1211_PIN_2;
+  pattern->steps[0].value = VT1211_PIN_2;
+  pattern->steps[1].mask  = VT1211_PIN_2;
+  pattern->steps[1].value = 0;
+  return sizeof(gpio_pattern_t) + 2 * sizeof(gpio_pattern_step_t);
+}
+
+static size_t fill_pattern_status(void *data) {
+  memset(data, 0, sizeof(gpio_pattern_status_t));
+  return sizeof(gpio_pattern_status_t);
+}
+
+static size_t fill_pwm(void *data, uint32_t period_us) {
+  gpio_pwm_t *pwm = data;
+
+  memset(pwm, 0, sizeof(gpio_pwm_t));
+  pwm->port      = VT1211_PORT_1;
+  pwm->pin       = VT1211_PIN_3;
+  pwm->period_us = period_us;
+  pwm->duty_us   = period_us / 2;
+  return sizeof(gpio_pwm_t);
+}
+
+static size_t fill_pwm_on(void *data) {
+  return fill_pwm(data, 1000);
+}
+
+static size_t fill_pwm_off(void *data) {
+  return fill_pwm(data, 0);
+}
+
+static size_t fill_debounce(void *data, uint8_t count) {
+  gpio_debounce_t *debounce = data;
+
+  debounce->port  = VT1211_PORT_1;
+  debounce->mask  = VT1211_PIN_7;
+  debounce->count = count;
+  return sizeof(gpio_debounce_t);
+}
+
+static size_t fill_debounce_on(void *data) {
+  return fill_debounce(data, 3);
+}
+
+static size_t fill_debounce_off(void *data) {
+  return fill_debounce(data, 0);
+}
+
+static size_t fill_trace(void *data) {
+  gpio_trace_ctl_t *trace = data;
+
+  trace->enable = 0;
+  return sizeof(gpio_trace_ctl_t);
+}
+
+static size_t fill_stats(void *data) {
+  gpio_stats_t *stats = data;
+
+  memset(stats, 0, sizeof(gpio_stats_t));
+  stats->cmd = VT1211_GET_PIN & 0xFF;
+  return sizeof(gpio_stats_t);
+}
+
+static size_t fill_bus(void *data) {
+  gpio_bus_t *bus = data;
+
+  memset(bus, 0, sizeof(gpio_bus_t));
+  bus->type = VT1211_BUS_SPI;
+  bus->port = VT1211_PORT_5;
+  bus->clk  = VT1211_PIN_0;
+  bus->mosi = VT1211_PIN_1;
+  bus->miso = VT1211_PIN_2;
+  bus->cs   = VT1211_PIN_3;
+  return sizeof(gpio_bus_t);
+}
+
+static size_t fill_bus_xfer(void *data) {
+  gpio_bus_xfer_t *xfer = data;
+
+  memset(xfer, 0, sizeof(gpio_bus_xfer_t) + 4);
+  xfer->wlen    = 2;
+  xfer->rlen    = 2;
+  xfer->data[0] = 0x9F;
+  xfer->data[1] = 0x00;
+  return sizeof(gpio_bus_xfer_t) + 4;
+}
+
+static size_t fill_group(void *data) {
+  gpio_group_t *group = data;
+
+  memset(group, 0, sizeof(gpio_group_t));
+  strcpy(group->name, "case");
+  group->count = 4;
+
+  for (uint8_t bit = 0; bit < 4; ++bit) {
+    group->members[bit].port = VT1211_PORT_1;
+    group->members[bit].pin  = 1 << bit;
+  }
+
+  return sizeof(gpio_group_t);
+}
+
+static size_t fill_group_find(void *data) {
+  gpio_group_t *group = data;
+
+  memset(group, 0, sizeof(gpio_group_t));
+  strcpy(group->name, "case");
+  return sizeof(gpio_group_t);
+}
+
+static size_t fill_group_value(void *data) {
+  gpio_group_value_t *value = data;
+
+  value->id    = group_id;
+  value->value = 0x9;
+  return sizeof(gpio_group_value_t);
+}
+
+static size_t fill_capture(void *data, uint8_t mask) {
+  gpio_capture_t *capture = data;
+
+  memset(capture, 0, sizeof(gpio_capture_t));
+  capture->mask[VT1211_PORT_6]  = mask;
+  capture->edge                 = VT1211_EDGE_BOTH;
+  capture->depth                = 64;
+  return sizeof(gpio_capture_t);
+}
+
+static size_t fill_capture_on(void *data) {
+  return fill_capture(data, 0x07);
+}
+
+static size_t fill_capture_off(void *data) {
+  return fill_capture(data, 0);
+}
+
+static size_t fill_capture_stats(void *data) {
+  memset(data, 0, sizeof(gpio_capture_stats_t));
+  return sizeof(gpio_capture_stats_t);
+}
+
+static const vt1211_case_t free_pin     = { "FREE_PIN",       VT1211_FREE_PIN,      CASE_FD_MAIN,    fill_pin_3,        NULL };
+static const vt1211_case_t free_port    = { "FREE_PORT",      VT1211_FREE_PORT,     CASE_FD_MAIN,    fill_port_4,       NULL };
+static const vt1211_case_t watch_off    = { "WATCH off",      VT1211_WATCH,         CASE_FD_MAIN,    fill_watch_off,    NULL };
+static const vt1211_case_t pattern_stop = { "PATTERN_STOP",   VT1211_PATTERN_STOP,  CASE_FD_MAIN,    fill_none,         NULL };
+static const vt1211_case_t pwm_off      = { "PWM_CONFIG off", VT1211_PWM_CONFIG,    CASE_FD_MAIN,    fill_pwm_off,      NULL };
+static const vt1211_case_t capture_off  = { "CAPTURE off",    VT1211_CAPTURE,       CASE_FD_CAPTURE, fill_capture_off,  NULL };
+static const vt1211_case_t debounce_off = { "DEBOUNCE off",   VT1211_DEBOUNCE,      CASE_FD_MAIN,    fill_debounce_off, NULL };
+
+const vt1211_case_t vt1211_cases[] = {
+  { "GET_INFO",       VT1211_GET_INFO,        CASE_FD_MAIN,     fill_info,            NULL },
+  { "CONFIG_PIN",     VT1211_CONFIG_PIN,      CASE_FD_MAIN,     fill_config_pin,      NULL },
+  { "SET_PIN",        VT1211_SET_PIN,         CASE_FD_MAIN,     fill_set_pin,         NULL },
+  { "GET_PIN",        VT1211_GET_PIN,         CASE_FD_MAIN,     fill_get_pin,         NULL },
+  { "CONFIG_PORT",    VT1211_CONFIG_PORT,     CASE_FD_MAIN,     fill_config_port,     NULL },
+  { "SET_PORT",       VT1211_SET_PORT,        CASE_FD_MAIN,     fill_set_port,        NULL },
+  { "GET_PORT",       VT1211_GET_PORT,        CASE_FD_MAIN,     fill_get_port,        NULL },
+  { "REQ_PORT",       VT1211_REQ_PORT,        CASE_FD_MAIN,     fill_port_4,          &free_port },
+  { "REQ_PIN",        VT1211_REQ_PIN,         CASE_FD_MAIN,     fill_pin_3,           &free_pin },
+  { "BATCH",          VT1211_BATCH,           CASE_FD_MAIN,     fill_batch,           NULL },
+  { "GET_ALL",        VT1211_GET_ALL,         CASE_FD_MAIN,     fill_none,            NULL },
+  { "SET_MULTI",      VT1211_SET_MULTI,       CASE_FD_MAIN,     fill_ports,           NULL },
+  { "CONFIG_MULTI",   VT1211_CONFIG_MULTI,    CASE_FD_MAIN,     fill_dirs,            NULL },
+  { "RESYNC",         VT1211_RESYNC,          CASE_FD_MAIN,     fill_none,            NULL },
+  { "MODIFY_PORT",    VT1211_MODIFY_PORT,     CASE_FD_MAIN,     fill_modify,          NULL },
+  { "BIND",           VT1211_BIND,            CASE_FD_MAIN,     fill_bind,            NULL },
+  { "SAMPLER_READ",   VT1211_SAMPLER_READ,    CASE_FD_SAMPLER,  fill_samples,         NULL },
+  { "WATCH",          VT1211_WATCH,           CASE_FD_MAIN,     fill_watch_on,        &watch_off },
+  { "WATCH_EVENTS",   VT1211_WATCH_EVENTS,    CASE_FD_MAIN,     fill_events,          NULL },
+  { "PLAY_PATTERN",   VT1211_PLAY_PATTERN,    CASE_FD_MAIN,     fill_pattern,         &pattern_stop },
+  { "PATTERN_STATUS", VT1211_PATTERN_STATUS,  CASE_FD_MAIN,     fill_pattern_status,  NULL },
+  { "PWM_CONFIG",     VT1211_PWM_CONFIG,      CASE_FD_MAIN,     fill_pwm_on,          &pwm_off },
+  { "DEBOUNCE",       VT1211_DEBOUNCE,        CASE_FD_MAIN,     fill_debounce_on,     &debounce_off },
+  { "RENEW",          VT1211_RENEW,           CASE_FD_MAIN,     fill_none,            NULL },
+  { "TRACE",          VT1211_TRACE,           CASE_FD_MAIN,     fill_trace,           NULL },
+  { "GET_STATS",      VT1211_GET_STATS,       CASE_FD_MAIN,     fill_stats,           NULL },
+  { "STATS_RESET",    VT1211_STATS_RESET,     CASE_FD_MAIN,     fill_none,            NULL },
+  { "BUS_CONFIG",     VT1211_BUS_CONFIG,      CASE_FD_BUS,      fill_bus,             NULL },
+  { "BUS_XFER",       VT1211_BUS_XFER,        CASE_FD_BUS,      fill_bus_xfer,        NULL },
+  { "GROUP_DEFINE",   VT1211_GROUP_DEFINE,    CASE_FD_MAIN,     fill_group,           NULL },
+  { "GROUP_FIND",     VT1211_GROUP_FIND,      CASE_FD_MAIN,     fill_group_find,      NULL },
+  { "GROUP_WRITE",    VT1211_GROUP_WRITE,     CASE_FD_MAIN,     fill_group_value,     NULL },
+  { "GROUP_READ",     VT1211_GROUP_READ,      CASE_FD_MAIN,     fill_group_value,     NULL },
+  { "CAPTURE",        VT1211_CAPTURE,         CASE_FD_CAPTURE,  fill_capture_on,      &capture_off },
+  { "CAPTURE_STATS",  VT1211_CAPTURE_STATS,   CASE_FD_CAPTURE,  fill_capture_stats,   NULL },
+};
+
+const int vt1211_cases_count = sizeof(vt1211_cases) / sizeof(vt1211_cases[0]);
+
+int vt1211_case_send(const vt1211_case_t *c, void *data) {
+  return devctl(vt1211_cases_fds[c->fd], c->dcmd, data, c->fill(data), NULL);
+}
+
+int vt1211_cases_setup(void) {
+  static const vt1211_case_t setup[] = {
+    { "REQ_PORT 1",     VT1211_REQ_PORT,      CASE_FD_MAIN,     fill_get_port,        NULL },
+    { "GROUP_DEFINE",   VT1211_GROUP_DEFINE,  CASE_FD_MAIN,     fill_group,           NULL },
+    { "REQ_PORT 5",     VT1211_REQ_PORT,      CASE_FD_BUS,      fill_port_5,          NULL },
+    { "BUS_CONFIG",     VT1211_BUS_CONFIG,    CASE_FD_BUS,      fill_bus,             NULL },
+    { "BIND",           VT1211_BIND,          CASE_FD_SAMPLER,  fill_bind_sampler,    NULL },
+  };
+  uint8_t data[CASE_DATA_MAX];
+  int     rc;
+
+  for (int fd = 0; fd < CASE_FDS; ++fd) {
+    if ((vt1211_cases_fds[fd] = host_open("/dev/vt1211", O_RDWR)) == -1)
+      return errno;
+  }
+
+  for (size_t i = 0; i < sizeof(setup) / sizeof(setup[0]); ++i) {
+    if ((rc = vt1211_case_send(&setup[i], data)) != EOK)
+      return rc;
+
+    if (setup[i].dcmd == VT1211_GROUP_DEFINE)
+      group_id = ((gpio_group_t *) data)->id;
+  }
+
+  return EOK;
+}
@@ -0,0 +1,71 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Host build: a valid request for every devctl of the driver, for the
+ * benchmark and the tests. vt1211_cases_setup opens the descriptors the
+ * requests are sent on and prepares the state they need:
+ *   CASE_FD_MAIN     owns port 1 (index 0), group "case" on its pins 0..3
+ *   CASE_FD_BUS      owns port 5 (index 3), SPI on its pins 0..3
+ *   CASE_FD_CAPTURE  for the capture of port 6 (index 4), nobody owns it
+ *   CASE_FD_SAMPLER  bound to the sampler
+ * Ports 3 and 4 (indexes 1, 2) are left free for the request/free cases.
+ * A case with an undo leaves the driver as it found it once the undo is
+ * sent, so the cases can be repeated in any order. Nothing is left running
+ * between the cases but the sampler, the I/O of the driver threads stays
+ * out of the counts of the requests.
+ */
+
+#ifndef VT1211_CASES_H
+#define VT1211_CASES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CASE_FD_MAIN      0
+#define CASE_FD_BUS       1
+#define CASE_FD_CAPTURE   2
+#define CASE_FD_SAMPLER   3
+#define CASE_FDS          4
+
+#define CASE_DATA_MAX     8192
+
+typedef struct vt1211_case vt1211_case_t;
+
+struct vt1211_case {
+  const char          *name;
+  uint32_t            dcmd;
+  int                 fd;                 // CASE_FD_*
+  size_t              (*fill)(void *data); // request data, returns its size
+  const vt1211_case_t *undo;
+};
+
+extern const vt1211_case_t  vt1211_cases[];
+extern const int            vt1211_cases_count;
+extern int                  vt1211_cases_fds[CASE_FDS];
+
+// The driver must be started with -p and -f (5 ports and the sampler on)
+int vt1211_cases_setup(void);
+int vt1211_case_send(const vt1211_case_t *c, void *data);
+
+#endif
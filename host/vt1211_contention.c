@@ -0,0 +1,255 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Contention benchmark on the simulated chip: 1 to N client threads each own
+ * a port of their own and hammer it with SET_PORT and GET_PORT. Requests on
+ * different ports only share the descriptor-free paths of the driver, so the
+ * throughput should grow with the threads until the ports run out or the
+ * host runs out of cores.
+ *
+ * A simulated access sleeps, so a client waiting on its port leaves the CPU
+ * to the others. The expected speedup with n threads is n, bounded by the CPU
+ * time of a request: with c ns of CPU out of t ns of wall time per request on
+ * the single thread, the cores can keep at most cores * t / c requests in
+ * flight. It is printed next to the measured one.
+ *
+ *   vt1211_contention [-t threads] [-n requests] [-l latency_ns]
+ *
+ * -t is the largest number of client threads, one per port by default and at
+ * most. Port requests need the port, so two clients can't share one.
+ * -l is the cost of one simulated I/O access, 10 us by default to leave room
+ * for the overlap.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/neutrino.h>
+#include "../vt1211_ipc.h"
+#include "../vt1211_hw.h"
+#include "host.h"
+
+// Client pids, apart from the pid 0 of the main thread
+#define CONTENTION_PID_BASE   0x100
+
+typedef struct {
+  pthread_t   thread;
+  int         index;
+  uint8_t     port;
+  uint32_t    count;
+  uint32_t    errors;
+} contention_client_t;
+
+static pthread_barrier_t  start_barrier;
+static pthread_barrier_t  stop_barrier;
+
+static void *contention_client(void *arg) {
+  contention_client_t *client = arg;
+  gpio_data_t         data    = { .port = client->port };
+  int                 fd;
+
+  host_client(CONTENTION_PID_BASE + client->index);
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1) {
+    client->errors = client->count;
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&stop_barrier);
+    return NULL;
+  }
+
+  if (devctl(fd, VT1211_REQ_PORT, &data, sizeof(data), NULL) != EOK)
+    ++client->errors;
+
+  data.data = VT1211_PORT_OUTPUT;
+
+  if (devctl(fd, VT1211_CONFIG_PORT, &data, sizeof(data), NULL) != EOK)
+    ++client->errors;
+
+  pthread_barrier_wait(&start_barrier);
+
+  for (uint32_t i = 0; i < client->count; ++i) {
+    data.data = (uint8_t) i;
+
+    if (devctl(fd, VT1211_SET_PORT, &data, sizeof(data), NULL) != EOK)
+      ++client->errors;
+
+    if (devctl(fd, VT1211_GET_PORT, &data, sizeof(data), NULL) != EOK)
+      ++client->errors;
+  }
+
+  pthread_barrier_wait(&stop_barrier);
+
+  devctl(fd, VT1211_FREE_PORT, &data, sizeof(data), NULL);
+
+  host_close(fd);
+
+  return NULL;
+}
+
+static uint64_t contention_cpu(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Runs the threads, returns the number of failed requests and sets the
+ * requests per second and the CPU time per request
+ */
+static int contention_run(int threads, uint32_t count, double *rate, double *cpu_ns) {
+  contention_client_t clients[threads];
+  uint64_t            start;
+  uint64_t            elapsed;
+  uint64_t            cpu;
+  uint32_t            errors = 0;
+
+  pthread_barrier_init(&start_barrier, NULL, threads + 1);
+  pthread_barrier_init(&stop_barrier, NULL, threads + 1);
+
+  for (int i = 0; i < threads; ++i) {
+    clients[i].index  = i;
+    clients[i].port   = i;
+    clients[i].count  = count;
+    clients[i].errors = 0;
+    pthread_create(&clients[i].thread, NULL, contention_client, &clients[i]);
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  start   = ClockCycles();
+  cpu     = contention_cpu();
+  pthread_barrier_wait(&stop_barrier);
+  elapsed = ClockCycles() - start;
+  cpu     = contention_cpu() - cpu;
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(clients[i].thread, NULL);
+    errors += clients[i].errors;
+  }
+
+  pthread_barrier_destroy(&start_barrier);
+  pthread_barrier_destroy(&stop_barrier);
+
+  // SET_PORT and GET_PORT are two requests
+  *rate   = 2.0 * count * threads * 1e9 / elapsed;
+  *cpu_ns = cpu / (2.0 * count * threads);
+
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  uint32_t          count   = 100000;
+  int               threads = 0;
+  char              latency[16] = "10000";
+  char              *args[] = { "vt1211_nto", "-p", "-f", "1", "-S", latency, NULL };
+  gpio_portsinfo_t  info;
+  double            base    = 0;
+  double            bound   = 0;
+  double            speedup = 0;
+  long              cores   = sysconf(_SC_NPROCESSORS_ONLN);
+  int               errors  = 0;
+  int               opt;
+  int               fd;
+
+  while ((opt = getopt(argc, argv, "t:n:l:")) != -1) {
+    switch (opt) {
+      case 't': {
+        threads = atoi(optarg);
+        break;
+      }
+      case 'n': {
+        count = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'l': {
+        snprintf(latency, sizeof(latency), "%s", optarg);
+        break;
+      }
+      default: {
+        fprintf(stderr, "usage: %s [-t threads] [-n requests] [-l latency_ns]\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (count == 0)
+    count = 1;
+
+  optind = 1;
+
+  if (host_start(6, args) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: the driver didn't start\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1 ||
+      devctl(fd, VT1211_GET_INFO, &info, sizeof(info), NULL) != EOK || info.count == 0) {
+    fprintf(stderr, "%s: no ports\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  host_close(fd);
+
+  if (threads <= 0 || threads > info.count)
+    threads = info.count;
+
+  if (cores < 1)
+    cores = 1;
+
+  printf("%u SET_PORT + GET_PORT per thread, %u ports, %ld cores, simulated I/O access %s ns\n\n",
+         count, info.count, cores, latency);
+  printf("%-8s %12s %12s %10s %8s %8s %8s\n", "threads", "req/s", "req/s/thread", "cpu ns/req", "expected",
+         "speedup", "errors");
+
+  for (int n = 1; n <= threads; ++n) {
+    double  rate;
+    double  cpu_ns;
+    double  expected;
+    int     rc = contention_run(n, count, &rate, &cpu_ns);
+
+    // The single thread sets the CPU bound of the speedup
+    if (n == 1) {
+      base  = rate;
+      bound = cpu_ns > 0 ? cores * 1e9 / (rate * cpu_ns) : threads;
+    }
+
+    expected  = n < bound ? n : bound;
+    speedup   = rate / base;
+
+    printf("%-8d %12.0f %12.0f %10.0f %8.2f %8.2f %8d\n", n, rate, rate / n, cpu_ns, expected, speedup, rc);
+    errors += rc;
+  }
+
+  bound = threads < bound ? threads : bound;
+
+  printf("\n%d threads: expected %.2fx (%s), measured %.2fx, %.0f%% of expected\n", threads, bound,
+         bound == threads ? "one per port" : "CPU bound", speedup, 100 * speedup / bound);
+
+  return errors != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
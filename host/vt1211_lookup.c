@@ -0,0 +1,385 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Lookup microbenchmark on the simulated chip with no I/O latency, in two
+ * parts.
+ *
+ * The validation stage alone, before and after: vt1211_check is called
+ * straight on the OCB of the client, under the port lock as io_devctl holds
+ * it. The before column is the chain SET_PIN and GET_PIN used to run on the
+ * libds port table, a hashmap of ports each with a hashmap of its pins:
+ * port_check, pin_check, pin_check_perm and pin_is_busy, six lookups of
+ * {data, len} keys. libds isn't in the tree, lookup_map is a chained hashmap
+ * with the same keys, hashed and compared byte by byte.
+ *
+ * Whole requests through io_devctl: what is left is the dcmd table, the
+ * ownership checks and the bookkeeping around the handler. The unknown
+ * request stops right after the table lookup and is the floor. ns/lookup is
+ * what a request costs above it: the port lock, the ownership check of
+ * vt1211_check and the handler.
+ *
+ *   vt1211_lookup [-n requests]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/neutrino.h>
+#include "../vt1211_nto.h"
+#include "host.h"
+
+// The client holding the pin the main client has no rights to
+#define LOOKUP_PID_OTHER  0x7000
+
+// Not in the dcmd table
+#define LOOKUP_UNKNOWN    __DION (_DCMD_MISC, 0x2007FF)
+
+#define LOOKUP_BUCKETS    16
+
+typedef struct {
+  const char  *name;
+  int         dcmd;
+  gpio_data_t data;
+  int         expected;
+} lookup_case_t;
+
+typedef struct {
+  const char  *name;
+  gpio_data_t data;
+  int         expected;
+} lookup_check_t;
+
+struct hkey {
+  const void  *data;
+  size_t      len;
+};
+
+typedef struct lookup_entry {
+  struct lookup_entry *next;
+  uint8_t             key[sizeof(uint32_t)];
+  size_t              len;
+  void                *value;
+} lookup_entry_t;
+
+typedef struct {
+  lookup_entry_t *buckets[LOOKUP_BUCKETS];
+} lookup_map_t;
+
+typedef struct {
+  bool  busy;
+  pid_t pid;
+} lookup_pin_t;
+
+typedef struct {
+  bool          busy;
+  pid_t         pid;
+  lookup_map_t  pins;
+} lookup_port_t;
+
+static const lookup_case_t lookup_cases[] = {
+  { "unknown",          LOOKUP_UNKNOWN,     { 0 },                                ENOSYS },
+  { "GET_PIN own",      VT1211_GET_PIN,     { VT1211_PORT_3, VT1211_PIN_0, 0 },   EOK },
+  { "SET_PIN own",      VT1211_SET_PIN,     { VT1211_PORT_3, VT1211_PIN_0, 1 },   EOK },
+  { "GET_PIN other",    VT1211_GET_PIN,     { VT1211_PORT_3, VT1211_PIN_1, 0 },   VT1211_ERR_PERM },
+  { "SET_PIN other",    VT1211_SET_PIN,     { VT1211_PORT_3, VT1211_PIN_1, 1 },   VT1211_ERR_PERM },
+  { "GET_PIN bad port", VT1211_GET_PIN,     { VT1211_PORTS_MAX, VT1211_PIN_0, 0 }, VT1211_ERR_INCRCT_PORT },
+};
+
+static const lookup_check_t lookup_checks[] = {
+  { "own pin",    { VT1211_PORT_3, VT1211_PIN_0, 0 },     EOK },
+  { "other pin",  { VT1211_PORT_3, VT1211_PIN_1, 0 },     VT1211_ERR_PERM },
+  { "bad port",   { VT1211_PORTS_MAX, VT1211_PIN_0, 0 },  VT1211_ERR_INCRCT_PORT },
+};
+
+static lookup_map_t lookup_ports;
+
+static uint32_t lookup_hash(const struct hkey *key) {
+  const uint8_t *data = key->data;
+  uint32_t      hash  = 2166136261u;
+
+  for (size_t i = 0; i < key->len; ++i) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+static void *lookup_get(const lookup_map_t *map, const struct hkey *key) {
+  for (lookup_entry_t *entry = map->buckets[lookup_hash(key) % LOOKUP_BUCKETS]; entry; entry = entry->next) {
+    if (entry->len == key->len && memcmp(entry->key, key->data, key->len) == 0)
+      return entry->value;
+  }
+
+  return NULL;
+}
+
+static bool lookup_contains(const lookup_map_t *map, const struct hkey *key) {
+  return lookup_get(map, key) != NULL;
+}
+
+static void lookup_put(lookup_map_t *map, uint8_t id, void *value) {
+  lookup_entry_t  *entry  = calloc(1, sizeof(*entry));
+  struct hkey     key     = { &id, sizeof(id) };
+  uint32_t        bucket  = lookup_hash(&key) % LOOKUP_BUCKETS;
+
+  entry->key[0]       = id;
+  entry->len          = sizeof(id);
+  entry->value        = value;
+  entry->next         = map->buckets[bucket];
+  map->buckets[bucket] = entry;
+}
+
+// The port table as the driver kept it, with the pins of the two clients
+static void lookup_map_setup(const gpio_portsinfo_t *info, pid_t other_pid) {
+  for (uint8_t port = 0; port < info->count; ++port) {
+    lookup_port_t *port_status = calloc(1, sizeof(*port_status));
+
+    for (uint8_t pin = 0; pin < info->pins_by_port[port]; ++pin) {
+      lookup_pin_t *pin_status = calloc(1, sizeof(*pin_status));
+
+      if (port == VT1211_PORT_3 && (1 << pin) == VT1211_PIN_0) {
+        pin_status->busy = true;
+      } else if (port == VT1211_PORT_3 && (1 << pin) == VT1211_PIN_1) {
+        pin_status->busy = true;
+        pin_status->pid  = other_pid;
+      }
+
+      lookup_put(&port_status->pins, 1 << pin, pin_status);
+    }
+
+    lookup_put(&lookup_ports, port, port_status);
+  }
+}
+
+static bool lookup_port_check(const gpio_data_t *port_data) {
+  uint8_t     port_id   = port_data->port;
+  struct hkey port_key  = { &port_id, sizeof(port_id) };
+
+  return lookup_contains(&lookup_ports, &port_key);
+}
+
+static bool lookup_pin_check(const gpio_data_t *port_data) {
+  uint8_t     port_id   = port_data->port;
+  struct hkey port_key  = { &port_id, sizeof(port_id) };
+  uint8_t     pin_id    = port_data->pin;
+  struct hkey pin_key   = { &pin_id, sizeof(pin_id) };
+
+  lookup_port_t *port_status = lookup_get(&lookup_ports, &port_key);
+
+  return lookup_contains(&port_status->pins, &pin_key);
+}
+
+static bool lookup_pin_check_perm(pid_t pid, const gpio_data_t *port_data) {
+  uint8_t     port_id   = port_data->port;
+  struct hkey port_key  = { &port_id, sizeof(port_id) };
+  uint8_t     pin_id    = port_data->pin;
+  struct hkey pin_key   = { &pin_id, sizeof(pin_id) };
+
+  lookup_port_t *port_status = lookup_get(&lookup_ports, &port_key);
+  lookup_pin_t  *pin_status  = lookup_get(&port_status->pins, &pin_key);
+
+  return pin_status->pid == pid;
+}
+
+static bool lookup_pin_is_busy(const gpio_data_t *port_data) {
+  uint8_t     port_id   = port_data->port;
+  struct hkey port_key  = { &port_id, sizeof(port_id) };
+  uint8_t     pin_id    = port_data->pin;
+  struct hkey pin_key   = { &pin_id, sizeof(pin_id) };
+
+  lookup_port_t *port_status = lookup_get(&lookup_ports, &port_key);
+  lookup_pin_t  *pin_status  = lookup_get(&port_status->pins, &pin_key);
+
+  return pin_status->busy;
+}
+
+// The checks of SET_PIN and GET_PIN before vt1211_check
+static __attribute__((noinline)) int lookup_check_before(pid_t pid, const gpio_data_t *port_data) {
+  if (!lookup_port_check(port_data))
+    return VT1211_ERR_INCRCT_PORT;
+
+  if (!lookup_pin_check(port_data))
+    return VT1211_ERR_INCRCT_PIN;
+
+  if (!lookup_pin_check_perm(pid, port_data) && lookup_pin_is_busy(port_data))
+    return VT1211_ERR_PERM;
+
+  return EOK;
+}
+
+/*
+ * Runs the validation of the check count times, before and after, and prints
+ * the time per check of both
+ */
+static int lookup_check(vt1211_ocb_t *ocb, const lookup_check_t *c, uint32_t count) {
+  const gpio_data_t *data   = &c->data;
+  uint64_t          start;
+  uint64_t          before;
+  uint64_t          after;
+  uint32_t          errors  = 0;
+
+  start = ClockCycles();
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (lookup_check_before(0, data) != c->expected)
+      ++errors;
+  }
+
+  before = ClockCycles() - start;
+
+  vt1211_lock(1 << data->port);
+  start = ClockCycles();
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (vt1211_check(ocb, data->port, data->pin, VT1211_CHECK_PIN_PERM) != c->expected)
+      ++errors;
+  }
+
+  after = ClockCycles() - start;
+  vt1211_unlock(1 << data->port);
+
+  printf("%-20s %10.1f %10.1f %8.2f %8u\n", c->name, (double) before / count, (double) after / count,
+         (double) before / after, errors);
+
+  return errors;
+}
+
+/*
+ * Sends the case count times and prints it, ns is the time per request.
+ * floor_ns is taken away for the cost of the lookup itself, 0 for the floor
+ * case.
+ */
+static int lookup_case(int fd, const lookup_case_t *c, uint32_t count, double floor_ns, double *ns) {
+  gpio_data_t data;
+  uint64_t    start;
+  uint64_t    elapsed;
+  uint32_t    errors = 0;
+
+  start = ClockCycles();
+
+  for (uint32_t i = 0; i < count; ++i) {
+    data = c->data;
+
+    if (devctl(fd, c->dcmd, &data, sizeof(data), NULL) != c->expected)
+      ++errors;
+  }
+
+  elapsed = ClockCycles() - start;
+  *ns     = (double) elapsed / count;
+
+  printf("%-20s %12.0f %10.1f %10.1f %8u\n", c->name, count * 1e9 / elapsed, *ns,
+         floor_ns > 0 ? *ns - floor_ns : 0, errors);
+
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  uint32_t    count   = 1000000;
+  char        *args[] = { "vt1211_nto", "-p", "-f", "1", "-S", "0", NULL };
+  gpio_data_t own     = { VT1211_PORT_3, VT1211_PIN_0, VT1211_PIN_OUTPUT };
+  gpio_data_t other   = { VT1211_PORT_3, VT1211_PIN_1, VT1211_PIN_OUTPUT };
+  double      floor_ns = 0;
+  int         errors  = 0;
+  int         opt;
+  gpio_portsinfo_t info;
+  int         fd;
+  int         other_fd;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n': {
+        count = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      default: {
+        fprintf(stderr, "usage: %s [-n requests]\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (count == 0)
+    count = 1;
+
+  optind = 1;
+
+  if (host_start(6, args) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: the driver didn't start\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  host_client(LOOKUP_PID_OTHER);
+
+  if ((other_fd = host_open("/dev/vt1211", O_RDWR)) == -1 ||
+      devctl(other_fd, VT1211_REQ_PIN, &other, sizeof(other), NULL) != EOK) {
+    fprintf(stderr, "%s: setup of the other client failed\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  host_client(0);
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1 ||
+      devctl(fd, VT1211_REQ_PIN, &own, sizeof(own), NULL) != EOK ||
+      devctl(fd, VT1211_CONFIG_PIN, &own, sizeof(own), NULL) != EOK) {
+    fprintf(stderr, "%s: setup failed\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (devctl(fd, VT1211_GET_INFO, &info, sizeof(info), NULL) != EOK) {
+    fprintf(stderr, "%s: no ports\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  lookup_map_setup(&info, LOOKUP_PID_OTHER);
+
+  printf("Validation stage, %u checks per case: before is the hashmap chain of SET_PIN, after is vt1211_check\n\n",
+         count);
+  printf("%-20s %10s %10s %8s %8s\n", "check", "before ns", "after ns", "speedup", "errors");
+
+  for (size_t i = 0; i < sizeof(lookup_checks) / sizeof(lookup_checks[0]); ++i) {
+    errors += lookup_check(host_ocb(fd), &lookup_checks[i], count);
+  }
+
+  printf("\nWhole requests through io_devctl, %u requests per case, no simulated I/O latency\n\n", count);
+  printf("%-20s %12s %10s %10s %8s\n", "request", "req/s", "ns/req", "ns/lookup", "errors");
+
+  for (size_t i = 0; i < sizeof(lookup_cases) / sizeof(lookup_cases[0]); ++i) {
+    double ns;
+
+    errors += lookup_case(fd, &lookup_cases[i], count, floor_ns, &ns);
+
+    // The unknown request is the cost of the transport and the table lookup
+    if (i == 0)
+      floor_ns = ns;
+  }
+
+  host_close(fd);
+  host_close(other_fd);
+
+  return errors != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
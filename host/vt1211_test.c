@@ -0,0 +1,516 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * devctl tests on the simulated chip. For every request of vt1211_cases:
+ *   - a valid request succeeds (and so does its undo)
+ *   - the port requests leave the expected latch and direction in the chip
+ *     and reply the expected data
+ *   - a request one byte shorter than its data fails with EINVAL, and so do
+ *     the requests with a field out of its range
+ *   - the command with other size bits fails with ENOSYS
+ *   - a request on the port or the pin of another client fails with
+ *     VT1211_ERR_PERM
+ * and every unused command number fails with ENOSYS, an O_EXCL open of a
+ * held pin and a second pattern run fail with EBUSY. A pattern leaves the
+ * pins another client takes alone. Closing the descriptor of a client gives
+ * its port and pins back and stops its PWM and pattern.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include "../vt1211_ipc.h"
+#include "../vt1211_hw.h"
+#include "host.h"
+#include "vt1211_cases.h"
+
+#define TEST_PID_OTHER  0x7000
+
+// Data size of a command, the command numbers of vt1211_ipc.h carry 0x20 into the size bits
+#define DCMD_SIZE(_dcmd)  ((((_dcmd) >> 16) & 0x3FFF) - (0x200700 >> 16))
+
+static int failures;
+static int checks;
+
+static void expect(const char *name, const char *what, int rc, int expected) {
+  ++checks;
+
+  if (rc == expected)
+    return;
+
+  ++failures;
+  printf("FAIL %-16s %-10s got %s (0x%X), expected %s (0x%X)\n",
+         name, what, strerror(rc), rc, strerror(expected), expected);
+}
+
+static void expect_value(const char *name, const char *what, uint32_t value, uint32_t expected) {
+  ++checks;
+
+  if (value == expected)
+    return;
+
+  ++failures;
+  printf("FAIL %-16s %-10s got 0x%02X, expected 0x%02X\n", name, what, value, expected);
+}
+
+/*
+ * The requests of vt1211_cases refused on the port of CASE_FD_MAIN. The pin
+ * requests only check the owner of the pin, they are tested on a held pin.
+ */
+static bool test_owned(uint32_t dcmd) {
+  static const uint32_t owned[] = {
+    VT1211_CONFIG_PORT, VT1211_SET_PORT, VT1211_GET_PORT, VT1211_SET_MULTI, VT1211_CONFIG_MULTI, VT1211_MODIFY_PORT, VT1211_WATCH,
+    VT1211_PLAY_PATTERN, VT1211_PWM_CONFIG, VT1211_DEBOUNCE, VT1211_GROUP_WRITE, VT1211_GROUP_READ,
+  };
+
+  for (size_t i = 0; i < sizeof(owned) / sizeof(owned[0]); ++i) {
+    if (owned[i] == dcmd)
+      return true;
+  }
+
+  return false;
+}
+
+static void test_success(void) {
+  uint8_t data[CASE_DATA_MAX];
+
+  for (int i = 0; i < vt1211_cases_count; ++i) {
+    const vt1211_case_t *c = &vt1211_cases[i];
+
+    expect(c->name, "valid", vt1211_case_send(c, data), EOK);
+
+    if (c->undo != NULL)
+      expect(c->undo->name, "valid", vt1211_case_send(c->undo, data), EOK);
+  }
+}
+
+/*
+ * The chip as the requests left it: the latch and the direction register of
+ * port 1 in the simulator against the expected ones
+ */
+static void expect_port(const char *name, uint8_t latch, uint8_t dir) {
+  uint8_t sim_latch;
+  uint8_t sim_dir;
+
+  vt1211_sim_port(VT1211_PORT_1, &sim_latch, &sim_dir);
+  expect_value(name, "latch", sim_latch, latch);
+  expect_value(name, "direction", sim_dir, dir);
+}
+
+/*
+ * The requests on port 1 of CASE_FD_MAIN one after the other, with the
+ * state of the chip and the reply data of each checked. Pins 4..7 are
+ * inputs at 0xA0, an output reads back its latch.
+ */
+static void test_effect(void) {
+  int           fd      = vt1211_cases_fds[CASE_FD_MAIN];
+  gpio_data_t   d       = { VT1211_PORT_1, 0, 0 };
+  gpio_modify_t modify  = { VT1211_PORT_1, VT1211_MODIFY_TOGGLE, VT1211_PIN_1, 0 };
+  gpio_ports_t  ports;
+  gpio_dirs_t   dirs;
+  uint8_t       batch_data[sizeof(gpio_batch_t) + 3 * sizeof(gpio_batch_op_t)];
+  gpio_batch_t  *batch  = (gpio_batch_t *) batch_data;
+
+  vt1211_sim_input(VT1211_PORT_1, 0xA0);
+
+  d.data = VT1211_PORT_OUTPUT;
+  expect("CONFIG_PORT", "setup", devctl(fd, VT1211_CONFIG_PORT, &d, sizeof(d), NULL), EOK);
+  d.data = 0x3C;
+  expect("SET_PORT", "setup", devctl(fd, VT1211_SET_PORT, &d, sizeof(d), NULL), EOK);
+  expect_port("SET_PORT", 0x3C, 0xFF);
+
+  // Only the direction changes
+  d.data = 0x0F;
+  expect("CONFIG_PORT", "effect", devctl(fd, VT1211_CONFIG_PORT, &d, sizeof(d), NULL), EOK);
+  expect_port("CONFIG_PORT", 0x3C, 0x0F);
+
+  d.data = 0x05;
+  expect("SET_PORT", "effect", devctl(fd, VT1211_SET_PORT, &d, sizeof(d), NULL), EOK);
+  expect_port("SET_PORT", 0x05, 0x0F);
+
+  d.data = 0;
+  expect("GET_PORT", "effect", devctl(fd, VT1211_GET_PORT, &d, sizeof(d), NULL), EOK);
+  expect_value("GET_PORT", "data", d.data, 0xA5);
+
+  d.pin  = VT1211_PIN_0;
+  d.data = 0;
+  expect("SET_PIN", "effect", devctl(fd, VT1211_SET_PIN, &d, sizeof(d), NULL), EOK);
+  expect_port("SET_PIN", 0x04, 0x0F);
+
+  d.pin  = VT1211_PIN_2;
+  d.data = 0;
+  expect("GET_PIN", "output", devctl(fd, VT1211_GET_PIN, &d, sizeof(d), NULL), EOK);
+  expect_value("GET_PIN", "output data", d.data, 1);
+
+  d.pin  = VT1211_PIN_6;
+  d.data = 1;
+  expect("GET_PIN", "input", devctl(fd, VT1211_GET_PIN, &d, sizeof(d), NULL), EOK);
+  expect_value("GET_PIN", "input data", d.data, 0);
+
+  d.pin  = VT1211_PIN_4;
+  d.data = VT1211_PIN_OUTPUT;
+  expect("CONFIG_PIN", "effect", devctl(fd, VT1211_CONFIG_PIN, &d, sizeof(d), NULL), EOK);
+  expect_port("CONFIG_PIN", 0x04, 0x1F);
+
+  expect("MODIFY_PORT", "effect", devctl(fd, VT1211_MODIFY_PORT, &modify, sizeof(modify), NULL), EOK);
+  expect_port("MODIFY_PORT", 0x06, 0x1F);
+  expect_value("MODIFY_PORT", "data", modify.value, 0x06);
+
+  memset(&ports, 0, sizeof(ports));
+  ports.mask                = 1 << VT1211_PORT_1;
+  ports.data[VT1211_PORT_1] = 0x0A;
+  expect("SET_MULTI", "effect", devctl(fd, VT1211_SET_MULTI, &ports, sizeof(ports), NULL), EOK);
+  expect_port("SET_MULTI", 0x0A, 0x1F);
+
+  memset(&dirs, 0, sizeof(dirs));
+  dirs.mask                = 1 << VT1211_PORT_1;
+  dirs.pins[VT1211_PORT_1] = 0xF0;
+  dirs.dir[VT1211_PORT_1]  = 0x30;
+  expect("CONFIG_MULTI", "effect", devctl(fd, VT1211_CONFIG_MULTI, &dirs, sizeof(dirs), NULL), EOK);
+  expect_port("CONFIG_MULTI", 0x0A, 0x3F);
+
+  memset(&ports, 0, sizeof(ports));
+  expect("GET_ALL", "effect", devctl(fd, VT1211_GET_ALL, &ports, sizeof(ports), NULL), EOK);
+  expect_value("GET_ALL", "data", ports.data[VT1211_PORT_1], 0x8A);
+
+  // Pin 0 set and read back, then input pin 7
+  memset(batch_data, 0, sizeof(batch_data));
+  batch->count = 3;
+  batch->ops[0] = (gpio_batch_op_t) { VT1211_OP_SET_PIN, VT1211_PORT_1, VT1211_PIN_0, 1, 0 };
+  batch->ops[1] = (gpio_batch_op_t) { VT1211_OP_GET_PIN, VT1211_PORT_1, VT1211_PIN_0, 0, 0 };
+  batch->ops[2] = (gpio_batch_op_t) { VT1211_OP_GET_PIN, VT1211_PORT_1, VT1211_PIN_7, 0, 0 };
+  expect("BATCH", "effect", devctl(fd, VT1211_BATCH, batch_data, sizeof(batch_data), NULL), EOK);
+  expect_port("BATCH", 0x0B, 0x3F);
+  expect_value("BATCH", "done", batch->done, 3);
+  expect_value("BATCH", "output data", batch->ops[1].data, 1);
+  expect_value("BATCH", "input data", batch->ops[2].data, 1);
+
+  vt1211_sim_input(VT1211_PORT_1, 0xFF);
+}
+
+/*
+ * The request data is cut one byte short of the size in the command. GET_INFO
+ * is the only command with data to the driver it doesn't read.
+ */
+static void test_short(void) {
+  uint8_t data[CASE_DATA_MAX];
+
+  for (int i = 0; i < vt1211_cases_count; ++i) {
+    const vt1211_case_t *c = &vt1211_cases[i];
+
+    if (!(c->dcmd & DEVDIR_TO) || c->dcmd == VT1211_GET_INFO)
+      continue;
+
+    c->fill(data);
+    expect(c->name, "short", devctl(vt1211_cases_fds[c->fd], c->dcmd, data, DCMD_SIZE(c->dcmd) - 1, NULL), EINVAL);
+  }
+}
+
+/*
+ * Requests with a field out of its range
+ */
+static void test_invalid(void) {
+  uint8_t         data[sizeof(gpio_bus_xfer_t) + 2];
+  gpio_bus_xfer_t *xfer = (gpio_bus_xfer_t *) data;
+  gpio_capture_t  capture;
+  gpio_watch_t    watch;
+
+  memset(data, 0, sizeof(data));
+  xfer->addr = 0x80;
+  xfer->wlen = 2;
+  expect("BUS_XFER", "8-bit addr", devctl(vt1211_cases_fds[CASE_FD_BUS], VT1211_BUS_XFER, data, sizeof(data), NULL),
+         EINVAL);
+
+  memset(&capture, 0, sizeof(capture));
+  capture.mask[VT1211_PORT_6] = VT1211_PIN_0;
+  expect("CAPTURE", "no edge", devctl(vt1211_cases_fds[CASE_FD_CAPTURE], VT1211_CAPTURE, &capture, sizeof(capture), NULL),
+         EINVAL);
+
+  memset(&watch, 0, sizeof(watch));
+  watch.port = VT1211_PORT_1;
+  watch.mask = VT1211_PIN_7;
+  expect("WATCH", "no edge", devctl(vt1211_cases_fds[CASE_FD_MAIN], VT1211_WATCH, &watch, sizeof(watch), NULL), EINVAL);
+}
+
+static void test_unknown(void) {
+  uint8_t data[CASE_DATA_MAX];
+  bool    used[256] = { false };
+  char    name[16];
+
+  for (int i = 0; i < vt1211_cases_count; ++i) {
+    const vt1211_case_t *c    = &vt1211_cases[i];
+    uint32_t            dcmd  = c->dcmd + (1 << 16);
+
+    used[c->dcmd & 0xFF] = true;
+
+    c->fill(data);
+    expect(c->name, "size bits", devctl(vt1211_cases_fds[c->fd], dcmd, data, DCMD_SIZE(dcmd), NULL), ENOSYS);
+  }
+
+  used[VT1211_FREE_PIN & 0xFF]      = true;
+  used[VT1211_FREE_PORT & 0xFF]     = true;
+  used[VT1211_PATTERN_STOP & 0xFF]  = true;
+
+  for (int cmd = 0; cmd < 256; ++cmd) {
+    if (used[cmd])
+      continue;
+
+    snprintf(name, sizeof(name), "cmd 0x%02X", cmd);
+    expect(name, "unused", devctl(vt1211_cases_fds[CASE_FD_MAIN], __DION(_DCMD_MISC, 0x200700 + cmd), NULL, 0, NULL),
+           ENOSYS);
+  }
+}
+
+/*
+ * Another client sends the requests on the port of CASE_FD_MAIN, then the
+ * pin requests on a pin CASE_FD_MAIN holds on a free port
+ */
+static void test_perm(void) {
+  uint8_t     data[CASE_DATA_MAX];
+  gpio_data_t pin = { VT1211_PORT_3, VT1211_PIN_0, 1 };
+  int         fd;
+
+  expect("REQ_PIN", "setup", devctl(vt1211_cases_fds[CASE_FD_MAIN], VT1211_REQ_PIN, &pin, sizeof(pin), NULL), EOK);
+
+  host_client(TEST_PID_OTHER);
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1) {
+    expect("open", "other", errno, EOK);
+    host_client(0);
+    return;
+  }
+
+  for (int i = 0; i < vt1211_cases_count; ++i) {
+    const vt1211_case_t *c = &vt1211_cases[i];
+
+    if (c->fd != CASE_FD_MAIN || !test_owned(c->dcmd))
+      continue;
+
+    expect(c->name, "other", devctl(fd, c->dcmd, data, c->fill(data), NULL), VT1211_ERR_PERM);
+  }
+
+  expect("CONFIG_PIN", "other pin", devctl(fd, VT1211_CONFIG_PIN, &pin, sizeof(pin), NULL), VT1211_ERR_PERM);
+  expect("SET_PIN", "other pin", devctl(fd, VT1211_SET_PIN, &pin, sizeof(pin), NULL), VT1211_ERR_PERM);
+  expect("GET_PIN", "other pin", devctl(fd, VT1211_GET_PIN, &pin, sizeof(pin), NULL), VT1211_ERR_PERM);
+  expect("REQ_PIN", "other pin", devctl(fd, VT1211_REQ_PIN, &pin, sizeof(pin), NULL), VT1211_ERR_PIN_BUSY);
+  expect("FREE_PIN", "other pin", devctl(fd, VT1211_FREE_PIN, &pin, sizeof(pin), NULL), VT1211_ERR_PERM);
+
+  host_close(fd);
+  host_client(0);
+
+  expect("FREE_PIN", "setup", devctl(vt1211_cases_fds[CASE_FD_MAIN], VT1211_FREE_PIN, &pin, sizeof(pin), NULL), EOK);
+}
+
+static void test_busy(void) {
+  uint8_t         data[sizeof(gpio_pattern_t) + 2 * sizeof(gpio_pattern_step_t)];
+  gpio_pattern_t  *pattern = (gpio_pattern_t *) data;
+  gpio_data_t     pin      = { VT1211_PORT_3, VT1211_PIN_0, 0 };
+  int             main_fd  = vt1211_cases_fds[CASE_FD_MAIN];
+  int             fd;
+
+  expect("REQ_PIN", "setup", devctl(main_fd, VT1211_REQ_PIN, &pin, sizeof(pin), NULL), EOK);
+
+  fd = host_open("/dev/vt1211/port3/pin0", O_RDWR | O_EXCL);
+  expect("open", "O_EXCL", fd == -1 ? errno : EOK, EBUSY);
+
+  if (fd != -1)
+    host_close(fd);
+
+  expect("FREE_PIN", "setup", devctl(main_fd, VT1211_FREE_PIN, &pin, sizeof(pin), NULL), EOK);
+
+  fd = host_open("/dev/vt1211/port3/pin0", O_RDWR | O_EXCL);
+  expect("open", "O_EXCL", fd == -1 ? errno : EOK, EOK);
+
+  if (fd != -1)
+    host_close(fd);
+
+  // Runs until stopped, two steps of VT1211_PATTERN_PERIOD
+  memset(data, 0, sizeof(data));
+  pattern->port   = VT1211_PORT_1;
+  pattern->repeat = 0;
+  pattern->count  = 2;
+  pattern->steps[0].mask      = VT1211_PIN_2;
+  pattern->steps[0].value     = VT1211_PIN_2;
+  pattern->steps[0].delay_ns  = VT1211_PATTERN_PERIOD;
+  pattern->steps[1].mask      = VT1211_PIN_2;
+  pattern->steps[1].delay_ns  = VT1211_PATTERN_PERIOD;
+
+  expect("PLAY_PATTERN", "first", devctl(main_fd, VT1211_PLAY_PATTERN, data, sizeof(data), NULL), EOK);
+  expect("PLAY_PATTERN", "second", devctl(main_fd, VT1211_PLAY_PATTERN, data, sizeof(data), NULL), EBUSY);
+  expect("PATTERN_STOP", "setup", devctl(main_fd, VT1211_PATTERN_STOP, NULL, 0, NULL), EOK);
+}
+
+/*
+ * A pattern and a PWM channel run on pins nobody holds, then another client
+ * takes one pin of each: both must leave them at the level its owner set
+ */
+static void test_take(void) {
+  uint8_t         data[sizeof(gpio_pattern_t) + 2 * sizeof(gpio_pattern_step_t)];
+  gpio_pattern_t  *pattern = (gpio_pattern_t *) data;
+  gpio_data_t     pin      = { VT1211_PORT_4, VT1211_PIN_1, VT1211_PIN_OUTPUT };
+  gpio_data_t     pwm_pin  = { VT1211_PORT_4, VT1211_PIN_2, VT1211_PIN_OUTPUT };
+  gpio_pwm_t      pwm      = { VT1211_PORT_4, VT1211_PIN_2, { 0 }, 1000, 1000 };
+  int             main_fd  = vt1211_cases_fds[CASE_FD_MAIN];
+  struct timespec pause    = { 0, 20000000L };
+  uint8_t         latch;
+  uint8_t         dir;
+  int             fd;
+
+  memset(data, 0, sizeof(data));
+  pattern->port   = VT1211_PORT_4;
+  pattern->repeat = 0;
+  pattern->count  = 2;
+  pattern->steps[0].mask      = VT1211_PIN_0 | VT1211_PIN_1;
+  pattern->steps[0].value     = VT1211_PIN_0 | VT1211_PIN_1;
+  pattern->steps[0].delay_ns  = VT1211_PATTERN_PERIOD;
+  pattern->steps[1].mask      = VT1211_PIN_0 | VT1211_PIN_1;
+  pattern->steps[1].delay_ns  = VT1211_PATTERN_PERIOD;
+
+  expect("PLAY_PATTERN", "free pins", devctl(main_fd, VT1211_PLAY_PATTERN, data, sizeof(data), NULL), EOK);
+  expect("PWM_CONFIG", "free pin", devctl(main_fd, VT1211_PWM_CONFIG, &pwm, sizeof(pwm), NULL), EOK);
+
+  host_client(TEST_PID_OTHER);
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1) {
+    expect("open", "other", errno, EOK);
+    host_client(0);
+    devctl(main_fd, VT1211_PATTERN_STOP, NULL, 0, NULL);
+    pwm.period_us = 0;
+    devctl(main_fd, VT1211_PWM_CONFIG, &pwm, sizeof(pwm), NULL);
+    return;
+  }
+
+  expect("REQ_PIN", "under pattern", devctl(fd, VT1211_REQ_PIN, &pin, sizeof(pin), NULL), EOK);
+  expect("CONFIG_PIN", "under pattern", devctl(fd, VT1211_CONFIG_PIN, &pin, sizeof(pin), NULL), EOK);
+
+  expect("REQ_PIN", "under PWM", devctl(fd, VT1211_REQ_PIN, &pwm_pin, sizeof(pwm_pin), NULL), EOK);
+  expect("CONFIG_PIN", "under PWM", devctl(fd, VT1211_CONFIG_PIN, &pwm_pin, sizeof(pwm_pin), NULL), EOK);
+
+  pin.data      = 0;
+  pwm_pin.data  = 0;
+  expect("SET_PIN", "under pattern", devctl(fd, VT1211_SET_PIN, &pin, sizeof(pin), NULL), EOK);
+  expect("SET_PIN", "under PWM", devctl(fd, VT1211_SET_PIN, &pwm_pin, sizeof(pwm_pin), NULL), EOK);
+
+  // Two steps of the pattern or a PWM period at full duty would set the pins
+  nanosleep(&pause, NULL);
+  vt1211_sim_port(VT1211_PORT_4, &latch, &dir);
+  expect("PLAY_PATTERN", "taken pin", latch & VT1211_PIN_1 ? EBUSY : EOK, EOK);
+  expect("PWM_CONFIG", "taken pin", latch & VT1211_PIN_2 ? EBUSY : EOK, EOK);
+
+  expect("PATTERN_STOP", "setup", devctl(main_fd, VT1211_PATTERN_STOP, NULL, 0, NULL), EOK);
+
+  host_close(fd);
+  host_client(0);
+}
+
+/*
+ * A client dies holding a port and a pin, with a PWM channel and a pattern
+ * running: its descriptor is closed, which must give everything back and
+ * stop all the output
+ */
+static void test_close(void) {
+  uint8_t         data[sizeof(gpio_pattern_t) + 2 * sizeof(gpio_pattern_step_t)];
+  gpio_pattern_t  *pattern = (gpio_pattern_t *) data;
+  gpio_data_t     port     = { VT1211_PORT_4, 0, 0 };
+  gpio_data_t     pin      = { VT1211_PORT_3, VT1211_PIN_1, 0 };
+  gpio_pwm_t      pwm      = { VT1211_PORT_4, VT1211_PIN_0, { 0 }, 1000, 500 };
+  int             main_fd  = vt1211_cases_fds[CASE_FD_MAIN];
+  uint64_t        reads;
+  uint64_t        writes[2];
+  struct timespec pause    = { 0, 20000000L };
+  int             fd;
+
+  host_client(TEST_PID_OTHER);
+
+  if ((fd = host_open("/dev/vt1211", O_RDWR)) == -1) {
+    expect("open", "other", errno, EOK);
+    host_client(0);
+    return;
+  }
+
+  memset(data, 0, sizeof(data));
+  pattern->port   = VT1211_PORT_4;
+  pattern->repeat = 0;
+  pattern->count  = 2;
+  pattern->steps[0].mask      = VT1211_PIN_1;
+  pattern->steps[0].value     = VT1211_PIN_1;
+  pattern->steps[0].delay_ns  = VT1211_PATTERN_PERIOD;
+  pattern->steps[1].mask      = VT1211_PIN_1;
+  pattern->steps[1].delay_ns  = VT1211_PATTERN_PERIOD;
+
+  expect("REQ_PORT", "dying", devctl(fd, VT1211_REQ_PORT, &port, sizeof(port), NULL), EOK);
+  expect("REQ_PIN", "dying", devctl(fd, VT1211_REQ_PIN, &pin, sizeof(pin), NULL), EOK);
+  expect("PWM_CONFIG", "dying", devctl(fd, VT1211_PWM_CONFIG, &pwm, sizeof(pwm), NULL), EOK);
+  expect("PLAY_PATTERN", "dying", devctl(fd, VT1211_PLAY_PATTERN, data, sizeof(data), NULL), EOK);
+
+  host_close(fd);
+  host_client(0);
+
+  expect("REQ_PORT", "after close", devctl(main_fd, VT1211_REQ_PORT, &port, sizeof(port), NULL), EOK);
+  expect("FREE_PORT", "after close", devctl(main_fd, VT1211_FREE_PORT, &port, sizeof(port), NULL), EOK);
+  expect("REQ_PIN", "after close", devctl(main_fd, VT1211_REQ_PIN, &pin, sizeof(pin), NULL), EOK);
+  expect("FREE_PIN", "after close", devctl(main_fd, VT1211_FREE_PIN, &pin, sizeof(pin), NULL), EOK);
+
+  // Channels switched off earlier finish their period first, then only the
+  // sampler reads the chip and nothing writes it
+  nanosleep(&pause, NULL);
+  vt1211_sim_counters(&reads, &writes[0]);
+  nanosleep(&pause, NULL);
+  vt1211_sim_counters(&reads, &writes[1]);
+
+  expect("close", "writes", writes[1] != writes[0] ? EBUSY : EOK, EOK);
+}
+
+int main(int argc, char **argv) {
+  char  *args[] = { "vt1211_nto", "-p", "-f", "100", "-S", "0", NULL };
+  int   rc;
+
+  if (host_start(6, args) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: the driver didn't start\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((rc = vt1211_cases_setup()) != EOK) {
+    fprintf(stderr, "%s: setup failed: %s (0x%X)\n", argv[0], strerror(rc), rc);
+    return EXIT_FAILURE;
+  }
+
+  test_success();
+  test_effect();
+  test_short();
+  test_invalid();
+  test_unknown();
+  test_perm();
+  test_busy();
+  test_take();
+  test_close();
+
+  printf("%d checks, %d failed\n", checks, failures);
+
+  return failures != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
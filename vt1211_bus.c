@@ -0,0 +1,332 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Bit-banged SPI and I2C masters.
+ *
+ * A descriptor sets up one bus on pins of one port it owns and then submits
+ * whole transfers; the clock edges are made here with the port locked for
+ * the transfer. Every edge is one port write through the shadow latch, so
+ * there are no reads of the output pins. SPI changes the data together with
+ * the clock edge that shifts it out. I2C changes SDA only while SCL is low
+ * and drives it push-pull, releasing it (input, the pull-up makes the 1) for
+ * the acknowledge and the read bits. SCL is always driven, clock stretching
+ * is not supported.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "vt1211_nto.h"
+
+static inline void vt1211_bus_delay(const gpio_bus_t *bus) {
+  if (bus->half_period_ns == 0)
+    return;
+
+  uint64_t end = vt1211_now() + bus->half_period_ns;
+
+  while (vt1211_now() < end)
+    ;
+}
+
+static inline void vt1211_bus_set(const gpio_bus_t *bus, uint8_t mask, uint8_t value) {
+  vt1211_port_modify(bus->port, VT1211_MODIFY_ASSIGN, mask, value);
+  vt1211_bus_delay(bus);
+}
+
+static inline uint8_t vt1211_bus_get(const gpio_bus_t *bus, uint8_t pin) {
+  return (vt1211_hw_port_read(bus->port) & pin) ? 1 : 0;
+}
+
+static uint8_t vt1211_spi_byte(const gpio_bus_t *bus, uint8_t out) {
+  uint8_t idle    = bus->flags & VT1211_BUS_CPOL ? bus->clk : 0;
+  uint8_t active  = idle ^ bus->clk;
+  uint8_t in      = 0;
+
+  for (int i = 0; i < 8; ++i) {
+    int     shift = bus->flags & VT1211_BUS_LSB_FIRST ? i : 7 - i;
+    uint8_t mosi  = (out >> shift) & 1 ? bus->mosi : 0;
+
+    if (bus->flags & VT1211_BUS_CPHA) {
+      vt1211_bus_set(bus, bus->clk | bus->mosi, active | mosi);
+      vt1211_bus_set(bus, bus->clk, idle);
+    } else {
+      vt1211_bus_set(bus, bus->clk | bus->mosi, idle | mosi);
+      vt1211_bus_set(bus, bus->clk, active);
+    }
+
+    if (bus->miso)
+      in |= vt1211_bus_get(bus, bus->miso) << shift;
+  }
+
+  return in;
+}
+
+static int vt1211_spi(const gpio_bus_t *bus, uint8_t *data, size_t wlen, size_t rlen) {
+  uint8_t cs    = bus->flags & VT1211_BUS_CS_HIGH ? bus->cs : 0;
+  uint8_t idle  = bus->flags & VT1211_BUS_CPOL ? bus->clk : 0;
+
+  if (bus->cs)
+    vt1211_bus_set(bus, bus->cs, cs);
+
+  for (size_t i = 0; i < wlen + rlen; ++i) {
+    data[i] = vt1211_spi_byte(bus, i < wlen ? data[i] : 0);
+  }
+
+  // With CPHA 0 the clock is left at the active level after the last bit
+  vt1211_bus_set(bus, bus->clk, idle);
+
+  if (bus->cs)
+    vt1211_bus_set(bus, bus->cs, cs ^ bus->cs);
+
+  return EOK;
+}
+
+static inline void vt1211_i2c_sda(const gpio_bus_t *bus, bool release) {
+  vt1211_port_dir(bus->port, bus->mosi, release ? 0 : bus->mosi);
+}
+
+static void vt1211_i2c_start(const gpio_bus_t *bus) {
+  // Idle or after a byte: SCL is high or low, SDA driven. Both go high first
+  vt1211_bus_set(bus, bus->mosi, bus->mosi);
+  vt1211_bus_set(bus, bus->clk, bus->clk);
+  vt1211_bus_set(bus, bus->mosi, 0);
+  vt1211_bus_set(bus, bus->clk, 0);
+}
+
+static void vt1211_i2c_stop(const gpio_bus_t *bus) {
+  vt1211_bus_set(bus, bus->mosi, 0);
+  vt1211_bus_set(bus, bus->clk, bus->clk);
+  vt1211_bus_set(bus, bus->mosi, bus->mosi);
+}
+
+/*
+ * Sends the byte with SCL low on entry and exit. Returns true if acknowledged.
+ */
+static bool vt1211_i2c_write(const gpio_bus_t *bus, uint8_t out) {
+  bool ack;
+
+  for (int i = 7; i >= 0; --i) {
+    vt1211_bus_set(bus, bus->mosi, (out >> i) & 1 ? bus->mosi : 0);
+    vt1211_bus_set(bus, bus->clk, bus->clk);
+    vt1211_bus_set(bus, bus->clk, 0);
+  }
+
+  vt1211_i2c_sda(bus, true);
+  vt1211_bus_set(bus, bus->clk, bus->clk);
+  ack = !vt1211_bus_get(bus, bus->mosi);
+  vt1211_bus_set(bus, bus->clk, 0);
+  vt1211_i2c_sda(bus, false);
+
+  return ack;
+}
+
+/*
+ * Receives a byte with SCL low on entry and exit and acknowledges it unless
+ * it's the last one.
+ */
+static uint8_t vt1211_i2c_read(const gpio_bus_t *bus, bool ack) {
+  uint8_t in = 0;
+
+  vt1211_i2c_sda(bus, true);
+
+  for (int i = 7; i >= 0; --i) {
+    vt1211_bus_set(bus, bus->clk, bus->clk);
+    in |= vt1211_bus_get(bus, bus->mosi) << i;
+    vt1211_bus_set(bus, bus->clk, 0);
+  }
+
+  // The latch is set before the pin is driven again
+  vt1211_bus_set(bus, bus->mosi, ack ? 0 : bus->mosi);
+  vt1211_i2c_sda(bus, false);
+  vt1211_bus_set(bus, bus->clk, bus->clk);
+  vt1211_bus_set(bus, bus->clk, 0);
+
+  return in;
+}
+
+static int vt1211_i2c(const gpio_bus_t *bus, uint8_t addr, uint8_t *data, size_t wlen, size_t rlen) {
+  int rc = EOK;
+
+  vt1211_i2c_start(bus);
+
+  // An empty transfer is an address probe
+  if (wlen != 0 || rlen == 0) {
+    if (!vt1211_i2c_write(bus, addr << 1))
+      rc = EIO;
+
+    for (size_t i = 0; i < wlen && rc == EOK; ++i) {
+      if (!vt1211_i2c_write(bus, data[i]))
+        rc = EIO;
+    }
+
+    if (rc == EOK && rlen != 0)
+      vt1211_i2c_start(bus);
+  }
+
+  if (rc == EOK && rlen != 0) {
+    if (!vt1211_i2c_write(bus, (addr << 1) | 1))
+      rc = EIO;
+
+    for (size_t i = 0; i < rlen && rc == EOK; ++i) {
+      data[wlen + i] = vt1211_i2c_read(bus, i + 1 < rlen);
+    }
+  }
+
+  vt1211_i2c_stop(bus);
+
+  return rc;
+}
+
+static inline bool vt1211_bus_owned(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins) {
+  return ocb->held_port[port] || (ocb->held_pins[port] & pins) == pins;
+}
+
+/*
+ * VT1211_BUS_CONFIG. The port is checked and locked.
+ */
+int vt1211_bus_config(vt1211_ocb_t *ocb, gpio_bus_t *bus) {
+  uint8_t pins  = bus->clk | bus->mosi | bus->miso | bus->cs;
+  uint8_t out   = bus->clk | bus->mosi | bus->cs;
+  uint8_t idle;
+
+  if (bus->type == VT1211_BUS_NONE) {
+    if (ocb->bind == VT1211_BIND_BUS)
+      ocb->bind = VT1211_BIND_NONE;
+
+    ocb->bus.type = VT1211_BUS_NONE;
+    return EOK;
+  }
+
+  if (bus->type != VT1211_BUS_SPI && bus->type != VT1211_BUS_I2C)
+    return EINVAL;
+
+  if (__builtin_popcount(bus->clk) != 1 || __builtin_popcount(bus->mosi) > 1 ||
+      __builtin_popcount(bus->miso) > 1 || __builtin_popcount(bus->cs) > 1 ||
+      __builtin_popcount(pins) != __builtin_popcount(bus->clk) + __builtin_popcount(bus->mosi) +
+                                  __builtin_popcount(bus->miso) + __builtin_popcount(bus->cs)) {
+    return EINVAL;
+  }
+
+  if (bus->type == VT1211_BUS_I2C && (bus->mosi == 0 || bus->miso != 0 || bus->cs != 0 || bus->addr > 0x7F))
+    return EINVAL;
+
+  if (pins & ~ports_status[bus->port].pins) {
+    debugf("Incorrect pin\n");
+    return VT1211_ERR_INCRCT_PIN;
+  }
+
+  if (!vt1211_bus_owned(ocb, bus->port, pins)) {
+    debugf("Bus pins are not owned\n");
+    return VT1211_ERR_PERM;
+  }
+
+  if (bus->type == VT1211_BUS_I2C) {
+    idle = bus->clk | bus->mosi;
+  } else {
+    idle = (bus->flags & VT1211_BUS_CPOL ? bus->clk : 0) |
+           (bus->flags & VT1211_BUS_CS_HIGH ? 0 : bus->cs);
+  }
+
+  // Idle levels are latched before the pins become outputs
+  vt1211_port_modify(bus->port, VT1211_MODIFY_ASSIGN, out, idle);
+  vt1211_port_dir(bus->port, pins, out);
+
+  ocb->bus  = *bus;
+  ocb->bind = VT1211_BIND_BUS;
+  ocb->port = bus->port;
+
+  return EOK;
+}
+
+/*
+ * Runs a transfer on the bus of the descriptor. Returns EOK or an error code.
+ */
+int vt1211_bus_transfer(vt1211_ocb_t *ocb, uint8_t addr, uint8_t *data, size_t wlen, size_t rlen) {
+  const gpio_bus_t  *bus  = &ocb->bus;
+  int               rc;
+
+  if (bus->type == VT1211_BUS_NONE)
+    return ENXIO;
+
+  if (addr > 0x7F)
+    return EINVAL;
+
+  if (wlen + rlen > VT1211_BUS_MAX)
+    return E2BIG;
+
+  vt1211_lock(1 << bus->port);
+
+  if (!vt1211_bus_owned(ocb, bus->port, bus->clk | bus->mosi | bus->miso | bus->cs)) {
+    debugf("Bus pins are not owned\n");
+    rc = VT1211_ERR_PERM;
+  } else if (bus->type == VT1211_BUS_SPI) {
+    rc = vt1211_spi(bus, data, wlen, rlen);
+  } else {
+    rc = vt1211_i2c(bus, addr, data, wlen, rlen);
+  }
+
+  vt1211_unlock(1 << bus->port);
+
+  return rc;
+}
+
+/*
+ * read() and write() of a descriptor bound to the bus. One call is one
+ * transfer of at most VT1211_BUS_MAX bytes. The read data is put into the
+ * receive buffer.
+ */
+int vt1211_bus_read(resmgr_context_t *ctp, io_read_t *msg, vt1211_ocb_t *ocb) {
+  uint8_t *buf    = (uint8_t *) msg;
+  size_t  nbytes  = msg->i.nbytes;
+  int     rc;
+
+  if (nbytes > VT1211_BUS_MAX)
+    nbytes = VT1211_BUS_MAX;
+
+  if (nbytes > ctp->msg_max_size)
+    nbytes = ctp->msg_max_size;
+
+  if ((rc = vt1211_bus_transfer(ocb, ocb->bus.addr, buf, 0, nbytes)) != EOK)
+    return rc;
+
+  _IO_SET_READ_NBYTES(ctp, nbytes);
+  return _RESMGR_PTR(ctp, buf, nbytes);
+}
+
+int vt1211_bus_write(resmgr_context_t *ctp, io_write_t *msg, vt1211_ocb_t *ocb) {
+  uint8_t buf[VT1211_BUS_MAX];
+  size_t  nbytes  = msg->i.nbytes;
+  int     rc;
+
+  if (nbytes > VT1211_BUS_MAX)
+    nbytes = VT1211_BUS_MAX;
+
+  if (resmgr_msgread(ctp, buf, nbytes, sizeof(msg->i)) != (int) nbytes)
+    return EFAULT;
+
+  if ((rc = vt1211_bus_transfer(ocb, ocb->bus.addr, buf, nbytes, 0)) != EOK)
+    return rc;
+
+  _IO_SET_WRITE_NBYTES(ctp, nbytes);
+  return _RESMGR_NPARTS(0);
+}
@@ -0,0 +1,399 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Edge capture.
+ *
+ * Subscribers ask for edges on some input pins. A capture thread above the
+ * other driver threads reads the subscribed ports every tick (the shortest
+ * period asked for), timestamps each read with ClockCycles and queues a
+ * gpio_edge_t for every edge a subscriber wants. The queue of a subscriber
+ * is a ring with the capture thread as the only writer and the descriptor's
+ * read() as the only reader; when it's full new edges are dropped and
+ * counted. The raw pin values are used, the debounce filter is not applied.
+ *
+ * An edge happened at some point between the previous read of the port and
+ * the timestamped one, so the time between reads is the resolution of the
+ * timestamps. It's measured and reported with VT1211_CAPTURE_STATS.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+#include "vt1211_nto.h"
+
+#define VT1211_CAPTURE_PERIOD_US  100
+#define VT1211_CAPTURE_DEPTH      1024
+#define VT1211_CAPTURE_PRIO       61
+
+typedef struct vt1211_capture {
+  struct vt1211_capture *next;
+  vt1211_ocb_t          *ocb;
+  gpio_capture_t        sub;
+  uint32_t              size;                     // ring records, power of 2
+  gpio_edge_t           *ring;
+  uint32_t              head;                     // records written
+  uint32_t              tail;                     // records read
+  uint32_t              lost;                     // edges dropped since the last queued one
+  uint64_t              events;
+  uint64_t              overflow;
+} vt1211_capture_t;
+
+static pthread_mutex_t  capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   capture_cond;
+static vt1211_capture_t *capture_list;
+static uint8_t          capture_value[VT1211_PORTS_MAX];  // port values of the last scan
+
+static uint64_t         capture_samples;
+static uint64_t         capture_intervals;
+static uint64_t         capture_last;                     // time of the last scan, 0 after idle
+static uint64_t         capture_min;
+static uint64_t         capture_max;
+static uint64_t         capture_sum;
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns) {
+  ns          += ts->tv_nsec;
+  ts->tv_sec  += ns / 1000000000;
+  ts->tv_nsec  = ns % 1000000000;
+}
+
+static uint8_t vt1211_capture_ports(void) {
+  uint8_t ports = 0;
+
+  for (vt1211_capture_t *cap = capture_list; cap != NULL; cap = cap->next) {
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (cap->sub.mask[port])
+        ports |= 1 << port;
+    }
+  }
+
+  return ports;
+}
+
+static bool vt1211_capture_push(vt1211_capture_t *cap, uint64_t timestamp, uint8_t port, uint8_t pins, uint8_t edge) {
+  bool pushed = false;
+
+  for (; pins; pins &= pins - 1) {
+    uint32_t tail = __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE);
+
+    if (cap->head - tail >= cap->size) {
+      cap->lost++;
+      __atomic_add_fetch(&cap->overflow, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    gpio_edge_t *rec = &cap->ring[cap->head & (cap->size - 1)];
+
+    rec->timestamp  = timestamp;
+    rec->port       = port;
+    rec->pin        = __builtin_ctz(pins);
+    rec->edge       = edge;
+    rec->reserved   = 0;
+    rec->lost       = cap->lost;
+    cap->lost       = 0;
+
+    __atomic_store_n(&cap->head, cap->head + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&cap->events, 1, __ATOMIC_RELAXED);
+    pushed = true;
+  }
+
+  return pushed;
+}
+
+static void vt1211_capture_scan(uint8_t ports, const uint8_t *values, const uint64_t *stamp) {
+  uint8_t   rising[VT1211_PORTS_MAX];
+  uint8_t   falling[VT1211_PORTS_MAX];
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (!(ports & (1 << port)))
+      continue;
+
+    uint8_t value = values[port];
+
+    rising[port]        = value & ~capture_value[port];
+    falling[port]       = ~value & capture_value[port];
+    capture_value[port] = value;
+  }
+
+  if (capture_last != 0) {
+    uint64_t interval = stamp[__builtin_ctz(ports)] - capture_last;
+
+    if (capture_min == 0 || interval < capture_min)
+      capture_min = interval;
+
+    if (interval > capture_max)
+      capture_max = interval;
+
+    capture_sum += interval;
+    capture_intervals++;
+  }
+
+  capture_last = stamp[__builtin_ctz(ports)];
+  capture_samples++;
+
+  for (vt1211_capture_t *cap = capture_list; cap != NULL; cap = cap->next) {
+    bool pushed = false;
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      uint8_t mask = cap->sub.mask[port];
+
+      if (mask == 0 || !((rising[port] | falling[port]) & mask))
+        continue;
+
+      if (cap->sub.edge & VT1211_EDGE_RISING)
+        pushed |= vt1211_capture_push(cap, stamp[port], port, rising[port] & mask, VT1211_EDGE_RISING);
+
+      if (cap->sub.edge & VT1211_EDGE_FALLING)
+        pushed |= vt1211_capture_push(cap, stamp[port], port, falling[port] & mask, VT1211_EDGE_FALLING);
+    }
+
+    if (pushed)
+      vt1211_watch_trigger(cap->ocb);
+  }
+}
+
+static void *vt1211_capture_thread(void *arg) {
+  struct timespec next;
+
+  pthread_mutex_lock(&capture_lock);
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while (1) {
+    uint32_t period = UINT32_MAX;
+
+    if (capture_list == NULL) {
+      capture_last = 0;
+      pthread_cond_wait(&capture_cond, &capture_lock);
+      clock_gettime(CLOCK_MONOTONIC, &next);
+      continue;
+    }
+
+    for (vt1211_capture_t *cap = capture_list; cap != NULL; cap = cap->next) {
+      if (cap->sub.period_us < period)
+        period = cap->sub.period_us;
+    }
+
+    timespec_add_ns(&next, period * 1000ULL);
+
+    // Subscribers changed, start over with the new period
+    if (pthread_cond_timedwait(&capture_cond, &capture_lock, &next) == EOK) {
+      clock_gettime(CLOCK_MONOTONIC, &next);
+      capture_last = 0;
+      continue;
+    }
+
+    uint8_t   ports = vt1211_capture_ports();
+    uint8_t   values[VT1211_PORTS_MAX];
+    uint64_t  stamp[VT1211_PORTS_MAX];
+
+    // The port locks are taken before capture_lock elsewhere
+    pthread_mutex_unlock(&capture_lock);
+    vt1211_ports_sample(ports, values, stamp);
+    pthread_mutex_lock(&capture_lock);
+
+    // A port subscribed meanwhile starts from its own first read
+    vt1211_capture_scan(ports & vt1211_capture_ports(), values, stamp);
+  }
+
+  return NULL;
+}
+
+int vt1211_capture_start(void) {
+  pthread_condattr_t  cond_attr;
+  pthread_attr_t      attr;
+  struct sched_param  param;
+  pthread_t           thread;
+
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&capture_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  param.sched_priority = VT1211_CAPTURE_PRIO;
+  pthread_attr_setschedparam(&attr, &param);
+
+  int rc = pthread_create(&thread, &attr, vt1211_capture_thread, NULL);
+
+  pthread_attr_destroy(&attr);
+
+  return rc;
+}
+
+static void vt1211_capture_unlink(vt1211_capture_t *cap) {
+  for (vt1211_capture_t **p = &capture_list; *p != NULL; p = &(*p)->next) {
+    if (*p == cap) {
+      *p = cap->next;
+      break;
+    }
+  }
+}
+
+/*
+ * Drops the subscription of the OCB, if any
+ */
+void vt1211_capture_remove(vt1211_ocb_t *ocb) {
+  vt1211_capture_t *cap = ocb->capture;
+
+  if (cap == NULL)
+    return;
+
+  pthread_mutex_lock(&capture_lock);
+  vt1211_capture_unlink(cap);
+  pthread_cond_signal(&capture_cond);
+  pthread_mutex_unlock(&capture_lock);
+
+  ocb->capture = NULL;
+
+  free(cap->ring);
+  free(cap);
+}
+
+/*
+ * VT1211_CAPTURE. The ports and pins are already checked. A new subscription
+ * replaces the old one with an empty queue, all zero masks cancel it.
+ */
+int vt1211_capture(vt1211_ocb_t *ocb, gpio_capture_t *sub) {
+  vt1211_capture_t  *cap;
+  uint8_t           ports = 0;
+  uint32_t          size  = sub->depth != 0 ? sub->depth : VT1211_CAPTURE_DEPTH;
+
+  vt1211_capture_remove(ocb);
+
+  if (ocb->bind == VT1211_BIND_CAPTURE)
+    ocb->bind = VT1211_BIND_NONE;
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (sub->mask[port])
+      ports |= 1 << port;
+  }
+
+  if (ports == 0)
+    return EOK;
+
+  if (size > VT1211_CAPTURE_DEPTH_MAX)
+    return EINVAL;
+
+  if (size & (size - 1))
+    size = 1U << (32 - __builtin_clz(size));
+
+  if ((cap = calloc(1, sizeof(vt1211_capture_t))) == NULL)
+    return ENOMEM;
+
+  if ((cap->ring = malloc(size * sizeof(gpio_edge_t))) == NULL) {
+    free(cap);
+    return ENOMEM;
+  }
+
+  cap->ocb        = ocb;
+  cap->sub        = *sub;
+  cap->sub.depth  = size;
+  cap->size       = size;
+
+  if (cap->sub.period_us == 0)
+    cap->sub.period_us = VT1211_CAPTURE_PERIOD_US;
+
+  pthread_mutex_lock(&capture_lock);
+
+  // A port nobody captured has no previous value yet
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((ports & (1 << port)) && !(vt1211_capture_ports() & (1 << port)))
+      capture_value[port] = vt1211_hw_port_read(port);
+  }
+
+  cap->next     = capture_list;
+  capture_list  = cap;
+
+  pthread_cond_signal(&capture_cond);
+  pthread_mutex_unlock(&capture_lock);
+
+  ocb->capture  = cap;
+  ocb->bind     = VT1211_BIND_CAPTURE;
+
+  return EOK;
+}
+
+/*
+ * Takes up to count queued edges
+ */
+uint32_t vt1211_capture_read(vt1211_ocb_t *ocb, gpio_edge_t *edges, uint32_t count) {
+  vt1211_capture_t  *cap = ocb->capture;
+  uint32_t          head;
+
+  if (cap == NULL)
+    return 0;
+
+  head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+
+  if (count > head - cap->tail)
+    count = head - cap->tail;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    edges[i] = cap->ring[(cap->tail + i) & (cap->size - 1)];
+  }
+
+  __atomic_store_n(&cap->tail, cap->tail + count, __ATOMIC_RELEASE);
+
+  return count;
+}
+
+bool vt1211_capture_pending(vt1211_ocb_t *ocb) {
+  vt1211_capture_t *cap = ocb->capture;
+
+  return cap != NULL && __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE) != cap->tail;
+}
+
+/*
+ * VT1211_CAPTURE_STATS
+ */
+void vt1211_capture_stats(vt1211_ocb_t *ocb, gpio_capture_stats_t *stats) {
+  vt1211_capture_t *cap = ocb->capture;
+
+  memset(stats, 0, sizeof(gpio_capture_stats_t));
+
+  if (cap != NULL) {
+    stats->events   = __atomic_load_n(&cap->events, __ATOMIC_RELAXED);
+    stats->overflow = __atomic_load_n(&cap->overflow, __ATOMIC_RELAXED);
+    stats->queued   = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE) - cap->tail;
+    stats->depth    = cap->size;
+  }
+
+  pthread_mutex_lock(&capture_lock);
+
+  stats->samples        = capture_samples;
+  stats->interval_min   = capture_min;
+  stats->interval_max   = capture_max;
+  stats->interval_avg   = capture_intervals != 0 ? capture_sum / capture_intervals : 0;
+
+  pthread_mutex_unlock(&capture_lock);
+
+  stats->cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+}
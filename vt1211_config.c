@@ -0,0 +1,281 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Startup configuration file (-c). It's read and checked as a whole, then
+ * applied before the pathnames are attached, so clients find the pins set up:
+ * all the initial output levels are latched first, then all the directions
+ * are set in one configuration session, so an output never drives anything
+ * but its declared level. One declaration per line, # starts a comment.
+ * Ports are the chip port numbers 1, 3..6, pins are written port.pin:
+ *
+ *   port 3 dir 0xF0 out 0x50      directions (a set bit is an output) and
+ *                                 levels of the whole port, out is optional
+ *   pin 4.2 out 1                 an output with its initial level
+ *   pin 4.3 in
+ *   group bus 3.0 3.1 4.0 4.1     a pin group, the first pin is bit 0
+ *   reserve 5                     the port or the pin is owned by the
+ *   reserve 4.7                   driver, clients can't touch it
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vt1211_nto.h"
+
+#define VT1211_CONFIG_LINE  256
+
+typedef struct {
+  uint8_t       ports;                            // ports with directions
+  uint8_t       dir_mask[VT1211_PORTS_MAX];
+  uint8_t       dir[VT1211_PORTS_MAX];
+  uint8_t       out_mask[VT1211_PORTS_MAX];
+  uint8_t       out[VT1211_PORTS_MAX];
+  uint8_t       reserve_ports;
+  uint8_t       reserve_pins[VT1211_PORTS_MAX];
+  uint32_t      groups_count;
+  gpio_group_t  groups[VT1211_GROUPS_MAX];
+  int           groups_line[VT1211_GROUPS_MAX];   // declaration lines, for the errors
+} vt1211_config_t;
+
+static int vt1211_config_port(const char *s, uint8_t *port) {
+  char          *end;
+  unsigned long n = strtoul(s, &end, 10);
+
+  if (*end != 0 && *end != '.')
+    return EINVAL;
+
+  if (n == 1)
+    *port = VT1211_PORT_1;
+  else if (n >= 3 && n <= 6)
+    *port = VT1211_PORT_3 + n - 3;
+  else
+    return EINVAL;
+
+  return *port < ports_info.count ? EOK : EINVAL;
+}
+
+static int vt1211_config_pin(const char *s, uint8_t *port, uint8_t *pin) {
+  const char    *dot = strchr(s, '.');
+  char          *end;
+  unsigned long n;
+
+  if (dot == NULL || vt1211_config_port(s, port) != EOK)
+    return EINVAL;
+
+  n = strtoul(dot + 1, &end, 10);
+
+  if (*end != 0 || dot[1] == 0 || n >= VT1211_PINS_MAX || !(ports_status[*port].pins & (1 << n)))
+    return EINVAL;
+
+  *pin = 1 << n;
+  return EOK;
+}
+
+static int vt1211_config_byte(const char *s, uint8_t *value) {
+  char          *end;
+  unsigned long n;
+
+  if (s == NULL)
+    return EINVAL;
+
+  n = strtoul(s, &end, 0);
+
+  if (*end != 0 || n > 0xFF)
+    return EINVAL;
+
+  *value = n;
+  return EOK;
+}
+
+static int vt1211_config_line(vt1211_config_t *config, char *line, int line_no) {
+  char    *save;
+  char    *key    = strtok_r(line, " \t\r\n", &save);
+  char    *arg    = strtok_r(NULL, " \t\r\n", &save);
+  uint8_t port;
+  uint8_t pin;
+  uint8_t value;
+
+  if (key == NULL)
+    return EOK;
+
+  if (arg == NULL)
+    return EINVAL;
+
+  if (strcmp(key, "port") == 0) {
+    char *word = strtok_r(NULL, " \t\r\n", &save);
+
+    if (strchr(arg, '.') != NULL || vt1211_config_port(arg, &port) != EOK || word == NULL || strcmp(word, "dir") != 0 ||
+        vt1211_config_byte(strtok_r(NULL, " \t\r\n", &save), &value) != EOK) {
+      return EINVAL;
+    }
+
+    config->dir_mask[port]  = 0xFF;
+    config->dir[port]       = value;
+    config->ports          |= 1 << port;
+
+    if ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+      if (strcmp(word, "out") != 0 || vt1211_config_byte(strtok_r(NULL, " \t\r\n", &save), &value) != EOK)
+        return EINVAL;
+
+      config->out_mask[port]  = 0xFF;
+      config->out[port]       = value;
+    }
+  } else if (strcmp(key, "pin") == 0) {
+    char *word = strtok_r(NULL, " \t\r\n", &save);
+
+    if (vt1211_config_pin(arg, &port, &pin) != EOK || word == NULL)
+      return EINVAL;
+
+    config->dir_mask[port] |= pin;
+    config->ports          |= 1 << port;
+
+    if (strcmp(word, "in") == 0) {
+      config->dir[port] &= ~pin;
+    } else if (strcmp(word, "out") == 0) {
+      config->dir[port] |= pin;
+
+      if ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (vt1211_config_byte(word, &value) != EOK || value > 1)
+          return EINVAL;
+
+        config->out_mask[port] |= pin;
+        config->out[port]       = value ? config->out[port] | pin : config->out[port] & ~pin;
+      }
+    } else {
+      return EINVAL;
+    }
+  } else if (strcmp(key, "group") == 0) {
+    gpio_group_t *group = &config->groups[config->groups_count];
+
+    if (config->groups_count == VT1211_GROUPS_MAX || strlen(arg) >= VT1211_GROUP_NAME)
+      return EINVAL;
+
+    memset(group, 0, sizeof(gpio_group_t));
+    strcpy(group->name, arg);
+
+    for (char *member; (member = strtok_r(NULL, " \t\r\n", &save)) != NULL; ++group->count) {
+      if (group->count == VT1211_GROUP_PINS ||
+          vt1211_config_pin(member, &group->members[group->count].port, &group->members[group->count].pin) != EOK) {
+        return EINVAL;
+      }
+    }
+
+    if (group->count == 0)
+      return EINVAL;
+
+    config->groups_line[config->groups_count++] = line_no;
+  } else if (strcmp(key, "reserve") == 0) {
+    if (strchr(arg, '.') == NULL) {
+      if (vt1211_config_port(arg, &port) != EOK)
+        return EINVAL;
+
+      config->reserve_ports |= 1 << port;
+    } else {
+      if (vt1211_config_pin(arg, &port, &pin) != EOK)
+        return EINVAL;
+
+      config->reserve_pins[port] |= pin;
+    }
+  } else {
+    return EINVAL;
+  }
+
+  return EOK;
+}
+
+/*
+ * Reads and applies the configuration file. Returns EOK or an error code,
+ * nothing is applied if the file has an error.
+ */
+int vt1211_config_load(const char *path) {
+  vt1211_config_t config;
+  char            line[VT1211_CONFIG_LINE];
+  int             line_no = 0;
+  int             rc      = EOK;
+  FILE            *file;
+
+  if ((file = fopen(path, "r")) == NULL) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return errno;
+  }
+
+  memset(&config, 0, sizeof(config));
+
+  while (rc == EOK && fgets(line, sizeof(line), file) != NULL) {
+    char *comment = strchr(line, '#');
+
+    ++line_no;
+
+    // fgets would hand the rest of the line over as the next one
+    if (strchr(line, '\n') == NULL && !feof(file)) {
+      fprintf(stderr, "%s:%d: Line longer than %d characters\n", path, line_no, VT1211_CONFIG_LINE - 2);
+      rc = EINVAL;
+      break;
+    }
+
+    if (comment != NULL)
+      *comment = 0;
+
+    if ((rc = vt1211_config_line(&config, line, line_no)) != EOK)
+      fprintf(stderr, "%s:%d: Incorrect declaration\n", path, line_no);
+  }
+
+  fclose(file);
+
+  if (rc != EOK)
+    return rc;
+
+  for (uint32_t i = 0; i < config.groups_count; ++i) {
+    if ((rc = vt1211_group_verify(&config.groups[i])) != EOK) {
+      fprintf(stderr, "%s:%d: Incorrect group %s: %s\n", path, config.groups_line[i], config.groups[i].name,
+              strerror(rc));
+      return rc;
+    }
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (config.out_mask[port])
+      vt1211_port_modify(port, VT1211_MODIFY_ASSIGN, config.out_mask[port], config.out[port]);
+  }
+
+  vt1211_ports_dir(config.ports, config.dir_mask, config.dir);
+
+  for (uint32_t i = 0; i < config.groups_count; ++i) {
+    if ((rc = vt1211_group_define(&config.groups[i])) != EOK) {
+      fprintf(stderr, "%s:%d: Group %s not defined: %s\n", path, config.groups_line[i], config.groups[i].name,
+              strerror(rc));
+      return rc;
+    }
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((config.reserve_ports & (1 << port)) || config.reserve_pins[port])
+      vt1211_reserve(port, config.reserve_ports & (1 << port) ? 0 : config.reserve_pins[port]);
+  }
+
+  debugf("Config:\t\t\t%s, %d lines OK\n", path, line_no);
+
+  return EOK;
+}
@@ -0,0 +1,277 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Pin groups.
+ *
+ * A group maps the bits of an integer onto pins of one or more ports. When
+ * the group is defined its members are folded into runs: consecutive bits
+ * landing on consecutive pins of one port, which move with a single shift
+ * and mask. A write builds the new value of every touched port from the runs
+ * and writes each port once with all of them locked; a read reads each port
+ * once.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include "vt1211_nto.h"
+
+typedef struct {
+  uint8_t   port;
+  int8_t    shift;                              // pin index - bit index
+  uint32_t  mask;                               // bits of the value
+} vt1211_run_t;
+
+typedef struct {
+  uint32_t            id;                       // 0 - free slot
+  gpio_group_t        def;
+  uint8_t             ports;                    // touched ports mask
+  uint8_t             pins[VT1211_PORTS_MAX];   // member pins by port
+  uint8_t             runs_count;
+  vt1211_run_t        runs[VT1211_GROUP_PINS];
+} vt1211_group_t;
+
+static pthread_rwlock_t group_lock = PTHREAD_RWLOCK_INITIALIZER;
+static vt1211_group_t   groups[VT1211_GROUPS_MAX];
+static uint32_t         group_generation;
+
+/*
+ * The id has the slot in the low byte, a removed group's id doesn't match
+ * the next group in the slot.
+ */
+static vt1211_group_t *vt1211_group_get(uint32_t id) {
+  vt1211_group_t *group = &groups[(id & 0xFF) % VT1211_GROUPS_MAX];
+
+  return id != 0 && group->id == id ? group : NULL;
+}
+
+static vt1211_group_t *vt1211_group_by_name(const char *name) {
+  for (int i = 0; i < VT1211_GROUPS_MAX; ++i) {
+    if (groups[i].id != 0 && strcmp(groups[i].def.name, name) == 0)
+      return &groups[i];
+  }
+
+  return NULL;
+}
+
+static int vt1211_group_build(vt1211_group_t *group, const gpio_group_t *def) {
+  if (def->name[0] == 0 || memchr(def->name, 0, VT1211_GROUP_NAME) == NULL || def->count > VT1211_GROUP_PINS)
+    return EINVAL;
+
+  memset(group->pins, 0, sizeof(group->pins));
+  group->ports      = 0;
+  group->runs_count = 0;
+
+  for (uint8_t bit = 0; bit < def->count; ++bit) {
+    const gpio_group_member_t *member = &def->members[bit];
+
+    if (member->port >= ports_info.count) {
+      debugf("Incorrect port\n");
+      return VT1211_ERR_INCRCT_PORT;
+    }
+
+    if (__builtin_popcount(member->pin) != 1 || !(member->pin & ports_status[member->port].pins) ||
+        (member->pin & group->pins[member->port])) {
+      debugf("Incorrect pin\n");
+      return VT1211_ERR_INCRCT_PIN;
+    }
+
+    int           shift = __builtin_ctz(member->pin) - bit;
+    vt1211_run_t  *run  = group->runs_count != 0 ? &group->runs[group->runs_count - 1] : NULL;
+
+    if (run == NULL || run->port != member->port || run->shift != shift) {
+      run         = &group->runs[group->runs_count++];
+      run->port   = member->port;
+      run->shift  = shift;
+      run->mask   = 0;
+    }
+
+    run->mask                   |= 1U << bit;
+    group->pins[member->port]   |= member->pin;
+    group->ports                |= 1 << member->port;
+  }
+
+  return EOK;
+}
+
+/*
+ * Checks a definition without defining the group. Returns the error
+ * vt1211_group_define would return for it, except ENOSPC and ENOENT.
+ */
+int vt1211_group_verify(const gpio_group_t *def) {
+  vt1211_group_t built;
+
+  return vt1211_group_build(&built, def);
+}
+
+/*
+ * VT1211_GROUP_DEFINE
+ */
+int vt1211_group_define(gpio_group_t *def) {
+  vt1211_group_t  *group;
+  vt1211_group_t  built;
+  int             rc;
+
+  if ((rc = vt1211_group_build(&built, def)) != EOK)
+    return rc;
+
+  pthread_rwlock_wrlock(&group_lock);
+
+  if ((group = vt1211_group_by_name(def->name)) == NULL && def->count != 0) {
+    for (int i = 0; i < VT1211_GROUPS_MAX && group == NULL; ++i) {
+      if (groups[i].id == 0) {
+        group     = &groups[i];
+        group->id = (++group_generation << 8) | i;
+      }
+    }
+  }
+
+  if (group == NULL) {
+    rc = def->count != 0 ? ENOSPC : ENOENT;
+  } else if (def->count == 0) {
+    group->id = 0;
+    def->id   = 0;
+  } else {
+    built.id    = group->id;
+    built.def   = *def;
+    *group      = built;
+    def->id     = group->id;
+  }
+
+  pthread_rwlock_unlock(&group_lock);
+
+  return rc;
+}
+
+/*
+ * VT1211_GROUP_FIND
+ */
+int vt1211_group_find(gpio_group_t *def) {
+  vt1211_group_t  *group;
+  int             rc = EOK;
+
+  def->name[VT1211_GROUP_NAME - 1] = 0;
+
+  pthread_rwlock_rdlock(&group_lock);
+
+  if ((group = vt1211_group_by_name(def->name)) != NULL)
+    *def = group->def;
+  else
+    rc = ENOENT;
+
+  pthread_rwlock_unlock(&group_lock);
+
+  return rc;
+}
+
+static int vt1211_group_check(vt1211_ocb_t *ocb, const vt1211_group_t *group) {
+  int rc;
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((group->ports & (1 << port)) &&
+        (rc = vt1211_check(ocb, port, group->pins[port], VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM)) != EOK) {
+      return rc;
+    }
+  }
+
+  return EOK;
+}
+
+/*
+ * VT1211_GROUP_WRITE
+ */
+int vt1211_group_write(vt1211_ocb_t *ocb, uint32_t id, uint32_t value) {
+  vt1211_group_t  *group;
+  uint8_t         data[VT1211_PORTS_MAX] = {0};
+  int             rc;
+
+  pthread_rwlock_rdlock(&group_lock);
+
+  if ((group = vt1211_group_get(id)) == NULL) {
+    pthread_rwlock_unlock(&group_lock);
+    return ENOENT;
+  }
+
+  for (uint8_t i = 0; i < group->runs_count; ++i) {
+    const vt1211_run_t *run = &group->runs[i];
+
+    data[run->port] |= run->shift >= 0 ? (value & run->mask) << run->shift : (value & run->mask) >> -run->shift;
+  }
+
+  vt1211_lock(group->ports);
+
+  if ((rc = vt1211_group_check(ocb, group)) == EOK) {
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (group->ports & (1 << port))
+        vt1211_port_modify(port, VT1211_MODIFY_ASSIGN, group->pins[port], data[port]);
+    }
+  }
+
+  vt1211_unlock(group->ports);
+  pthread_rwlock_unlock(&group_lock);
+
+  return rc;
+}
+
+/*
+ * VT1211_GROUP_READ
+ */
+int vt1211_group_read(vt1211_ocb_t *ocb, uint32_t id, uint32_t *value) {
+  vt1211_group_t  *group;
+  uint8_t         data[VT1211_PORTS_MAX];
+  int             rc;
+
+  pthread_rwlock_rdlock(&group_lock);
+
+  if ((group = vt1211_group_get(id)) == NULL) {
+    pthread_rwlock_unlock(&group_lock);
+    return ENOENT;
+  }
+
+  vt1211_lock(group->ports);
+
+  if ((rc = vt1211_group_check(ocb, group)) == EOK) {
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (group->ports & (1 << port))
+        data[port] = vt1211_port_read(port);
+    }
+  }
+
+  vt1211_unlock(group->ports);
+
+  if (rc == EOK) {
+    *value = 0;
+
+    for (uint8_t i = 0; i < group->runs_count; ++i) {
+      const vt1211_run_t  *run  = &group->runs[i];
+      uint32_t            bits  = data[run->port];
+
+      *value |= (run->shift >= 0 ? bits >> run->shift : bits << -run->shift) & run->mask;
+    }
+  }
+
+  pthread_rwlock_unlock(&group_lock);
+
+  return rc;
+}
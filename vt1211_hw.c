@@ -0,0 +1,107 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * The vt1211_gpio backend: the library functions as they are, but for
+ * ports_dir which goes to the configuration registers itself
+ */
+
+#include <hw/inout.h>
+#include "vt1211_ipc.h"
+#include "vt1211_hw.h"
+#include "vt1211_gpio/src/vt1211_gpio.h"
+
+// Configuration space of the chip behind CIR/CDR
+#define GPIO_CONFIG_ENTER   0x87    // written twice
+#define GPIO_CONFIG_EXIT    0xAA
+#define GPIO_REG_LDN        0x07
+#define GPIO_LDN            0x08
+#define GPIO_REG_DIR        0xF0    // + port, a set bit is an output
+
+static uint16_t gpio_cir;
+static uint16_t gpio_cdr;
+
+// vt_init takes and returns the VT_* values, the backend the VT1211_HW_* ones
+static int gpio_init(uint8_t config, uint16_t cir, uint16_t cdr) {
+  uint8_t vt_config = ((config & VT1211_HW_PORT_1) ? VT_CONFIG_PORT_1 : 0) |
+                      ((config & VT1211_HW_PORT_3_6) ? VT_CONFIG_PORT_3_6 : 0);
+
+  gpio_cir = cir;
+  gpio_cdr = cdr;
+
+  switch (vt_init(vt_config, cir, cdr)) {
+    case VT_INIT_OK:        return VT1211_HW_INIT_OK;
+    case VT_INIT_NO_PORT:   return VT1211_HW_INIT_NO_PORT;
+    default:                return VT1211_HW_INIT_NOT_FOUND;
+  }
+}
+
+/*
+ * vt1211_gpio enters and leaves the configuration mode in every mode call,
+ * which would cost a session per port and two for a port with pins going
+ * both ways. All the ports are done in one session instead: enter once,
+ * select the GPIO device once, write each direction register and leave. A
+ * port set whole is written as it is, the others read-modify-write.
+ */
+static void gpio_ports_dir(uint8_t ports, const uint8_t *mask, const uint8_t *dir) {
+  out8(gpio_cir, GPIO_CONFIG_ENTER);
+  out8(gpio_cir, GPIO_CONFIG_ENTER);
+  out8(gpio_cir, GPIO_REG_LDN);
+  out8(gpio_cdr, GPIO_LDN);
+
+  for (uint8_t port = 0; ports >> port; ++port) {
+    if (!(ports & (1 << port)))
+      continue;
+
+    uint8_t value = dir[port];
+
+    out8(gpio_cir, GPIO_REG_DIR + port);
+
+    if (mask[port] != 0xFF)
+      value = (in8(gpio_cdr) & ~mask[port]) | (dir[port] & mask[port]);
+
+    out8(gpio_cdr, value);
+  }
+
+  out8(gpio_cir, GPIO_CONFIG_EXIT);
+}
+
+const vt1211_hw_t vt1211_hw_gpio = {
+  .name       = "vt1211_gpio",
+  .io_request = io_request,
+  .init       = gpio_init,
+  .pin_mode   = vt_pin_mode,
+  .port_mode  = vt_port_mode,
+  .ports_dir  = gpio_ports_dir,
+  .pin_set    = vt_pin_set,
+  .pin_get    = vt_pin_get,
+  .port_write = vt_port_write,
+  .port_read  = vt_port_read,
+  .dev_id     = vt_get_dev_id,
+  .dev_rev    = vt_get_dev_rev,
+  .baddr      = vt_get_baddr,
+};
+
+const vt1211_hw_t *vt1211_hw = &vt1211_hw_gpio;
+
+__thread uint32_t vt1211_hw_calls;
@@ -0,0 +1,123 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+#ifndef VT1211_HW_H
+#define VT1211_HW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VT1211_PORTS_MAX    5
+#define VT1211_PINS_MAX     8
+
+// Ports to enable (init config), the vt1211_gpio VT_CONFIG_* flags
+
+#define VT1211_HW_PORT_1          0x01
+#define VT1211_HW_PORT_3_6        0x02
+
+// init results, the vt1211_gpio VT_INIT_* codes
+
+#define VT1211_HW_INIT_OK         0
+#define VT1211_HW_INIT_NOT_FOUND  1
+#define VT1211_HW_INIT_NO_PORT    2
+
+/*
+ * Chip access backend. The driver does all its hardware access through
+ * vt1211_hw, which is the vt1211_gpio library on the real board or the
+ * simulated chip (-S). The calls have the vt1211_gpio semantics: pins are
+ * masks, a set bit of the port mode is an output, init takes VT1211_HW_PORT_*
+ * and returns VT1211_HW_INIT_*. This header doesn't depend on QNX or on the
+ * library, so the simulated chip also builds on a development host.
+ * ports_dir sets the directions of the pins mask[port] of every port in the
+ * ports mask to dir[port], a 0xFF mask sets the whole port. It does all of
+ * them in one configuration session where the backend can.
+ */
+typedef struct {
+  const char  *name;
+  int         (*io_request)(void);
+  int         (*init)(uint8_t config, uint16_t cir, uint16_t cdr);
+  void        (*pin_mode)(uint8_t port, uint8_t pin, uint8_t mode);
+  void        (*port_mode)(uint8_t port, uint8_t mode);
+  void        (*ports_dir)(uint8_t ports, const uint8_t *mask, const uint8_t *dir);
+  void        (*pin_set)(uint8_t port, uint8_t pin, uint8_t data);
+  uint8_t     (*pin_get)(uint8_t port, uint8_t pin);
+  void        (*port_write)(uint8_t port, uint8_t data);
+  uint8_t     (*port_read)(uint8_t port);
+  uint8_t     (*dev_id)(void);
+  uint8_t     (*dev_rev)(void);
+  uint16_t    (*baddr)(void);
+} vt1211_hw_t;
+
+extern const vt1211_hw_t  *vt1211_hw;
+extern const vt1211_hw_t  vt1211_hw_gpio;
+extern const vt1211_hw_t  vt1211_hw_sim;
+
+/*
+ * GPIO access through the backend. Every call is counted per thread, the
+ * statistics attribute the calls to the requests.
+ */
+extern __thread uint32_t  vt1211_hw_calls;
+
+static inline void vt1211_hw_pin_mode(uint8_t port, uint8_t pin, uint8_t mode) {
+  ++vt1211_hw_calls;
+  vt1211_hw->pin_mode(port, pin, mode);
+}
+
+static inline void vt1211_hw_port_mode(uint8_t port, uint8_t mode) {
+  ++vt1211_hw_calls;
+  vt1211_hw->port_mode(port, mode);
+}
+
+static inline void vt1211_hw_ports_dir(uint8_t ports, const uint8_t *mask, const uint8_t *dir) {
+  ++vt1211_hw_calls;
+  vt1211_hw->ports_dir(ports, mask, dir);
+}
+
+static inline void vt1211_hw_pin_set(uint8_t port, uint8_t pin, uint8_t data) {
+  ++vt1211_hw_calls;
+  vt1211_hw->pin_set(port, pin, data);
+}
+
+static inline uint8_t vt1211_hw_pin_get(uint8_t port, uint8_t pin) {
+  ++vt1211_hw_calls;
+  return vt1211_hw->pin_get(port, pin);
+}
+
+static inline void vt1211_hw_port_write(uint8_t port, uint8_t data) {
+  ++vt1211_hw_calls;
+  vt1211_hw->port_write(port, data);
+}
+
+static inline uint8_t vt1211_hw_port_read(uint8_t port) {
+  ++vt1211_hw_calls;
+  return vt1211_hw->port_read(port);
+}
+
+// vt1211_hw_sim.c
+
+void      vt1211_sim_latency(uint32_t latency_ns);
+void      vt1211_sim_input(uint8_t port, uint8_t value);
+void      vt1211_sim_counters(uint64_t *reads, uint64_t *writes);
+void      vt1211_sim_port(uint8_t port, uint8_t *latch, uint8_t *dir);
+
+#endif
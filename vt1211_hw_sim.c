@@ -0,0 +1,320 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Simulated chip, for running the driver without the board. It models the
+ * I/O the library does: the configuration space behind the CIR/CDR pair
+ * (entered with 0x87 0x87, left with 0xAA) and the GPIO data ports at the
+ * base address. Every simulated inb/outb is counted and sleeps latency_ns to
+ * model the cost of an ISA access. Input pins read the levels set with
+ * vt1211_sim_input (high after init), output pins read back the latch.
+ *
+ * The register map is the simulator's own, laid out like a Super I/O
+ * logical device:
+ *   0x07          logical device number
+ *   0x20, 0x21    device ID and revision
+ *   0x30          GPIO enable: bit 0 - port 1, bit 1 - ports 3..6
+ *   0x60, 0x61    GPIO base address
+ *   0xF0 + port   direction, a set bit is an output
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "vt1211_ipc.h"
+#include "vt1211_hw.h"
+
+#define SIM_REG_LDN       0x07
+#define SIM_REG_DEV_ID    0x20
+#define SIM_REG_DEV_REV   0x21
+#define SIM_REG_ENABLE    0x30
+#define SIM_REG_BASE_HI   0x60
+#define SIM_REG_BASE_LO   0x61
+#define SIM_REG_DIR       0xF0
+
+#define SIM_ENTER         0x87
+#define SIM_EXIT          0xAA
+#define SIM_GPIO_LDN      0x08
+#define SIM_DEV_ID        0x3C
+#define SIM_DEV_REV       0x02
+#define SIM_BASE          0x0800
+
+static struct {
+  uint16_t  cir;
+  uint16_t  cdr;
+  uint8_t   unlock;                   // SIM_ENTER writes seen, config mode at 2
+  uint8_t   index;                    // selected configuration register
+  uint8_t   cfg[256];
+  uint8_t   latch[VT1211_PORTS_MAX];
+  uint8_t   input[VT1211_PORTS_MAX];
+} sim;
+
+static uint32_t sim_latency_ns;
+static uint64_t sim_reads;
+static uint64_t sim_writes;
+
+/*
+ * The access sleeps rather than spins, like a thread stalled on the bus, so
+ * accesses of other threads go on meanwhile even on one CPU
+ */
+static void sim_delay(void) {
+  struct timespec end;
+  uint64_t        ns;
+
+  if (sim_latency_ns == 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  ns          = end.tv_nsec + sim_latency_ns;
+  end.tv_sec += ns / 1000000000;
+  end.tv_nsec = ns % 1000000000;
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR)
+    ;
+}
+
+static inline int sim_data_port(uint16_t addr) {
+  uint16_t base = (sim.cfg[SIM_REG_BASE_HI] << 8) | sim.cfg[SIM_REG_BASE_LO];
+
+  return addr >= base && addr < base + VT1211_PORTS_MAX ? addr - base : -1;
+}
+
+static void sim_outb(uint16_t addr, uint8_t value) {
+  int port;
+
+  __atomic_add_fetch(&sim_writes, 1, __ATOMIC_RELAXED);
+  sim_delay();
+
+  if (addr == sim.cir) {
+    if (sim.unlock < 2) {
+      sim.unlock = value == SIM_ENTER ? sim.unlock + 1 : 0;
+    } else if (value == SIM_EXIT) {
+      sim.unlock = 0;
+    } else {
+      sim.index = value;
+    }
+  } else if (addr == sim.cdr) {
+    if (sim.unlock == 2 && sim.index != SIM_REG_DEV_ID && sim.index != SIM_REG_DEV_REV)
+      sim.cfg[sim.index] = value;
+  } else if ((port = sim_data_port(addr)) >= 0) {
+    sim.latch[port] = value;
+  }
+}
+
+static uint8_t sim_inb(uint16_t addr) {
+  int port;
+
+  __atomic_add_fetch(&sim_reads, 1, __ATOMIC_RELAXED);
+  sim_delay();
+
+  if (addr == sim.cdr)
+    return sim.unlock == 2 ? sim.cfg[sim.index] : 0xFF;
+
+  if ((port = sim_data_port(addr)) >= 0) {
+    uint8_t dir = sim.cfg[SIM_REG_DIR + port];
+
+    return (sim.latch[port] & dir) | (sim.input[port] & ~dir);
+  }
+
+  return 0xFF;
+}
+
+static void sim_config_enter(void) {
+  sim_outb(sim.cir, SIM_ENTER);
+  sim_outb(sim.cir, SIM_ENTER);
+  sim_outb(sim.cir, SIM_REG_LDN);
+  sim_outb(sim.cdr, SIM_GPIO_LDN);
+}
+
+static void sim_config_exit(void) {
+  sim_outb(sim.cir, SIM_EXIT);
+}
+
+static uint8_t sim_config_read(uint8_t reg) {
+  sim_outb(sim.cir, reg);
+  return sim_inb(sim.cdr);
+}
+
+static void sim_config_write(uint8_t reg, uint8_t value) {
+  sim_outb(sim.cir, reg);
+  sim_outb(sim.cdr, value);
+}
+
+static uint16_t sim_base(void) {
+  return (sim.cfg[SIM_REG_BASE_HI] << 8) | sim.cfg[SIM_REG_BASE_LO];
+}
+
+static int sim_io_request(void) {
+  return 1;
+}
+
+static int sim_init(uint8_t config, uint16_t cir, uint16_t cdr) {
+  memset(&sim, 0, sizeof(sim));
+  memset(sim.input, 0xFF, sizeof(sim.input));
+
+  sim.cir = cir;
+  sim.cdr = cdr;
+  sim.cfg[SIM_REG_DEV_ID]   = SIM_DEV_ID;
+  sim.cfg[SIM_REG_DEV_REV]  = SIM_DEV_REV;
+  sim.cfg[SIM_REG_BASE_HI]  = SIM_BASE >> 8;
+  sim.cfg[SIM_REG_BASE_LO]  = SIM_BASE & 0xFF;
+
+  if ((config & (VT1211_HW_PORT_1 | VT1211_HW_PORT_3_6)) == 0)
+    return VT1211_HW_INIT_NO_PORT;
+
+  sim_config_enter();
+
+  if (sim_config_read(SIM_REG_DEV_ID) != SIM_DEV_ID) {
+    sim_config_exit();
+    return VT1211_HW_INIT_NOT_FOUND;
+  }
+
+  sim_config_write(SIM_REG_ENABLE, ((config & VT1211_HW_PORT_1) ? 0x01 : 0) |
+                                   ((config & VT1211_HW_PORT_3_6) ? 0x02 : 0));
+  sim_config_exit();
+
+  return VT1211_HW_INIT_OK;
+}
+
+static void sim_pin_mode(uint8_t port, uint8_t pin, uint8_t mode) {
+  sim_config_enter();
+
+  uint8_t dir = sim_config_read(SIM_REG_DIR + port);
+
+  if (mode == VT1211_PIN_INPUT) {
+    dir &= ~pin;
+  } else {
+    dir |= pin;
+  }
+
+  sim_config_write(SIM_REG_DIR + port, dir);
+  sim_config_exit();
+}
+
+static void sim_port_mode(uint8_t port, uint8_t mode) {
+  sim_config_enter();
+  sim_config_write(SIM_REG_DIR + port, mode);
+  sim_config_exit();
+}
+
+static void sim_ports_dir(uint8_t ports, const uint8_t *mask, const uint8_t *dir) {
+  sim_config_enter();
+
+  for (uint8_t port = 0; ports >> port; ++port) {
+    if (!(ports & (1 << port)))
+      continue;
+
+    uint8_t value = dir[port];
+
+    if (mask[port] != 0xFF)
+      value = (sim_config_read(SIM_REG_DIR + port) & ~mask[port]) | (dir[port] & mask[port]);
+
+    sim_config_write(SIM_REG_DIR + port, value);
+  }
+
+  sim_config_exit();
+}
+
+static void sim_port_write(uint8_t port, uint8_t data) {
+  sim_outb(sim_base() + port, data);
+}
+
+static uint8_t sim_port_read(uint8_t port) {
+  return sim_inb(sim_base() + port);
+}
+
+static void sim_pin_set(uint8_t port, uint8_t pin, uint8_t data) {
+  uint8_t value = sim_port_read(port);
+
+  sim_port_write(port, data ? value | pin : value & ~pin);
+}
+
+static uint8_t sim_pin_get(uint8_t port, uint8_t pin) {
+  return (sim_port_read(port) & pin) ? 1 : 0;
+}
+
+static uint8_t sim_dev_id(void) {
+  sim_config_enter();
+  uint8_t id = sim_config_read(SIM_REG_DEV_ID);
+  sim_config_exit();
+
+  return id;
+}
+
+static uint8_t sim_dev_rev(void) {
+  sim_config_enter();
+  uint8_t rev = sim_config_read(SIM_REG_DEV_REV);
+  sim_config_exit();
+
+  return rev;
+}
+
+static uint16_t sim_baddr(void) {
+  sim_config_enter();
+  uint16_t base = (sim_config_read(SIM_REG_BASE_HI) << 8) | sim_config_read(SIM_REG_BASE_LO);
+  sim_config_exit();
+
+  return base;
+}
+
+const vt1211_hw_t vt1211_hw_sim = {
+  .name       = "simulated",
+  .io_request = sim_io_request,
+  .init       = sim_init,
+  .pin_mode   = sim_pin_mode,
+  .port_mode  = sim_port_mode,
+  .ports_dir  = sim_ports_dir,
+  .pin_set    = sim_pin_set,
+  .pin_get    = sim_pin_get,
+  .port_write = sim_port_write,
+  .port_read  = sim_port_read,
+  .dev_id     = sim_dev_id,
+  .dev_rev    = sim_dev_rev,
+  .baddr      = sim_baddr,
+};
+
+void vt1211_sim_latency(uint32_t latency_ns) {
+  sim_latency_ns = latency_ns;
+}
+
+/*
+ * Levels on the input pins of the port
+ */
+void vt1211_sim_input(uint8_t port, uint8_t value) {
+  if (port < VT1211_PORTS_MAX)
+    __atomic_store_n(&sim.input[port], value, __ATOMIC_RELAXED);
+}
+
+void vt1211_sim_counters(uint64_t *reads, uint64_t *writes) {
+  *reads  = __atomic_load_n(&sim_reads, __ATOMIC_RELAXED);
+  *writes = __atomic_load_n(&sim_writes, __ATOMIC_RELAXED);
+}
+
+/*
+ * Latch and direction register of the port, as the chip holds them
+ */
+void vt1211_sim_port(uint8_t port, uint8_t *latch, uint8_t *dir) {
+  *latch  = port < VT1211_PORTS_MAX ? __atomic_load_n(&sim.latch[port], __ATOMIC_RELAXED) : 0;
+  *dir    = port < VT1211_PORTS_MAX ? __atomic_load_n(&sim.cfg[SIM_REG_DIR + port], __ATOMIC_RELAXED) : 0;
+}
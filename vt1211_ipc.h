@@ -35,6 +35,34 @@
 #define VT1211_REQ_PIN      __DIOTF (_DCMD_MISC, 0x200708, gpio_data_t)
 #define VT1211_FREE_PORT    __DIOTF (_DCMD_MISC, 0x200709, gpio_data_t)
 #define VT1211_FREE_PIN     __DIOTF (_DCMD_MISC, 0x20070A, gpio_data_t)
+#define VT1211_BATCH        __DIOTF (_DCMD_MISC, 0x20070B, gpio_batch_t)
+#define VT1211_GET_ALL      __DIOF  (_DCMD_MISC, 0x20070C, gpio_ports_t)
+#define VT1211_SET_MULTI    __DIOT  (_DCMD_MISC, 0x20070D, gpio_ports_t)
+#define VT1211_RESYNC       __DION  (_DCMD_MISC, 0x20070E)
+#define VT1211_MODIFY_PORT  __DIOTF (_DCMD_MISC, 0x20070F, gpio_modify_t)
+
+#define VT1211_BIND         __DIOT  (_DCMD_MISC, 0x200720, gpio_bind_t)
+#define VT1211_SAMPLER_READ __DIOTF (_DCMD_MISC, 0x200721, gpio_samples_t)
+#define VT1211_WATCH        __DIOT  (_DCMD_MISC, 0x200722, gpio_watch_t)
+#define VT1211_WATCH_EVENTS __DIOF  (_DCMD_MISC, 0x200723, gpio_events_t)
+#define VT1211_PLAY_PATTERN   __DIOT  (_DCMD_MISC, 0x200724, gpio_pattern_t)
+#define VT1211_PATTERN_STATUS __DIOF  (_DCMD_MISC, 0x200725, gpio_pattern_status_t)
+#define VT1211_PATTERN_STOP   __DION  (_DCMD_MISC, 0x200726)
+#define VT1211_PWM_CONFIG     __DIOT  (_DCMD_MISC, 0x200727, gpio_pwm_t)
+#define VT1211_DEBOUNCE       __DIOT  (_DCMD_MISC, 0x200728, gpio_debounce_t)
+#define VT1211_RENEW          __DION  (_DCMD_MISC, 0x200729)  // keep the ownership lease (-l) of an idle client
+#define VT1211_TRACE          __DIOT  (_DCMD_MISC, 0x20072A, gpio_trace_ctl_t)
+#define VT1211_GET_STATS      __DIOTF (_DCMD_MISC, 0x20072B, gpio_stats_t)
+#define VT1211_STATS_RESET    __DION  (_DCMD_MISC, 0x20072C)
+#define VT1211_CONFIG_MULTI   __DIOT  (_DCMD_MISC, 0x20072D, gpio_dirs_t)
+#define VT1211_BUS_CONFIG     __DIOT  (_DCMD_MISC, 0x20072E, gpio_bus_t)
+#define VT1211_BUS_XFER       __DIOTF (_DCMD_MISC, 0x20072F, gpio_bus_xfer_t)
+#define VT1211_GROUP_DEFINE   __DIOTF (_DCMD_MISC, 0x200730, gpio_group_t)
+#define VT1211_GROUP_FIND     __DIOTF (_DCMD_MISC, 0x200731, gpio_group_t)
+#define VT1211_GROUP_WRITE    __DIOT  (_DCMD_MISC, 0x200732, gpio_group_value_t)
+#define VT1211_GROUP_READ     __DIOTF (_DCMD_MISC, 0x200733, gpio_group_value_t)
+#define VT1211_CAPTURE        __DIOT  (_DCMD_MISC, 0x200734, gpio_capture_t)
+#define VT1211_CAPTURE_STATS  __DIOF  (_DCMD_MISC, 0x200735, gpio_capture_stats_t)
 
 // Errors 
 
@@ -45,6 +73,10 @@
 #define VT1211_ERR_PERM           0x200714
 #define VT1211_ERR_ALREADY        0x200715
 
+// Published state, see gpio_state_t
+
+#define VT1211_STATE_SHM    "/vt1211_state"
+
 #define VT1211_PORT_1       0x00 //GP10...GP17
 #define VT1211_PORT_3       0x01 //GP30...GP37
 #define VT1211_PORT_4       0x02 //GP40...GP47
@@ -66,6 +98,81 @@
 #define VT1211_PIN_INPUT    0x1
 #define VT1211_PIN_OUTPUT   0x0
 
+// read()/write() binding of an open file descriptor (gpio_bind_t.mode)
+
+#define VT1211_BIND_NONE      0x00
+#define VT1211_BIND_PORT      0x01 // bytes are port values
+#define VT1211_BIND_SAMPLER   0x02 // read() returns gpio_sample_t records
+#define VT1211_BIND_PIN       0x03 // set by opening /dev/vt1211/portN/pinM, not by VT1211_BIND
+#define VT1211_BIND_TRACE     0x04 // set by opening /dev/vt1211/trace, not by VT1211_BIND
+#define VT1211_BIND_STATS     0x05 // set by opening /dev/vt1211/stats, not by VT1211_BIND
+#define VT1211_BIND_BUS       0x06 // bytes are bus transfers, set by VT1211_BUS_CONFIG
+#define VT1211_BIND_CAPTURE   0x07 // read() returns gpio_edge_t records, set by VT1211_CAPTURE
+
+// Edges for VT1211_WATCH (gpio_watch_t.edge)
+
+#define VT1211_EDGE_RISING    0x01
+#define VT1211_EDGE_FALLING   0x02
+#define VT1211_EDGE_BOTH      (VT1211_EDGE_RISING | VT1211_EDGE_FALLING)
+
+// Port modify operations (gpio_modify_t.op)
+
+#define VT1211_MODIFY_SET     0x00 // port |= mask
+#define VT1211_MODIFY_CLEAR   0x01 // port &= ~mask
+#define VT1211_MODIFY_TOGGLE  0x02 // port ^= mask
+#define VT1211_MODIFY_ASSIGN  0x03 // port = (port & ~mask) | (value & mask)
+
+// Batch operations (gpio_batch_op_t.op)
+
+#define VT1211_OP_CONFIG_PIN  0x01
+#define VT1211_OP_SET_PIN     0x02
+#define VT1211_OP_GET_PIN     0x03
+#define VT1211_OP_CONFIG_PORT 0x04
+#define VT1211_OP_SET_PORT    0x05
+#define VT1211_OP_GET_PORT    0x06
+
+#define VT1211_BATCH_MAX      256
+
+// Bus master types (gpio_bus_t.type)
+
+#define VT1211_BUS_NONE       0x00
+#define VT1211_BUS_SPI        0x01
+#define VT1211_BUS_I2C        0x02
+
+// Bus flags (gpio_bus_t.flags)
+
+#define VT1211_BUS_CPOL       0x01 // SPI clock idles high
+#define VT1211_BUS_CPHA       0x02 // SPI data is sampled on the trailing clock edge
+#define VT1211_BUS_CS_HIGH    0x04 // SPI chip select is active high
+#define VT1211_BUS_LSB_FIRST  0x08 // SPI bit order
+
+#define VT1211_BUS_MAX        1024 // bytes per transfer
+
+/*
+ * Fire-and-forget output update: MsgSendPulse() on the descriptor with the
+ * code VT1211_PULSE_MODIFY and a VT1211_PULSE_VALUE() value does
+ * VT1211_MODIFY_PORT without a reply. Pins owned by a descriptor of another
+ * process are not touched, such pulses are counted in gpio_stats_t.
+ */
+#define VT1211_PULSE_MODIFY   0x40 // pulse code
+#define VT1211_PULSE_VALUE(op, port, mask, value) \
+  ((int) (((op) & 0xFF) << 24 | ((port) & 0xFF) << 16 | ((mask) & 0xFF) << 8 | ((value) & 0xFF)))
+
+#define VT1211_CAPTURE_DEPTH_MAX  65536 // edges queued per subscriber
+
+#define VT1211_GROUPS_MAX     16
+#define VT1211_GROUP_PINS     32   // members of a group, bits of its value
+#define VT1211_GROUP_NAME     16   // name length with the terminating zero
+
+#define VT1211_PATTERN_MAX    4096 // steps
+#define VT1211_PATTERN_PERIOD 100000 // ns, least sum of the delays of a repeated table
+
+#define VT1211_DEBOUNCE_MAX   7    // filter steps
+#define VT1211_STATS_CMDS     64   // commands in the statistics, indexed by dcmd & 0xFF
+#define VT1211_STATS_BUCKETS  32   // latency histogram buckets
+#define VT1211_STATS_ERRORS   7    // VT1211_ERR_INCRCT_PORT..VT1211_ERR_ALREADY, then any other error
+#define VT1211_STATS_PIDS     32
+
 typedef struct {
   uint8_t count;
   uint8_t pins_by_port[5];
@@ -77,3 +184,403 @@ typedef struct {
   uint8_t data;
 } gpio_data_t;
 
+/*
+ * VT1211_GET_ALL: mask is set to the ports that were read (enabled and not
+ * owned by another process), data[port] holds their values.
+ * VT1211_SET_MULTI: data[port] is written to every port in mask. Nothing is
+ * written unless every port in mask passes the checks.
+ */
+typedef struct {
+  uint8_t mask;
+  uint8_t data[5];
+} gpio_ports_t;
+
+/*
+ * VT1211_MODIFY_PORT: only the pins in mask have to be free or owned by the
+ * caller. value is replaced with the resulting port value.
+ */
+typedef struct {
+  uint8_t port;
+  uint8_t op;
+  uint8_t mask;
+  uint8_t value;
+} gpio_modify_t;
+
+/*
+ * VT1211_CONFIG_MULTI: the pins pins[port] of every port in mask are
+ * configured as dir[port], a set bit is an output. The pins must be valid
+ * pins of the port (gpio_portsinfo_t). Nothing is configured unless every
+ * port passes the checks; all changes are made in one configuration session.
+ */
+typedef struct {
+  uint8_t mask;
+  uint8_t pins[5];
+  uint8_t dir[5];
+} gpio_dirs_t;
+
+/*
+ * VT1211_BUS_CONFIG: a bus master on pins of one port, each of them owned by
+ * the caller (or the whole port is). SPI uses clk, mosi, miso and cs, where
+ * mosi, miso or cs may be 0 if not wired. I2C uses clk as SCL and mosi as
+ * SDA, with pull-ups on both. The pins are set to their idle levels and
+ * directions and the descriptor is bound to the bus: write() sends the bytes
+ * (to addr on I2C), read() receives them (SPI clocks out zeros). A transfer
+ * longer than VT1211_BUS_MAX is cut short. half_period_ns is added between
+ * clock edges, 0 runs at the port access speed. VT1211_BUS_NONE unbinds.
+ */
+typedef struct {
+  uint8_t  type;
+  uint8_t  port;
+  uint8_t  clk;
+  uint8_t  mosi;
+  uint8_t  miso;
+  uint8_t  cs;
+  uint8_t  flags;
+  uint8_t  addr;                      // 7-bit I2C address for read() and write()
+  uint32_t half_period_ns;
+} gpio_bus_t;
+
+typedef struct {
+  uint8_t port;
+  uint8_t pin;
+} gpio_group_member_t;
+
+/*
+ * VT1211_GROUP_DEFINE: a named group of pins, possibly on several ports.
+ * members[i] is bit i of the group value. Defining an existing name
+ * replaces the group, a zero count removes it. id is set in the reply and
+ * is used to read and write the group.
+ * VT1211_GROUP_FIND: id, count and members of the group called name.
+ */
+typedef struct {
+  char                name[VT1211_GROUP_NAME];
+  uint32_t            id;
+  uint8_t             count;
+  gpio_group_member_t members[VT1211_GROUP_PINS];
+} gpio_group_t;
+
+/*
+ * VT1211_GROUP_WRITE: every member pin is set from its bit of value, with one
+ * port write per port, all ports at once. Each pin has to be free or owned
+ * by the caller, otherwise nothing is written.
+ * VT1211_GROUP_READ: value is set to the levels of the member pins.
+ */
+typedef struct {
+  uint32_t id;
+  uint32_t value;
+} gpio_group_value_t;
+
+/*
+ * VT1211_CAPTURE: subscribes the descriptor to the edges of the pins
+ * mask[port] and binds it to the capture queue, read() then takes whole
+ * gpio_edge_t records, as many as are queued. The pins have to be free or
+ * owned by the caller. edge is a VT1211_EDGE_* set, EINVAL if it's empty
+ * with a pin in the masks. period_us is the time between reads of the ports, 0
+ * for the default of 100 us. depth is the queue length in records, rounded
+ * up to a power of 2, 0 for 1024. The descriptor is notified
+ * (_NOTIFY_COND_INPUT) when edges are queued. All zero masks cancel.
+ */
+typedef struct {
+  uint8_t  mask[5];
+  uint8_t  edge;
+  uint32_t period_us;
+  uint32_t depth;
+} gpio_capture_t;
+
+typedef struct {
+  uint64_t timestamp;                 // ClockCycles right after the port read that saw the edge
+  uint8_t  port;
+  uint8_t  pin;                       // pin number
+  uint8_t  edge;                      // VT1211_EDGE_RISING or VT1211_EDGE_FALLING
+  uint8_t  reserved;
+  uint32_t lost;                      // edges dropped right before this one, the queue was full
+} gpio_edge_t;
+
+/*
+ * VT1211_CAPTURE_STATS: queue counters of the descriptor and the measured
+ * time between port reads of the capture thread, the resolution of the
+ * timestamps, in ClockCycles.
+ */
+typedef struct {
+  uint64_t events;                    // edges queued
+  uint64_t overflow;                  // edges dropped
+  uint32_t queued;                    // edges waiting to be read
+  uint32_t depth;
+  uint64_t samples;                   // port reads of the capture thread
+  uint64_t interval_min;
+  uint64_t interval_max;
+  uint64_t interval_avg;
+  uint64_t cycles_per_sec;
+} gpio_capture_stats_t;
+
+/*
+ * VT1211_BUS_XFER on a descriptor with a bus: header followed by wlen + rlen
+ * data bytes, the devctl size is sizeof(gpio_bus_xfer_t) + wlen + rlen.
+ * SPI clocks wlen + rlen bytes under one chip select, the first wlen from
+ * data, then zeros; the received bytes replace data. I2C writes wlen bytes to
+ * addr, then reads rlen bytes into data + wlen after a repeated start. EIO if
+ * the device doesn't acknowledge, EINVAL if addr doesn't fit in 7 bits.
+ */
+typedef struct {
+  uint8_t  addr;                      // 7-bit I2C address
+  uint8_t  reserved;
+  uint16_t wlen;
+  uint16_t rlen;
+  uint8_t  data[];
+} gpio_bus_xfer_t;
+
+typedef struct {
+  uint8_t mode;
+  uint8_t port;
+} gpio_bind_t;
+
+/*
+ * VT1211_WATCH: subscribes the file descriptor to edges on the pins in mask.
+ * When a watched edge occurs the event armed with ionotify(_NOTIFY_COND_INPUT)
+ * is delivered. period_us is the longest acceptable detection delay, 0 for
+ * the default of 1 ms. A zero mask cancels the subscription.
+ */
+typedef struct {
+  uint8_t  port;
+  uint8_t  mask;
+  uint8_t  edge;
+  uint32_t period_us;
+} gpio_watch_t;
+
+/*
+ * VT1211_WATCH_EVENTS: edges seen since the previous call and the last
+ * scanned port value.
+ */
+typedef struct {
+  uint8_t port;
+  uint8_t rising;
+  uint8_t falling;
+  uint8_t value;
+} gpio_events_t;
+
+typedef struct {
+  uint8_t op;
+  uint8_t port;
+  uint8_t pin;
+  uint8_t data;
+  int32_t result;
+} gpio_batch_op_t;
+
+/*
+ * VT1211_BATCH: header followed by count operations. The devctl size is
+ * sizeof(gpio_batch_t) + count * sizeof(gpio_batch_op_t). All operations are
+ * checked before any of them is executed. If any check fails nothing is
+ * executed, done is 0 and result holds the error of the failed entries.
+ * Otherwise done == count and GET_* entries hold the read back data.
+ */
+typedef struct {
+  uint32_t        count;
+  uint32_t        done;
+  gpio_batch_op_t ops[];
+} gpio_batch_t;
+
+/*
+ * Sampler record. timestamp is ClockCycles() at the moment of the sample.
+ */
+typedef struct {
+  uint64_t timestamp;
+  uint8_t  port;
+  uint8_t  value;
+  uint8_t  reserved[6];
+} gpio_sample_t;
+
+/*
+ * VT1211_SAMPLER_READ: count is the capacity of samples on input and the
+ * number of returned records on output. overflow is the number of records
+ * lost by this client since its previous read because it fell behind the
+ * sampler. The devctl size is sizeof(gpio_samples_t) + count * sizeof(gpio_sample_t).
+ */
+typedef struct {
+  uint32_t      count;
+  uint32_t      overflow;
+  gpio_sample_t samples[];
+} gpio_samples_t;
+
+/*
+ * Driver state published read-only in the VT1211_STATE_SHM shared memory
+ * object (/dev/shmem/vt1211_state). The driver updates it on its own writes,
+ * mode and ownership changes, and, if started with -u, refreshes the inputs
+ * periodically. Every port has its own seqlock, so the updates of different
+ * ports don't contend: seq is odd while an update of the port is in progress,
+ * generation is incremented by every update of the port. A port entry has a
+ * cache line of its own. Use vt1211_port_state_read() for a consistent copy
+ * of a port, vt1211_state_read() copies every port that way.
+ */
+typedef struct {
+  uint32_t seq;
+  uint32_t generation;
+  uint8_t  input;                   // port value of the last hardware read
+  uint8_t  latch;                   // output latch
+  uint8_t  dir;                     // output pins, valid for dir_known pins
+  uint8_t  dir_known;
+  uint8_t  busy;                    // the port is requested
+  uint8_t  pins_busy;               // requested pins mask
+  uint8_t  reserved[2];
+  pid_t    port_pid;
+  pid_t    pins_pid[8];
+} __attribute__((aligned(64))) gpio_port_state_t;
+
+typedef struct {
+  uint8_t           count;          // enabled ports
+  gpio_port_state_t ports[5];
+} gpio_state_t;
+
+static inline void vt1211_port_state_read(const gpio_port_state_t *shm, gpio_port_state_t *state) {
+  uint32_t seq;
+
+  do {
+    while ((seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE)) & 1)
+      ;
+
+    *state = *shm;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) != seq);
+}
+
+static inline void vt1211_state_read(const gpio_state_t *shm, gpio_state_t *state) {
+  state->count = shm->count;
+
+  for (int port = 0; port < 5; ++port) {
+    vt1211_port_state_read(&shm->ports[port], &state->ports[port]);
+  }
+}
+
+/*
+ * Pattern step: the pins in mask are set to value, then the player waits
+ * delay_ns before the next step.
+ */
+typedef struct {
+  uint8_t  mask;
+  uint8_t  value;
+  uint8_t  reserved[2];
+  uint32_t delay_ns;
+} gpio_pattern_step_t;
+
+/*
+ * VT1211_PLAY_PATTERN: count steps played on port, repeat times (0 - until
+ * VT1211_PATTERN_STOP). The devctl size is
+ * sizeof(gpio_pattern_t) + count * sizeof(gpio_pattern_step_t).
+ * Ownership of the pins is checked when the pattern is started, pins taken
+ * by another descriptor later are left out of the steps from then on. A table
+ * played more than once must last at least VT1211_PATTERN_PERIOD.
+ * Only the descriptor that started the run can stop it, closing it stops the
+ * run.
+ */
+typedef struct {
+  uint8_t             port;
+  uint8_t             reserved[3];
+  uint32_t            repeat;
+  uint32_t            count;
+  gpio_pattern_step_t steps[];
+} gpio_pattern_t;
+
+/*
+ * VT1211_PATTERN_STATUS: state of the current or the last run. requested_ns
+ * is the scheduled time of the last played step from the start of the run,
+ * elapsed_ns is when it was actually written. late_ns is the lateness of a
+ * step against its schedule.
+ */
+typedef struct {
+  uint8_t  running;
+  uint8_t  port;
+  uint8_t  reserved[2];
+  uint32_t loop;
+  uint32_t step;
+  uint32_t max_late_ns;
+  uint64_t steps;
+  uint64_t total_late_ns;
+  uint64_t requested_ns;
+  uint64_t elapsed_ns;
+} gpio_pattern_status_t;
+
+/*
+ * VT1211_PWM_CONFIG: software PWM on a pin (configured as output by the
+ * client). A new setting of a running channel takes effect at its next
+ * period boundary. period_us 0 stops the channel, the pin is left low.
+ * Freeing the pin or the port, or closing the descriptor, stops the channel
+ * at once and leaves the pin at its level. So does another descriptor
+ * requesting the pin or the port.
+ */
+typedef struct {
+  uint8_t  port;
+  uint8_t  pin;
+  uint8_t  reserved[2];
+  uint32_t period_us;
+  uint32_t duty_us;
+} gpio_pwm_t;
+
+/*
+ * VT1211_DEBOUNCE: a debounced pin takes a new value only after reading it
+ * count filter steps in a row (one step per -b period, 1 ms by default).
+ * GET_PIN, GET_PORT and VT1211_WATCH see the filtered value. count 0 turns
+ * the filter off for the pins in mask.
+ */
+typedef struct {
+  uint8_t port;
+  uint8_t mask;
+  uint8_t count;
+} gpio_debounce_t;
+
+/*
+ * VT1211_TRACE: turns the request trace on (enable 1) or off (enable 0).
+ * The trace is read from /dev/vt1211/trace as gpio_trace_t records, see
+ * vt1211_tracedump.
+ */
+typedef struct {
+  uint8_t enable;
+} gpio_trace_ctl_t;
+
+/*
+ * Trace record. Every thread of the driver has its own ring, so the records
+ * of a thread are in order and the decoder sorts them by timestamp. port,
+ * pin and data are 0xFF when the request has none. dcmd 0 marks records lost
+ * to an overrun of the ring of thread, result is their number.
+ */
+typedef struct {
+  uint64_t timestamp;   // CLOCK_MONOTONIC, ns
+  uint32_t dcmd;
+  int32_t  pid;
+  uint8_t  port;
+  uint8_t  pin;         // pin or mask
+  uint8_t  data;        // data or value of the request after the handler
+  uint8_t  thread;      // ring index
+  int32_t  result;      // EOK or error code
+} gpio_trace_t;
+
+/*
+ * VT1211_GET_STATS: the counters of the command cmd (dcmd & 0xFF) and the
+ * counters shared by all the commands. Bucket n of the latency histogram
+ * counts requests that took [2^n, 2^(n+1)) ClockCycles, the last bucket
+ * also the longer ones. hw_calls are the backend (vt1211_gpio) calls made
+ * by the requests. pids are the first clients seen since the reset with
+ * their request counts (count 0 ends the list), other_pids counts the
+ * requests of the rest. The same is readable as text from /dev/vt1211/stats.
+ */
+typedef struct {
+  int32_t  pid;
+  uint32_t reserved;
+  uint64_t count;
+} gpio_stats_pid_t;
+
+typedef struct {
+  uint8_t           cmd;
+  uint8_t           reserved[7];
+  uint64_t          count;
+  uint64_t          errors;
+  uint64_t          hw_calls;
+  uint64_t          cycles;                           // total latency
+  uint64_t          cycles_per_sec;
+  uint32_t          latency[VT1211_STATS_BUCKETS];
+  uint64_t          error_codes[VT1211_STATS_ERRORS];   // all the commands
+  uint64_t          other_pids;
+  gpio_stats_pid_t  pids[VT1211_STATS_PIDS];
+  uint64_t          pulses;                           // VT1211_PULSE_MODIFY pulses applied
+  uint64_t          pulses_rejected;                  // ... dropped, pins owned by another process
+  uint64_t          pulses_invalid;                   // ... dropped, incorrect port, pins or operation
+} gpio_stats_t;
@@ -0,0 +1,407 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Input scanner: edge change notification and debouncing.
+ *
+ * Subscribers (OCBs) are kept in a list walked by one scanner thread. Every
+ * tick the scanner reads each port that has at least one subscriber or a
+ * debounced pin once, works out the edges against the previous scan and
+ * triggers the notify lists of the subscribers whose pins changed. Ports
+ * nobody watches are not read, and the tick is the shortest period asked for
+ * by a subscriber (or the debounce period). With nothing to scan the scanner
+ * sleeps until a subscriber arrives.
+ *
+ * The debounce filter works on all the ports at once: pin N of port P is bit
+ * 8 * P + N of a 64 bit word, and the per-pin counters and integration counts
+ * are bit-sliced into three words each (one word per counter bit). A filter
+ * step is a handful of word operations whatever the number of pins. A pin
+ * takes a new value after it has read that value count steps in a row.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "vt1211_nto.h"
+
+#define VT1211_WATCH_PERIOD_US  1000
+#define VT1211_WATCH_PRIO       40
+
+static pthread_mutex_t  watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   watch_cond;
+static vt1211_ocb_t     *watch_list;
+static uint32_t         watch_gen;          // bumped when the subscribers change
+static uint8_t          watch_value[VT1211_PORTS_MAX]; // port values of the last scan
+
+static uint64_t         debounce_enable;    // debounced pins
+static uint64_t         debounce_count[3];  // integration counts, bit-sliced
+static uint64_t         debounce_counter[3];
+static uint64_t         debounce_stable;    // filtered values
+static uint64_t         debounce_next;      // time of the next filter step, ns
+static void timespec_add_ns(struct timespec *ts, uint64_t ns) {
+  ns          += ts->tv_nsec;
+  ts->tv_sec  += ns / 1000000000;
+  ts->tv_nsec  = ns % 1000000000;
+}
+
+static uint8_t vt1211_debounce_ports(void) {
+  uint8_t ports = 0;
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((debounce_enable >> (8 * port)) & 0xFF)
+      ports |= 1 << port;
+  }
+
+  return ports;
+}
+
+/*
+ * One filter step over the raw values of all the ports
+ */
+static void vt1211_debounce_step(uint64_t raw) {
+  uint64_t delta  = (raw ^ debounce_stable) & debounce_enable;
+  uint64_t carry  = delta;
+  uint64_t *c     = debounce_counter;
+  uint64_t *t     = debounce_count;
+
+  // Counters of the pins that read the stable value start over, the others count up
+  for (int i = 0; i < 3; ++i) {
+    c[i]  &= delta;
+    c[i]  ^= carry;
+    carry &= ~c[i];
+  }
+
+  uint64_t done = ~((c[0] ^ t[0]) | (c[1] ^ t[1]) | (c[2] ^ t[2])) & delta;
+
+  for (int i = 0; i < 3; ++i) {
+    c[i] &= ~done;
+  }
+
+  __atomic_store_n(&debounce_stable, debounce_stable ^ done, __ATOMIC_RELEASE);
+}
+
+static uint8_t vt1211_watch_ports(void) {
+  uint8_t ports = vt1211_debounce_ports();
+
+  for (vt1211_ocb_t *ocb = watch_list; ocb != NULL; ocb = ocb->watch_next) {
+    ports |= 1 << ocb->watch.port;
+  }
+
+  return ports;
+}
+
+static void vt1211_watch_scan(uint8_t ports, const uint8_t *raw) {
+  uint8_t   rising[VT1211_PORTS_MAX];
+  uint8_t   falling[VT1211_PORTS_MAX];
+  uint64_t  now = vt1211_now();
+
+  if (debounce_enable != 0 && now >= debounce_next) {
+    uint64_t packed = 0;
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (ports & (1 << port))
+        packed |= (uint64_t) raw[port] << (8 * port);
+    }
+
+    vt1211_debounce_step(packed);
+
+    debounce_next += params.debounce_us * 1000ULL;
+
+    if (debounce_next < now)
+      debounce_next = now + params.debounce_us * 1000ULL;
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (!(ports & (1 << port)))
+      continue;
+
+    uint8_t value = vt1211_debounce_merge(port, raw[port]);
+
+    rising[port]      = value & ~watch_value[port];
+    falling[port]     = ~value & watch_value[port];
+    watch_value[port] = value;
+  }
+
+  for (vt1211_ocb_t *ocb = watch_list; ocb != NULL; ocb = ocb->watch_next) {
+    uint8_t port  = ocb->watch.port;
+    uint8_t r     = (ocb->watch.edge & VT1211_EDGE_RISING)  ? rising[port]  & ocb->watch.mask : 0;
+    uint8_t f     = (ocb->watch.edge & VT1211_EDGE_FALLING) ? falling[port] & ocb->watch.mask : 0;
+
+    ocb->events.value = watch_value[port];
+
+    if (r | f) {
+      ocb->events.rising  |= r;
+      ocb->events.falling |= f;
+
+      iofunc_notify_trigger(ocb->notify, 1, IOFUNC_NOTIFY_INPUT);
+    }
+  }
+}
+
+/*
+ * Tick of the scanner: the shortest period of the subscribers and of the
+ * debounce filter
+ */
+static uint32_t vt1211_watch_period(void) {
+  uint32_t period = UINT32_MAX;
+
+  for (vt1211_ocb_t *ocb = watch_list; ocb != NULL; ocb = ocb->watch_next) {
+    if (ocb->watch.period_us < period)
+      period = ocb->watch.period_us;
+  }
+
+  if (debounce_enable != 0 && params.debounce_us < period)
+    period = params.debounce_us;
+
+  return period;
+}
+
+static void *vt1211_watch_thread(void *arg) {
+  struct timespec last;     // deadline of the last scan
+  struct timespec next;
+  uint32_t        gen     = watch_gen - 1;
+  uint32_t        period  = 0;
+
+  pthread_mutex_lock(&watch_lock);
+  clock_gettime(CLOCK_MONOTONIC, &last);
+
+  while (1) {
+    if (vt1211_watch_ports() == 0) {
+      pthread_cond_wait(&watch_cond, &watch_lock);
+      clock_gettime(CLOCK_MONOTONIC, &last);
+      gen = watch_gen - 1;
+      continue;
+    }
+
+    // Subscribers changed, the new tick counts from the last scan
+    if (gen != watch_gen) {
+      gen     = watch_gen;
+      period  = vt1211_watch_period();
+      next    = last;
+      timespec_add_ns(&next, period * 1000ULL);
+    }
+
+    // Any other wakeup waits again for the same deadline
+    if (pthread_cond_timedwait(&watch_cond, &watch_lock, &next) != ETIMEDOUT)
+      continue;
+
+    last = next;
+    timespec_add_ns(&next, period * 1000ULL);
+
+    uint8_t ports = vt1211_watch_ports();
+    uint8_t raw[VT1211_PORTS_MAX];
+
+    // The port locks are taken before watch_lock elsewhere
+    pthread_mutex_unlock(&watch_lock);
+    vt1211_ports_sample(ports, raw, NULL);
+    pthread_mutex_lock(&watch_lock);
+
+    // A port subscribed meanwhile starts from its own first read
+    vt1211_watch_scan(ports & vt1211_watch_ports(), raw);
+  }
+
+  return NULL;
+}
+
+int vt1211_watch_start(void) {
+  pthread_condattr_t  cond_attr;
+  pthread_attr_t      attr;
+  struct sched_param  param;
+  pthread_t           thread;
+
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&watch_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  param.sched_priority = VT1211_WATCH_PRIO;
+  pthread_attr_setschedparam(&attr, &param);
+
+  int rc = pthread_create(&thread, &attr, vt1211_watch_thread, NULL);
+
+  pthread_attr_destroy(&attr);
+
+  return rc;
+}
+
+static void vt1211_watch_unlink(vt1211_ocb_t *ocb) {
+  for (vt1211_ocb_t **p = &watch_list; *p != NULL; p = &(*p)->watch_next) {
+    if (*p == ocb) {
+      *p = ocb->watch_next;
+      break;
+    }
+  }
+
+  ocb->watch_next = NULL;
+  ocb->watch.mask = 0;
+  ++watch_gen;
+}
+
+/*
+ * Subscribes the OCB to the edges described by watch or cancels the
+ * subscription if the mask is empty. The port and pins are already checked.
+ */
+int vt1211_watch(vt1211_ocb_t *ocb, gpio_watch_t *watch) {
+  pthread_mutex_lock(&watch_lock);
+
+  if (ocb->watch.mask != 0)
+    vt1211_watch_unlink(ocb);
+
+  if (watch->mask != 0) {
+    // A port nobody watched has no previous value yet
+    if (!(vt1211_watch_ports() & (1 << watch->port)))
+      watch_value[watch->port] = vt1211_debounce_merge(watch->port, vt1211_hw_port_read(watch->port));
+
+    ocb->watch = *watch;
+
+    if (ocb->watch.period_us == 0)
+      ocb->watch.period_us = VT1211_WATCH_PERIOD_US;
+
+    memset(&ocb->events, 0, sizeof(ocb->events));
+    ocb->events.port  = watch->port;
+    ocb->events.value = watch_value[watch->port];
+
+    ocb->watch_next = watch_list;
+    watch_list      = ocb;
+    ++watch_gen;
+  }
+
+  pthread_cond_signal(&watch_cond);
+  pthread_mutex_unlock(&watch_lock);
+
+  return EOK;
+}
+
+/*
+ * Replaces the debounced pins of a raw port value with their filtered values
+ */
+uint8_t vt1211_debounce_merge(uint8_t port, uint8_t raw) {
+  uint8_t enable  = __atomic_load_n(&debounce_enable, __ATOMIC_ACQUIRE) >> (8 * port);
+  uint8_t stable  = __atomic_load_n(&debounce_stable, __ATOMIC_ACQUIRE) >> (8 * port);
+
+  return (raw & ~enable) | (stable & enable);
+}
+
+uint8_t vt1211_debounce_pins(uint8_t port) {
+  return __atomic_load_n(&debounce_enable, __ATOMIC_ACQUIRE) >> (8 * port);
+}
+
+/*
+ * VT1211_DEBOUNCE. The port and pins are already checked.
+ */
+int vt1211_debounce(gpio_debounce_t *debounce) {
+  uint64_t mask   = (uint64_t) debounce->mask << (8 * debounce->port);
+  uint8_t  ports;
+
+  if (debounce->count > VT1211_DEBOUNCE_MAX)
+    return EINVAL;
+
+  pthread_mutex_lock(&watch_lock);
+
+  ports = vt1211_watch_ports();
+
+  for (int i = 0; i < 3; ++i) {
+    debounce_counter[i] &= ~mask;
+
+    if (debounce->count & (1 << i)) {
+      debounce_count[i] |= mask;
+    } else {
+      debounce_count[i] &= ~mask;
+    }
+  }
+
+  if (debounce->count == 0) {
+    __atomic_store_n(&debounce_enable, debounce_enable & ~mask, __ATOMIC_RELEASE);
+  } else {
+    // Newly debounced pins start from their current value
+    uint64_t added  = mask & ~debounce_enable;
+    uint64_t raw    = (uint64_t) vt1211_hw_port_read(debounce->port) << (8 * debounce->port);
+
+    __atomic_store_n(&debounce_stable, (debounce_stable & ~added) | (raw & added), __ATOMIC_RELEASE);
+    __atomic_store_n(&debounce_enable, debounce_enable | mask, __ATOMIC_RELEASE);
+
+    if (!(ports & (1 << debounce->port)))
+      watch_value[debounce->port] = vt1211_debounce_merge(debounce->port, raw >> (8 * debounce->port));
+
+    debounce_next = vt1211_now();
+  }
+
+  ++watch_gen;
+  pthread_cond_signal(&watch_cond);
+  pthread_mutex_unlock(&watch_lock);
+
+  return EOK;
+}
+
+void vt1211_watch_events(vt1211_ocb_t *ocb, gpio_events_t *events) {
+  pthread_mutex_lock(&watch_lock);
+
+  *events = ocb->events;
+
+  ocb->events.rising  = 0;
+  ocb->events.falling = 0;
+
+  pthread_mutex_unlock(&watch_lock);
+}
+
+void vt1211_watch_remove(vt1211_ocb_t *ocb) {
+  pthread_mutex_lock(&watch_lock);
+
+  if (ocb->watch.mask != 0)
+    vt1211_watch_unlink(ocb);
+
+  pthread_mutex_unlock(&watch_lock);
+}
+
+/*
+ * Input notification of the OCB from outside the scanner (edge capture).
+ * Taking watch_lock orders it with the check in io_notify.
+ */
+void vt1211_watch_trigger(vt1211_ocb_t *ocb) {
+  pthread_mutex_lock(&watch_lock);
+  iofunc_notify_trigger(ocb->notify, 1, IOFUNC_NOTIFY_INPUT);
+  pthread_mutex_unlock(&watch_lock);
+}
+
+int io_notify(resmgr_context_t *ctp, io_notify_t *msg, RESMGR_OCB_T *ocb) {
+  int trig = 0;
+  int rc;
+
+  pthread_mutex_lock(&watch_lock);
+
+  if ((ocb->events.rising | ocb->events.falling) || vt1211_capture_pending(ocb))
+    trig |= _NOTIFY_COND_INPUT;
+
+  rc = iofunc_notify(ctp, msg, ocb->notify, trig, NULL, NULL);
+
+  pthread_mutex_unlock(&watch_lock);
+
+  return rc;
+}
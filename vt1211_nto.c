@@ -27,448 +27,1827 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <devctl.h>
 #include <string.h>
-#include <sys/iofunc.h>
-#include <sys/dispatch.h>
-#include "vt1211_ipc.h"
-#include "vt1211_gpio/src/vt1211_gpio.h"
-#include "libds/src/hashmap.h"
+#include <sys/neutrino.h>
+#include "vt1211_nto.h"
 
-typedef struct {
-  uint16_t cir;
-  uint16_t cdr;
-  uint8_t  ports36;
-  uint8_t  verbose;
-} params_t;
+params_t                          params;
+gpio_port_status_t                ports_status[VT1211_PORTS_MAX];
+gpio_portsinfo_t                  ports_info;
+
+static const char*                params_str = "i:d:pvsf:m:u:t:b:l:S:Tc:";
+static resmgr_connect_funcs_t     connect_funcs;
+static resmgr_io_funcs_t          io_funcs;
+static vt1211_attr_t              attr;
+static vt1211_attr_t              nodes[VT1211_PORTS_MAX * (VT1211_PINS_MAX + 1)];
+static vt1211_attr_t              trace_node;
+static vt1211_attr_t              stats_node;
+static iofunc_mount_t             mount;
+static iofunc_funcs_t             ocb_funcs;
+static pthread_mutex_t            cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static vt1211_ocb_t               reserved;           // owner of the pins reserved by the configuration file
+
+void vt1211_debugf(const char *format, ... ) {
+  va_list args;
+  va_start (args, format);
+  vprintf(format, args);
+  va_end (args);
+}
+
+/*
+ * Returns the status of the port or NULL if the port is not enabled
+ */
+static inline gpio_port_status_t *vt1211_port_status(uint8_t port) {
+  if (port >= ports_info.count)
+    return NULL;
+
+  return &ports_status[port];
+}
+
+/*
+ * Returns the pin number (0..7) for the pin mask or -1 if the mask is not
+ * a single valid pin of the port
+ */
+static inline int vt1211_pin_index(gpio_port_status_t *port_status, uint8_t pin) {
+  if (pin == 0 || (pin & (pin - 1)) != 0 || (pin & port_status->pins) == 0)
+    return -1;
+
+  return __builtin_ctz(pin);
+}
+
+/*
+ * Ownership. The owner of a pin or a port is the OCB (open file descriptor)
+ * that requested it, and every OCB keeps an index of what it holds. All of
+ * it is released in io_close_ocb in O(held), so a client that dies can't
+ * leave pins busy. With a lease (-l) the ownership also ends when the owner
+ * sends no request for the lease time. It is taken away lazily, when
+ * somebody else runs into it. Everything here is done with the port locked.
+ */
+static void vt1211_pin_release(uint8_t port, int pin_index) {
+  gpio_port_status_t *port_status = &ports_status[port];
+  vt1211_ocb_t       *owner       = port_status->pins_owner[pin_index];
+
+  // A channel on a pin still covered by the port keeps running
+  if (!owner->held_port[port])
+    vt1211_pwm_release(owner, port, 1 << pin_index);
+
+  owner->held_pins[port] &= ~(1 << pin_index);
+  port_status->pins_owner[pin_index] = NULL;
+  port_status->pins_busy &= ~(1 << pin_index);
+
+  vt1211_shm_publish(port);
+}
+
+static void vt1211_port_release(uint8_t port) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  vt1211_pwm_release(port_status->owner, port, ~port_status->owner->held_pins[port]);
+
+  port_status->owner->held_port[port] = false;
+  port_status->owner  = NULL;
+  port_status->busy   = false;
+
+  vt1211_shm_publish(port);
+}
+
+static void vt1211_pin_take(uint8_t port, int pin_index, vt1211_ocb_t *ocb, pid_t pid) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  port_status->pins_busy |= 1 << pin_index;
+  port_status->pins_owner[pin_index]  = ocb;
+  port_status->pins_pid[pin_index]    = pid;
+  ocb->held_pins[port] |= 1 << pin_index;
+
+  vt1211_pwm_take(ocb, port, 1 << pin_index);
+  vt1211_pattern_take(ocb, port, 1 << pin_index);
+  vt1211_shm_publish(port);
+}
+
+static void vt1211_port_take(uint8_t port, vt1211_ocb_t *ocb, pid_t pid) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  port_status->busy   = true;
+  port_status->owner  = ocb;
+  port_status->pid    = pid;
+  ocb->held_port[port] = true;
+
+  vt1211_pwm_take(ocb, port, 0xFF);
+  vt1211_pattern_take(ocb, port, 0xFF);
+  vt1211_shm_publish(port);
+}
+
+static inline bool vt1211_expired(vt1211_ocb_t *owner) {
+  return params.lease_ms != 0 && vt1211_now() > __atomic_load_n(&owner->lease, __ATOMIC_RELAXED);
+}
+
+static inline void vt1211_renew(vt1211_ocb_t *ocb) {
+  if (params.lease_ms != 0)
+    __atomic_store_n(&ocb->lease, vt1211_now() + params.lease_ms * 1000000ULL, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns true if the pin is owned by another descriptor
+ */
+static bool vt1211_pin_foreign(uint8_t port, int pin_index, vt1211_ocb_t *ocb) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  if (!(port_status->pins_busy & (1 << pin_index)) || port_status->pins_owner[pin_index] == ocb)
+    return false;
+
+  if (vt1211_expired(port_status->pins_owner[pin_index])) {
+    debugf("(lease of pid %d expired) ", port_status->pins_pid[pin_index]);
+    vt1211_pin_release(port, pin_index);
+    return false;
+  }
 
+  return true;
+}
+
+/*
+ * Returns true if the port is owned by another descriptor
+ */
+static bool vt1211_port_foreign(uint8_t port, vt1211_ocb_t *ocb) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  if (!port_status->busy || port_status->owner == ocb)
+    return false;
+
+  if (vt1211_expired(port_status->owner)) {
+    debugf("(lease of pid %d expired) ", port_status->pid);
+    vt1211_port_release(port);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * REQ_PIN for a valid pin. Returns EOK or VT1211_ERR_* code.
+ */
+static int vt1211_pin_request(vt1211_ocb_t *ocb, uint8_t port, int pin_index, pid_t pid) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  vt1211_port_foreign(port, ocb);
+
+  if (port_status->busy) {
+    debugf("Port is busy\n");
+    return VT1211_ERR_PORT_BUSY;
+  }
+
+  vt1211_pin_foreign(port, pin_index, ocb);
+
+  if (port_status->pins_busy & (1 << pin_index)) {
+    debugf("Pin is busy\n");
+    return VT1211_ERR_PIN_BUSY;
+  }
+
+  vt1211_pin_take(port, pin_index, ocb, pid);
+  return EOK;
+}
+
+/*
+ * REQ_PORT for a valid port. Returns EOK or VT1211_ERR_* code.
+ */
+static int vt1211_port_request(vt1211_ocb_t *ocb, uint8_t port, pid_t pid) {
+  vt1211_port_foreign(port, ocb);
+
+  if (ports_status[port].busy) {
+    debugf("Busy\n");
+    return VT1211_ERR_PORT_BUSY;
+  }
+
+  vt1211_port_take(port, ocb, pid);
+  return EOK;
+}
+
+/*
+ * Gives the pins, or the whole port if pins is 0, to the driver itself. The
+ * owner never closes, its lease never runs out and it has no connection.
+ */
+void vt1211_reserve(uint8_t port, uint8_t pins) {
+  reserved.lease = UINT64_MAX;
+  reserved.scoid = -1;
+
+  vt1211_lock(1 << port);
+
+  if (pins == 0)
+    vt1211_port_take(port, &reserved, getpid());
+
+  for (; pins; pins &= pins - 1) {
+    vt1211_pin_take(port, __builtin_ctz(pins), &reserved, getpid());
+  }
+
+  vt1211_unlock(1 << port);
+}
+
+/*
+ * Releases everything the descriptor holds
+ */
+void vt1211_release(vt1211_ocb_t *ocb) {
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (ocb->held_pins[port] == 0 && !ocb->held_port[port])
+      continue;
+
+    vt1211_lock(1 << port);
+
+    for (uint8_t held = ocb->held_pins[port]; held; held &= held - 1) {
+      vt1211_pin_release(port, __builtin_ctz(held));
+    }
+
+    if (ocb->held_port[port])
+      vt1211_port_release(port);
+
+    vt1211_unlock(1 << port);
+  }
+}
+
+/*
+ * All the checks for a single request in one pass over the port table.
+ * Returns EOK or VT1211_ERR_* code.
+ */
+int vt1211_check(vt1211_ocb_t *ocb, uint8_t port, uint8_t pin, int flags) {
+  gpio_port_status_t *port_status = vt1211_port_status(port);
+
+  if (port_status == NULL) {
+    debugf("Incorrect port\n");
+    return VT1211_ERR_INCRCT_PORT;
+  }
+
+  if (flags & (VT1211_CHECK_PIN | VT1211_CHECK_PIN_PERM)) {
+    int pin_index = vt1211_pin_index(port_status, pin);
+
+    if (pin_index < 0) {
+      debugf("Incorrect pin\n");
+      return VT1211_ERR_INCRCT_PIN;
+    }
+
+    if ((flags & VT1211_CHECK_PIN_PERM) && vt1211_pin_foreign(port, pin_index, ocb)) {
+      debugf("Pin is owned by pid %d\n", port_status->pins_pid[pin_index]);
+      return VT1211_ERR_PERM;
+    }
+  }
+
+  if (flags & VT1211_CHECK_MASK_PERM) {
+    if (pin & ~port_status->pins) {
+      debugf("Incorrect pin\n");
+      return VT1211_ERR_INCRCT_PIN;
+    }
+
+    for (uint8_t busy = port_status->pins_busy & pin; busy; busy &= busy - 1) {
+      int pin_index = __builtin_ctz(busy);
+
+      if (vt1211_pin_foreign(port, pin_index, ocb)) {
+        debugf("Pin is owned by pid %d\n", port_status->pins_pid[pin_index]);
+        return VT1211_ERR_PERM;
+      }
+    }
+  }
+
+  if ((flags & VT1211_CHECK_PORT_PERM) && vt1211_port_foreign(port, ocb)) {
+    debugf("Port is owned by pid %d\n", port_status->pid);
+    return VT1211_ERR_PERM;
+  }
+
+  return EOK;
+}
+
+/*
+ * Locks the ports in the mask in ascending order
+ */
+void vt1211_lock(uint8_t ports) {
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (ports & (1 << port))
+      pthread_mutex_lock(&ports_status[port].lock);
+  }
+}
+
+void vt1211_unlock(uint8_t ports) {
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (ports & (1 << port))
+      pthread_mutex_unlock(&ports_status[port].lock);
+  }
+}
+
+/*
+ * Port I/O with the shadow register cache. The driver keeps a copy of the
+ * output latch and of the directions it has configured, so pin writes are a
+ * masked update of the shadow plus a single port write and reads of output
+ * pins do not touch the hardware. The directions are not readable through
+ * vt1211_gpio, so only pins configured through the driver are cached.
+ *
+ * The callers hold the port lock. Mode changes also take cfg_lock, as they go
+ * through the CIR/CDR pair shared by all ports.
+ */
+static uint8_t vt1211_latch(uint8_t port) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  if (!port_status->latch_valid) {
+    port_status->latch        = vt1211_hw_port_read(port);
+    port_status->latch_valid  = true;
+
+    vt1211_shm_latch(port, port_status->latch);
+  }
+
+  return port_status->latch;
+}
+
+static void vt1211_resync(uint8_t port) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  port_status->dir_known    = 0;
+  port_status->latch_valid  = false;
+
+  vt1211_latch(port);
+  vt1211_shm_input(port, port_status->latch);
+}
+
+/*
+ * Direction changes queued for one configuration session: the pins mask[port]
+ * of the ports in the ports mask get the directions dir[port], a set bit is
+ * an output. The callers hold the locks of the queued ports.
+ */
 typedef struct {
-  bool  busy;
-  pid_t pid;
-} gpio_pin_status_t;
+  uint8_t ports;
+  uint8_t mask[VT1211_PORTS_MAX];
+  uint8_t dir[VT1211_PORTS_MAX];
+} vt1211_dirs_t;
+
+static void vt1211_dirs_queue(vt1211_dirs_t *dirs, uint8_t port, uint8_t mask, uint8_t dir) {
+  dirs->mask[port] |= mask;
+  dirs->dir[port]   = (dirs->dir[port] & ~mask) | (dir & mask);
+  dirs->ports      |= 1 << port;
+}
+
+/*
+ * Applies the queued changes with a single enter/select/exit sequence and
+ * empties the queue. Pins already configured the requested way are not
+ * rewritten, a port of 8 pins with every direction known is written whole.
+ */
+static void vt1211_dirs_apply(vt1211_dirs_t *dirs) {
+  uint8_t ports = 0;
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    gpio_port_status_t  *port_status  = &ports_status[port];
+    uint8_t             mask          = dirs->mask[port] & port_status->pins;
+
+    if (!(dirs->ports & (1 << port)))
+      continue;
+
+    if (!params.nocache)
+      mask &= ~port_status->dir_known | (port_status->dir ^ dirs->dir[port]);
+
+    if (mask == 0)
+      continue;
+
+    port_status->dir        = (port_status->dir & ~mask) | (dirs->dir[port] & mask);
+    port_status->dir_known |= mask;
+
+    // Written whole only when every bit of the register is a pin of the port
+    if (port_status->pins == 0xFF && port_status->dir_known == 0xFF) {
+      dirs->mask[port]  = 0xFF;
+      dirs->dir[port]   = port_status->dir;
+    } else {
+      dirs->mask[port]  = mask;
+    }
+
+    ports |= 1 << port;
+  }
+
+  if (ports) {
+    pthread_mutex_lock(&cfg_lock);
+    vt1211_hw_ports_dir(ports, dirs->mask, dirs->dir);
+    pthread_mutex_unlock(&cfg_lock);
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (ports & (1 << port))
+        vt1211_shm_publish(port);
+    }
+  }
+
+  memset(dirs, 0, sizeof(vt1211_dirs_t));
+}
+
+static void vt1211_pin_mode(uint8_t port, uint8_t pin, uint8_t mode) {
+  vt1211_dirs_t dirs = { 0 };
+
+  vt1211_dirs_queue(&dirs, port, pin, mode == VT1211_PIN_INPUT ? 0x00 : 0xFF);
+  vt1211_dirs_apply(&dirs);
+}
+
+static void vt1211_port_mode(uint8_t port, uint8_t mode) {
+  vt1211_dirs_t dirs = { 0 };
+
+  vt1211_dirs_queue(&dirs, port, 0xFF, mode);
+  vt1211_dirs_apply(&dirs);
+}
+
+/*
+ * Directions of the pins in the mask, a set bit of dir is an output
+ */
+void vt1211_port_dir(uint8_t port, uint8_t mask, uint8_t dir) {
+  vt1211_dirs_t dirs = { 0 };
+
+  vt1211_dirs_queue(&dirs, port, mask, dir);
+  vt1211_dirs_apply(&dirs);
+}
+
+/*
+ * Directions of the pins mask[port] of the ports in the mask, in one session
+ */
+void vt1211_ports_dir(uint8_t ports, const uint8_t *mask, const uint8_t *dir) {
+  vt1211_dirs_t dirs = { 0 };
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (ports & (1 << port))
+      vt1211_dirs_queue(&dirs, port, mask[port], dir[port]);
+  }
+
+  vt1211_dirs_apply(&dirs);
+}
+
+static void vt1211_port_write(uint8_t port, uint8_t data) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  vt1211_hw_port_write(port, data);
+
+  port_status->latch        = data;
+  port_status->latch_valid  = true;
+
+  vt1211_shm_latch(port, data);
+}
+
+static void vt1211_pin_set(uint8_t port, uint8_t pin, uint8_t data) {
+  if (params.nocache) {
+    vt1211_hw_pin_set(port, pin, data);
+    return;
+  }
+
+  uint8_t latch = vt1211_latch(port);
+
+  if (data) {
+    latch |= pin;
+  } else {
+    latch &= ~pin;
+  }
+
+  vt1211_port_write(port, latch);
+}
+
+/*
+ * Read-modify-write of the pins in the mask. Returns the written port value.
+ */
+uint8_t vt1211_port_modify(uint8_t port, uint8_t op, uint8_t mask, uint8_t value) {
+  uint8_t data = params.nocache ? vt1211_hw_port_read(port) : vt1211_latch(port);
+
+  switch (op) {
+    case VT1211_MODIFY_SET:
+      data |= mask;
+      break;
+    case VT1211_MODIFY_CLEAR:
+      data &= ~mask;
+      break;
+    case VT1211_MODIFY_TOGGLE:
+      data ^= mask;
+      break;
+    case VT1211_MODIFY_ASSIGN:
+      data = (data & ~mask) | (value & mask);
+      break;
+  }
+
+  vt1211_port_write(port, data);
+
+  return data;
+}
+
+static inline bool vt1211_is_cached(uint8_t port, uint8_t pins) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  return !params.nocache && port_status->latch_valid &&
+         (port_status->dir_known & port_status->dir & pins) == pins;
+}
+
+static uint8_t vt1211_pin_get(uint8_t port, uint8_t pin) {
+  if (vt1211_is_cached(port, pin))
+    return (ports_status[port].latch & pin) ? 1 : 0;
+
+  if (vt1211_debounce_pins(port) & pin)
+    return (vt1211_debounce_merge(port, 0) & pin) ? 1 : 0;
+
+  return vt1211_hw_pin_get(port, pin);
+}
+
+uint8_t vt1211_port_read(uint8_t port) {
+  if (vt1211_is_cached(port, ports_status[port].pins))
+    return ports_status[port].latch;
+
+  uint8_t data = vt1211_hw_port_read(port);
+
+  vt1211_shm_input(port, data);
+
+  return vt1211_debounce_merge(port, data);
+}
+
+/*
+ * Hardware read of the ports in the mask for the scanner threads, each port
+ * under its lock, so a read never lands in the middle of a request, a
+ * pattern step or a PWM edge on the port. The data registers are outside the
+ * configuration space, so a direction session on another port (cfg_lock)
+ * doesn't need to be excluded. stamps, if not NULL, gets the ClockCycles()
+ * of each read. Called with no port locked.
+ */
+void vt1211_ports_sample(uint8_t ports, uint8_t *values, uint64_t *stamps) {
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (!(ports & (1 << port)))
+      continue;
+
+    vt1211_lock(1 << port);
+
+    values[port] = vt1211_hw_port_read(port);
+
+    if (stamps != NULL)
+      stamps[port] = ClockCycles();
+
+    vt1211_unlock(1 << port);
+  }
+}
+
+static int vt1211_batch_check(vt1211_ocb_t *ocb, gpio_batch_op_t *op) {
+  switch (op->op) {
+    case VT1211_OP_CONFIG_PIN:
+    case VT1211_OP_SET_PIN:
+    case VT1211_OP_GET_PIN:
+      return vt1211_check(ocb, op->port, op->pin, VT1211_CHECK_PIN_PERM);
+    case VT1211_OP_CONFIG_PORT:
+    case VT1211_OP_SET_PORT:
+    case VT1211_OP_GET_PORT:
+      return vt1211_check(ocb, op->port, op->pin, VT1211_CHECK_PORT_PERM);
+    default:
+      return ENOSYS;
+  }
+}
+
+/*
+ * Direction changes are queued and applied together before the next
+ * operation of another kind, so a run of them costs one configuration session.
+ */
+static void vt1211_batch_exec(gpio_batch_op_t *op, vt1211_dirs_t *dirs) {
+  if (op->op != VT1211_OP_CONFIG_PIN && op->op != VT1211_OP_CONFIG_PORT && dirs->ports)
+    vt1211_dirs_apply(dirs);
+
+  switch (op->op) {
+    case VT1211_OP_CONFIG_PIN:
+      vt1211_dirs_queue(dirs, op->port, op->pin, op->data == VT1211_PIN_INPUT ? 0x00 : 0xFF);
+      break;
+    case VT1211_OP_SET_PIN:
+      vt1211_pin_set(op->port, op->pin, op->data);
+      break;
+    case VT1211_OP_GET_PIN:
+      op->data = vt1211_pin_get(op->port, op->pin);
+      break;
+    case VT1211_OP_CONFIG_PORT:
+      vt1211_dirs_queue(dirs, op->port, 0xFF, op->data);
+      break;
+    case VT1211_OP_SET_PORT:
+      vt1211_port_write(op->port, op->data);
+      break;
+    case VT1211_OP_GET_PORT:
+      op->data = vt1211_port_read(op->port);
+      break;
+  }
+
+  op->result = EOK;
+}
+
+/*
+ * VT1211_BATCH. The operations are processed in place in the receive buffer
+ * and replied from there, so there is no extra copy in either direction.
+ * Returns the number of reply data bytes or -errno.
+ */
+static int vt1211_batch(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb) {
+  gpio_batch_t  *batch = (gpio_batch_t *) _DEVCTL_DATA (msg->i);
+  size_t        nbytes = msg->i.nbytes;
+  bool          failed = false;
+  vt1211_dirs_t dirs   = { 0 };
+
+  if (nbytes < sizeof(gpio_batch_t) ||
+      ctp->info.msglen < (int) (sizeof(msg->i) + nbytes)) {
+    return -EINVAL;
+  }
+
+  if (batch->count > VT1211_BATCH_MAX ||
+      nbytes < sizeof(gpio_batch_t) + batch->count * sizeof(gpio_batch_op_t)) {
+    return -E2BIG;
+  }
+
+  debugf("Batch of %u ops: ", batch->count);
+
+  for (uint32_t i = 0; i < batch->count; ++i) {
+    batch->ops[i].result = vt1211_batch_check(ocb, &batch->ops[i]);
+
+    if (batch->ops[i].result != EOK)
+      failed = true;
+  }
+
+  batch->done = 0;
+
+  if (failed) {
+    debugf("Rejected\n");
+    return nbytes;
+  }
+
+  for (uint32_t i = 0; i < batch->count; ++i) {
+    vt1211_batch_exec(&batch->ops[i], &dirs);
+  }
+
+  vt1211_dirs_apply(&dirs);
+
+  batch->done = batch->count;
+
+  debugf("OK\n");
+  return nbytes;
+}
+
+/*
+ * devctl handlers. A handler is called with the ports of the request locked
+ * and the checks of its devctls[] entry passed. *nbytes is preset to the
+ * reply size of the entry. Returns EOK or an error code.
+ */
+typedef int (*vt1211_devctl_t)(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes);
+
+static int vt1211_devctl_info(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  debugf("Action: info\n");
+
+  memcpy(data, &ports_info, sizeof(gpio_portsinfo_t));
+  return EOK;
+}
+
+static int vt1211_devctl_req_pin(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+  int         rc;
+
+  debugf("Port %d pin %d request. Status: ", port_data->port, port_data->pin);
+
+  if ((rc = vt1211_pin_request(ocb, port_data->port, __builtin_ctz(port_data->pin), ctp->info.pid)) != EOK)
+    return rc;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_free_pin(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t         *port_data    = (gpio_data_t *) data;
+  gpio_port_status_t  *port_status  = &ports_status[port_data->port];
+
+  debugf("Port %d pin %d free request. Status: ", port_data->port, port_data->pin);
+
+  if (!(port_status->pins_busy & port_data->pin)) {
+    debugf("Already free\n");
+    return VT1211_ERR_ALREADY;
+  }
+
+  if (port_status->pins_owner[__builtin_ctz(port_data->pin)] != ocb) {
+    debugf("Only owner can free pin\n");
+    return VT1211_ERR_PERM;
+  }
+
+  vt1211_pin_release(port_data->port, __builtin_ctz(port_data->pin));
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_config_pin(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+
+  debugf("Config port %d pin %d: ", port_data->port, port_data->pin);
+
+  vt1211_pin_mode(port_data->port, port_data->pin, port_data->data);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_set_pin(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
 
+  debugf("Set port %d pin %d data %02X: ", port_data->port, port_data->pin, port_data->data);
+
+  vt1211_pin_set(port_data->port, port_data->pin, port_data->data);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_get_pin(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+
+  debugf("Get port %d pin %d: ", port_data->port, port_data->pin);
+
+  port_data->data = vt1211_pin_get(port_data->port, port_data->pin);
+
+  debugf("OK. Data: %02X\n", port_data->data);
+  return EOK;
+}
+
+static int vt1211_devctl_req_port(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+  int         rc;
+
+  debugf("Port %d request. Status: ", port_data->port);
+
+  if ((rc = vt1211_port_request(ocb, port_data->port, ctp->info.pid)) != EOK)
+    return rc;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_free_port(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t         *port_data    = (gpio_data_t *) data;
+  gpio_port_status_t  *port_status  = &ports_status[port_data->port];
+
+  debugf("Port %d free request. Status: ", port_data->port);
+
+  if (!port_status->busy) {
+    debugf("Already free\n");
+    return VT1211_ERR_ALREADY;
+  }
+
+  if (port_status->owner != ocb) {
+    debugf("Only owner can free port\n");
+    return VT1211_ERR_PERM;
+  }
+
+  vt1211_port_release(port_data->port);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_config_port(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+
+  debugf("Config port %d: ", port_data->port);
+
+  vt1211_port_mode(port_data->port, port_data->data);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_set_port(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+
+  debugf("Set port %d Data %02X: ", port_data->port, port_data->data);
+
+  vt1211_port_write(port_data->port, port_data->data);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_get_port(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_data_t *port_data = (gpio_data_t *) data;
+
+  debugf("Get port %d: ", port_data->port);
+
+  port_data->data = vt1211_port_read(port_data->port);
+
+  debugf("OK. Data: %02X\n", port_data->data);
+  return EOK;
+}
+
+static int vt1211_devctl_batch(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  *nbytes = vt1211_batch(ctp, msg, ocb);
+
+  return *nbytes < 0 ? -*nbytes : EOK;
+}
+
+static int vt1211_devctl_get_all(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_ports_t *ports = (gpio_ports_t *) data;
+
+  debugf("Get all ports: ");
+
+  memset(ports, 0, sizeof(gpio_ports_t));
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (vt1211_port_foreign(port, ocb))
+      continue;
+
+    ports->data[port] = vt1211_port_read(port);
+    ports->mask |= 1 << port;
+  }
+
+  debugf("OK. Mask: %02X\n", ports->mask);
+  return EOK;
+}
+
+static int vt1211_devctl_set_multi(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_ports_t  *ports = (gpio_ports_t *) data;
+  int           rc;
+
+  debugf("Set ports %02X: ", ports->mask);
+
+  if (ports->mask >> ports_info.count) {
+    debugf("Incorrect port\n");
+    return VT1211_ERR_INCRCT_PORT;
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((ports->mask & (1 << port)) &&
+        (rc = vt1211_check(ocb, port, 0, VT1211_CHECK_PORT_PERM)) != EOK) {
+      return rc;
+    }
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (ports->mask & (1 << port))
+      vt1211_port_write(port, ports->data[port]);
+  }
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_config_multi(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_dirs_t   *config = (gpio_dirs_t *) data;
+  vt1211_dirs_t dirs    = { 0 };
+  int           rc;
+
+  debugf("Config ports %02X: ", config->mask);
+
+  if (config->mask >> ports_info.count) {
+    debugf("Incorrect port\n");
+    return VT1211_ERR_INCRCT_PORT;
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if ((config->mask & (1 << port)) &&
+        (rc = vt1211_check(ocb, port, config->pins[port], VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM)) != EOK) {
+      return rc;
+    }
+  }
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    if (config->mask & (1 << port))
+      vt1211_dirs_queue(&dirs, port, config->pins[port], config->dir[port]);
+  }
+
+  vt1211_dirs_apply(&dirs);
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_modify(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_modify_t *modify = (gpio_modify_t *) data;
+
+  debugf("Modify port %d op %d mask %02X value %02X: ", modify->port, modify->op, modify->mask, modify->value);
+
+  if (modify->op > VT1211_MODIFY_ASSIGN) {
+    debugf("Incorrect operation\n");
+    return EINVAL;
+  }
+
+  modify->value = vt1211_port_modify(modify->port, modify->op, modify->mask, modify->value);
+
+  debugf("OK. Data: %02X\n", modify->value);
+  return EOK;
+}
+
+static int vt1211_devctl_bind(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_bind_t *bind = (gpio_bind_t *) data;
+  int         rc;
+
+  debugf("Bind mode %d port %d: ", bind->mode, bind->port);
+
+  switch (bind->mode) {
+    case VT1211_BIND_NONE: {
+      rc = EOK;
+      break;
+    }
+    case VT1211_BIND_PORT: {
+      rc = vt1211_check(ocb, bind->port, 0, 0);
+      break;
+    }
+    case VT1211_BIND_SAMPLER: {
+      if (params.sample_rate == 0) {
+        debugf("Sampler is off\n");
+        rc = ENODEV;
+        break;
+      }
+
+      vt1211_sampler_attach(ocb);
+      rc = EOK;
+      break;
+    }
+    default: {
+      debugf("Incorrect mode\n");
+      rc = EINVAL;
+      break;
+    }
+  }
+
+  if (rc != EOK)
+    return rc;
+
+  ocb->bind = bind->mode;
+  ocb->port = bind->port;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_sampler_read(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_samples_t  *samples  = (gpio_samples_t *) data;
+  uint32_t        count     = (ctp->msg_max_size - sizeof(msg->o) - sizeof(gpio_samples_t)) / sizeof(gpio_sample_t);
+
+  if (ocb->bind != VT1211_BIND_SAMPLER)
+    return ENXIO;
+
+  if (msg->i.nbytes < sizeof(gpio_samples_t))
+    return EINVAL;
+
+  if (count > (msg->i.nbytes - sizeof(gpio_samples_t)) / sizeof(gpio_sample_t))
+    count = (msg->i.nbytes - sizeof(gpio_samples_t)) / sizeof(gpio_sample_t);
+
+  if (count > samples->count)
+    count = samples->count;
+
+  samples->count        = vt1211_sampler_read(ocb, samples->samples, count);
+  samples->overflow     = ocb->sample_overflow;
+  ocb->sample_overflow  = 0;
+
+  *nbytes = sizeof(gpio_samples_t) + samples->count * sizeof(gpio_sample_t);
+  return EOK;
+}
+
+static int vt1211_devctl_watch(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_watch_t *watch = (gpio_watch_t *) data;
+  int          rc;
+
+  debugf("Watch port %d mask %02X edge %d: ", watch->port, watch->mask, watch->edge);
+
+  if (watch->mask != 0 && (watch->edge & VT1211_EDGE_BOTH) == 0) {
+    debugf("Incorrect edge\n");
+    return EINVAL;
+  }
+
+  rc = vt1211_watch(ocb, watch);
+
+  debugf("OK\n");
+  return rc;
+}
+
+static int vt1211_devctl_watch_events(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  vt1211_watch_events(ocb, (gpio_events_t *) data);
+  return EOK;
+}
+
+static int vt1211_devctl_play_pattern(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  int rc;
+
+  debugf("Play pattern: ");
+
+  rc = vt1211_pattern_play(ctp, msg, ocb);
+
+  debugf("%s\n", rc == EOK ? "OK" : strerror(rc));
+  return rc;
+}
+
+static int vt1211_devctl_pattern_status(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  vt1211_pattern_status((gpio_pattern_status_t *) data);
+  return EOK;
+}
+
+static int vt1211_devctl_pattern_stop(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  int rc;
+
+  debugf("Stop pattern: ");
+
+  rc = vt1211_pattern_stop(ocb);
+
+  debugf("%s\n", rc == EOK ? "OK" : "Not the owner");
+  return rc;
+}
+
+static int vt1211_devctl_pwm(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_pwm_t  *pwm = (gpio_pwm_t *) data;
+  int         rc;
+
+  debugf("PWM port %d pin %d period %u us duty %u us: ", pwm->port, pwm->pin, pwm->period_us, pwm->duty_us);
+
+  rc = vt1211_pwm_config(ocb, pwm);
+
+  debugf("%s\n", rc == EOK ? "OK" : strerror(rc));
+  return rc;
+}
+
+static int vt1211_devctl_debounce(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_debounce_t *debounce = (gpio_debounce_t *) data;
+  int             rc;
+
+  debugf("Debounce port %d mask %02X count %d: ", debounce->port, debounce->mask, debounce->count);
+
+  rc = vt1211_debounce(debounce);
+
+  debugf("%s\n", rc == EOK ? "OK" : strerror(rc));
+  return rc;
+}
+
+static int vt1211_devctl_resync(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  debugf("Resync: ");
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    vt1211_resync(port);
+  }
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_renew(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  debugf("Lease renewed\n");
+  return EOK;
+}
+
+static int vt1211_devctl_bus_config(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_bus_t  *bus = (gpio_bus_t *) data;
+  int         rc;
+
+  debugf("Bus type %d port %d clk %02X mosi %02X miso %02X cs %02X: ",
+         bus->type, bus->port, bus->clk, bus->mosi, bus->miso, bus->cs);
+
+  if ((rc = vt1211_bus_config(ocb, bus)) != EOK)
+    return rc;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+/*
+ * VT1211_BUS_XFER. Like VT1211_BATCH the data is transferred in place in the
+ * receive buffer and replied from there.
+ */
+static int vt1211_devctl_bus_xfer(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_bus_xfer_t *xfer = (gpio_bus_xfer_t *) data;
+  size_t          len   = sizeof(gpio_bus_xfer_t) + xfer->wlen + xfer->rlen;
+  int             rc;
+
+  debugf("Bus transfer addr %02X write %u read %u: ", xfer->addr, xfer->wlen, xfer->rlen);
+
+  if (xfer->wlen + xfer->rlen > VT1211_BUS_MAX)
+    return E2BIG;
+
+  if (msg->i.nbytes < len || ctp->info.msglen < (int) (sizeof(msg->i) + len))
+    return EINVAL;
+
+  if ((rc = vt1211_bus_transfer(ocb, xfer->addr, xfer->data, xfer->wlen, xfer->rlen)) != EOK) {
+    debugf("Failed\n");
+    return rc;
+  }
+
+  *nbytes = len;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_group_define(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_group_t  *group = (gpio_group_t *) data;
+  int           rc;
+
+  debugf("Define group of %d pins: ", group->count);
+
+  if ((rc = vt1211_group_define(group)) != EOK)
+    return rc;
+
+  debugf("OK. Id: %X\n", group->id);
+  return EOK;
+}
+
+static int vt1211_devctl_group_find(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  return vt1211_group_find((gpio_group_t *) data);
+}
+
+static int vt1211_devctl_group_write(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_group_value_t *value = (gpio_group_value_t *) data;
+
+  return vt1211_group_write(ocb, value->id, value->value);
+}
+
+static int vt1211_devctl_group_read(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_group_value_t *value = (gpio_group_value_t *) data;
+
+  return vt1211_group_read(ocb, value->id, &value->value);
+}
+
+static int vt1211_devctl_capture(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_capture_t  *capture = (gpio_capture_t *) data;
+  uint8_t         pins     = 0;
+  int             rc;
+
+  debugf("Capture edges %d: ", capture->edge);
+
+  for (uint8_t port = 0; port < VT1211_PORTS_MAX; ++port) {
+    if (capture->mask[port] == 0)
+      continue;
+
+    if ((rc = vt1211_check(ocb, port, capture->mask[port], VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM)) != EOK)
+      return rc;
+
+    pins |= capture->mask[port];
+  }
+
+  if (pins != 0 && (capture->edge & VT1211_EDGE_BOTH) == 0) {
+    debugf("Incorrect edge\n");
+    return EINVAL;
+  }
+
+  if ((rc = vt1211_capture(ocb, capture)) != EOK)
+    return rc;
+
+  debugf("OK\n");
+  return EOK;
+}
+
+static int vt1211_devctl_capture_stats(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  vt1211_capture_stats(ocb, (gpio_capture_stats_t *) data);
+  return EOK;
+}
+
+static int vt1211_devctl_stats(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  return vt1211_stats_get((gpio_stats_t *) data);
+}
+
+static int vt1211_devctl_stats_reset(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  debugf("Statistics reset\n");
+
+  vt1211_stats_reset();
+  return EOK;
+}
+
+static int vt1211_devctl_trace(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb, void *data, int *nbytes) {
+  gpio_trace_ctl_t *trace = (gpio_trace_ctl_t *) data;
+
+  debugf("Trace %s\n", trace->enable ? "on" : "off");
+
+  __atomic_store_n(&vt1211_tracing, trace->enable != 0, __ATOMIC_RELAXED);
+  return EOK;
+}
+
+#define VT1211_LOCK_ALL     0x80 // the request works with all the ports
+#define VT1211_NO_ARG       -1
+
+/*
+ * What a devctl needs before its handler runs. port and pin are offsets of
+ * the port and of the pin (or the pin mask) in the request data. The port is
+ * validated and locked, the pin is checked according to the VT1211_CHECK_*
+ * flags. size is the request data the client has to send. value is the
+ * offset of the byte recorded as the data of the request in the trace.
+ */
 typedef struct {
-  bool            busy;
-  pid_t           pid;
-  struct hashmap  *pins;
-} gpio_port_status_t;
+  int             dcmd;
+  vt1211_devctl_t handler;
+  uint16_t        size;
+  uint16_t        reply;
+  int8_t          port;
+  int8_t          pin;
+  int8_t          value;
+  uint8_t         flags;
+} vt1211_devctl_entry_t;
+
+#define VT1211_DEVCTL(dcmd, handler, size, reply, port, pin, value, flags) \
+  [(dcmd) & 0xFF] = { dcmd, handler, size, reply, port, pin, value, flags }
+
+#define VT1211_ARG(type, field) offsetof(type, field)
+
+static const vt1211_devctl_entry_t devctls[256] = {
+  VT1211_DEVCTL(VT1211_GET_INFO,        vt1211_devctl_info,           0,                        sizeof(gpio_portsinfo_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_CONFIG_PIN,      vt1211_devctl_config_pin,     sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_ARG(gpio_data_t, pin),       VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PIN_PERM),
+  VT1211_DEVCTL(VT1211_SET_PIN,         vt1211_devctl_set_pin,        sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_ARG(gpio_data_t, pin),       VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PIN_PERM),
+  VT1211_DEVCTL(VT1211_GET_PIN,         vt1211_devctl_get_pin,        sizeof(gpio_data_t),      sizeof(gpio_data_t),
+                VT1211_ARG(gpio_data_t, port),      VT1211_ARG(gpio_data_t, pin),       VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PIN_PERM),
+  VT1211_DEVCTL(VT1211_CONFIG_PORT,     vt1211_devctl_config_port,    sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_NO_ARG,                      VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_SET_PORT,        vt1211_devctl_set_port,       sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_NO_ARG,                      VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_GET_PORT,        vt1211_devctl_get_port,       sizeof(gpio_data_t),      sizeof(gpio_data_t),
+                VT1211_ARG(gpio_data_t, port),      VT1211_NO_ARG,                      VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_REQ_PORT,        vt1211_devctl_req_port,       sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_NO_ARG,                      VT1211_ARG(gpio_data_t, data),       0),
+  VT1211_DEVCTL(VT1211_REQ_PIN,         vt1211_devctl_req_pin,        sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_ARG(gpio_data_t, pin),       VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PIN),
+  VT1211_DEVCTL(VT1211_FREE_PORT,       vt1211_devctl_free_port,      sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_NO_ARG,                      VT1211_ARG(gpio_data_t, data),       0),
+  VT1211_DEVCTL(VT1211_FREE_PIN,        vt1211_devctl_free_pin,       sizeof(gpio_data_t),      0,
+                VT1211_ARG(gpio_data_t, port),      VT1211_ARG(gpio_data_t, pin),       VT1211_ARG(gpio_data_t, data),       VT1211_CHECK_PIN),
+  VT1211_DEVCTL(VT1211_BATCH,           vt1211_devctl_batch,          sizeof(gpio_batch_t),     0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_GET_ALL,         vt1211_devctl_get_all,        0,                        sizeof(gpio_ports_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_SET_MULTI,       vt1211_devctl_set_multi,      sizeof(gpio_ports_t),     0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_CONFIG_MULTI,    vt1211_devctl_config_multi,   sizeof(gpio_dirs_t),      0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_RESYNC,          vt1211_devctl_resync,         0,                        0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_MODIFY_PORT,     vt1211_devctl_modify,         sizeof(gpio_modify_t),    sizeof(gpio_modify_t),
+                VT1211_ARG(gpio_modify_t, port),    VT1211_ARG(gpio_modify_t, mask),    VT1211_ARG(gpio_modify_t, value),    VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_BIND,            vt1211_devctl_bind,           sizeof(gpio_bind_t),      0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_SAMPLER_READ,    vt1211_devctl_sampler_read,   sizeof(gpio_samples_t),   0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_WATCH,           vt1211_devctl_watch,          sizeof(gpio_watch_t),     0,
+                VT1211_ARG(gpio_watch_t, port),     VT1211_ARG(gpio_watch_t, mask),     VT1211_ARG(gpio_watch_t, edge),      VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_WATCH_EVENTS,    vt1211_devctl_watch_events,   0,                        sizeof(gpio_events_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_PLAY_PATTERN,    vt1211_devctl_play_pattern,   sizeof(gpio_pattern_t),   0,
+                VT1211_ARG(gpio_pattern_t, port),   VT1211_NO_ARG,                      VT1211_NO_ARG,                       VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_PATTERN_STATUS,  vt1211_devctl_pattern_status, 0,                        sizeof(gpio_pattern_status_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_PATTERN_STOP,    vt1211_devctl_pattern_stop,   0,                        0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_PWM_CONFIG,      vt1211_devctl_pwm,            sizeof(gpio_pwm_t),       0,
+                VT1211_ARG(gpio_pwm_t, port),       VT1211_ARG(gpio_pwm_t, pin),        VT1211_NO_ARG,                       VT1211_CHECK_PIN_PERM | VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_DEBOUNCE,        vt1211_devctl_debounce,       sizeof(gpio_debounce_t),  0,
+                VT1211_ARG(gpio_debounce_t, port),  VT1211_ARG(gpio_debounce_t, mask),  VT1211_ARG(gpio_debounce_t, count),  VT1211_CHECK_MASK_PERM | VT1211_CHECK_PORT_PERM),
+  VT1211_DEVCTL(VT1211_RENEW,           vt1211_devctl_renew,          0,                        0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_TRACE,           vt1211_devctl_trace,          sizeof(gpio_trace_ctl_t), 0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_trace_ctl_t, enable), 0),
+  VT1211_DEVCTL(VT1211_GET_STATS,       vt1211_devctl_stats,          sizeof(gpio_stats_t),     sizeof(gpio_stats_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_stats_t, cmd),       0),
+  VT1211_DEVCTL(VT1211_STATS_RESET,     vt1211_devctl_stats_reset,    0,                        0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_BUS_CONFIG,      vt1211_devctl_bus_config,     sizeof(gpio_bus_t),       0,
+                VT1211_ARG(gpio_bus_t, port),       VT1211_NO_ARG,                      VT1211_ARG(gpio_bus_t, type),        0),
+  VT1211_DEVCTL(VT1211_BUS_XFER,        vt1211_devctl_bus_xfer,       sizeof(gpio_bus_xfer_t),  0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_bus_xfer_t, addr),   0),
+  VT1211_DEVCTL(VT1211_GROUP_DEFINE,    vt1211_devctl_group_define,   sizeof(gpio_group_t),     sizeof(gpio_group_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_group_t, count),     0),
+  VT1211_DEVCTL(VT1211_GROUP_FIND,      vt1211_devctl_group_find,     sizeof(gpio_group_t),     sizeof(gpio_group_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_GROUP_WRITE,     vt1211_devctl_group_write,    sizeof(gpio_group_value_t), 0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_group_value_t, value), 0),
+  VT1211_DEVCTL(VT1211_GROUP_READ,      vt1211_devctl_group_read,     sizeof(gpio_group_value_t), sizeof(gpio_group_value_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+  VT1211_DEVCTL(VT1211_CAPTURE,         vt1211_devctl_capture,        sizeof(gpio_capture_t),   0,
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_ARG(gpio_capture_t, edge),    VT1211_LOCK_ALL),
+  VT1211_DEVCTL(VT1211_CAPTURE_STATS,   vt1211_devctl_capture_stats,  0,                        sizeof(gpio_capture_stats_t),
+                VT1211_NO_ARG,                      VT1211_NO_ARG,                      VT1211_NO_ARG,                       0),
+};
+
+static inline uint8_t vt1211_devctl_arg(const uint8_t *data, int8_t offset) {
+  return offset != VT1211_NO_ARG ? data[offset] : 0xFF;
+}
+
+int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, RESMGR_OCB_T *ocb) {
+  const vt1211_devctl_entry_t *entry;
+  uint8_t                     *data;
+  uint8_t                     port;
+  uint8_t                     ports;
+  int                         nbytes;
+  int                         rc;
+  uint64_t                    start;
+  uint32_t                    hw_calls;
+
+  start     = ClockCycles();
+  hw_calls  = vt1211_hw_calls;
+  data      = _DEVCTL_DATA (msg->i);
+  entry     = &devctls[msg->i.dcmd & 0xFF];
+
+  debugf("dcmd: %0X from pid: %d\n", msg->i.dcmd, ctp->info.pid);
+
+  if (entry->handler == NULL || entry->dcmd != (int) msg->i.dcmd) {
+    vt1211_trace(msg->i.dcmd, ctp->info.pid, 0xFF, 0xFF, 0xFF, ENOSYS);
+    vt1211_stats_record(msg->i.dcmd, false, ctp->info.pid, ENOSYS, ClockCycles() - start, 0);
+    return ENOSYS;
+  }
+
+  if (ctp->info.msglen < (int) (sizeof(msg->i) + entry->size)) {
+    debugf("Short request\n");
+    vt1211_trace(msg->i.dcmd, ctp->info.pid, 0xFF, 0xFF, 0xFF, EINVAL);
+    vt1211_stats_record(msg->i.dcmd, true, ctp->info.pid, EINVAL, ClockCycles() - start, 0);
+    return EINVAL;
+  }
+
+  vt1211_renew(ocb);
+
+  ports = entry->flags & VT1211_LOCK_ALL ? (1 << ports_info.count) - 1 : 0;
+
+  if (entry->port != VT1211_NO_ARG) {
+    port  = data[entry->port];
+    ports = port < ports_info.count ? 1 << port : 0;
+  }
+
+  vt1211_lock(ports);
+
+  rc      = EOK;
+  nbytes  = entry->reply;
+
+  if (entry->port != VT1211_NO_ARG) {
+    rc = vt1211_check(ocb, port, entry->pin != VT1211_NO_ARG ? data[entry->pin] : 0,
+                      entry->flags & ~VT1211_LOCK_ALL);
+  }
+
+  if (rc == EOK)
+    rc = entry->handler(ctp, msg, ocb, data, &nbytes);
+
+  vt1211_unlock(ports);
+
+  vt1211_trace(msg->i.dcmd, ctp->info.pid, vt1211_devctl_arg(data, entry->port),
+               vt1211_devctl_arg(data, entry->pin), vt1211_devctl_arg(data, entry->value), rc);
+  vt1211_stats_record(msg->i.dcmd, true, ctp->info.pid, rc, ClockCycles() - start, vt1211_hw_calls - hw_calls);
+
+  if (rc != EOK)
+    return rc;
+
+  memset(&msg->o, 0, sizeof (msg->o));
+
+  msg->o.ret_val = EOK;
+  msg->o.nbytes  = nbytes;
+
+  return _RESMGR_PTR (ctp, &msg->o, sizeof (msg->o) + nbytes);
+}
+
+/*
+ * Streaming access to the port bound with VT1211_BIND: every byte written is
+ * a port write, every byte read is a port sample. The data is taken from and
+ * put into the receive buffer, larger transfers are done in chunks of its
+ * size. The port stays locked for the whole transfer.
+ */
+static int vt1211_stream_read(resmgr_context_t *ctp, io_read_t *msg, uint8_t port) {
+  size_t  nbytes  = msg->i.nbytes;
+  size_t  chunk   = ctp->msg_max_size;
+  size_t  len;
+  uint8_t *buf    = (uint8_t *) msg;
+
+  for (size_t offset = 0; offset < nbytes; offset += len) {
+    len = nbytes - offset < chunk ? nbytes - offset : chunk;
+
+    for (size_t i = 0; i < len; ++i) {
+      buf[i] = vt1211_port_read(port);
+    }
 
-static params_t                   params;
-static const char*                params_str = "i:d:pv";
-static resmgr_connect_funcs_t     connect_funcs;
-static resmgr_io_funcs_t          io_funcs;
-static iofunc_attr_t              attr;
-static struct hashmap             *ports_status;
-static gpio_portsinfo_t           ports_info;
+    if (len == nbytes) {
+      _IO_SET_READ_NBYTES(ctp, nbytes);
+      return _RESMGR_PTR(ctp, buf, len);
+    }
 
-static void debugf(const char *format, ... ) {
-  if (params.verbose) {
-    va_list args;
-    va_start (args, format);
-    vprintf(format, args);
-    va_end (args);
+    if (resmgr_msgwrite(ctp, buf, len, offset) == -1)
+      return errno;
   }
+
+  _IO_SET_READ_NBYTES(ctp, nbytes);
+  return _RESMGR_NPARTS(0);
 }
 
-bool vt1211_port_check(gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+static int vt1211_stream_write(resmgr_context_t *ctp, io_write_t *msg, uint8_t port) {
+  size_t  nbytes  = msg->i.nbytes;
+  size_t  len     = ctp->info.msglen - sizeof(msg->i);
+  uint8_t *buf    = (uint8_t *) (&msg->i + 1);
+  uint8_t chunk[256];
 
-  return hashmap_contains(ports_status, &port_key);
-}
+  if (len > nbytes)
+    len = nbytes;
 
-bool vt1211_port_check_perm(pid_t pid, gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+  for (size_t i = 0; i < len; ++i) {
+    vt1211_port_write(port, buf[i]);
+  }
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
+  for (size_t offset = len; offset < nbytes; offset += len) {
+    len = nbytes - offset < sizeof(chunk) ? nbytes - offset : sizeof(chunk);
 
-  if (port_status->pid == pid) {
-    return true;
-  } else {
-    return false;
+    if (resmgr_msgread(ctp, chunk, len, sizeof(msg->i) + offset) == -1)
+      return errno;
+
+    for (size_t i = 0; i < len; ++i) {
+      vt1211_port_write(port, chunk[i]);
+    }
   }
+
+  _IO_SET_WRITE_NBYTES(ctp, nbytes);
+  return _RESMGR_NPARTS(0);
 }
 
-bool vt1211_port_is_busy(gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+/*
+ * Pin descriptors. A one byte read returns the value as a 0/1 byte and can
+ * be repeated. A longer read returns "0\n" or "1\n" once, like a text file,
+ * and then the end of file until the descriptor is rewound. A write takes
+ * '0'/'1' characters or 0/1 bytes, whitespace is skipped, the last value is
+ * set.
+ */
+static int vt1211_pin_read(resmgr_context_t *ctp, io_read_t *msg, vt1211_ocb_t *ocb) {
+  uint8_t *buf    = (uint8_t *) msg;
+  size_t  nbytes  = 0;
+
+  if (msg->i.nbytes == 1) {
+    buf[0] = vt1211_pin_get(ocb->port, ocb->pin);
+    nbytes = 1;
+  } else if (msg->i.nbytes > 1 && ocb->hdr.offset == 0) {
+    buf[0] = '0' + vt1211_pin_get(ocb->port, ocb->pin);
+    buf[1] = '\n';
+    nbytes = 2;
+    ocb->hdr.offset += nbytes;
+  }
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
-  return port_status->busy;
+  _IO_SET_READ_NBYTES(ctp, nbytes);
+  return _RESMGR_PTR(ctp, buf, nbytes);
 }
 
-void vt1211_port_set_busy(pid_t pid, gpio_data_t *port_data, bool busy) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+static int vt1211_pin_parse(const uint8_t *buf, size_t len, int *value) {
+  for (size_t i = 0; i < len; ++i) {
+    switch (buf[i]) {
+      case 0:
+      case '0':
+        *value = 0;
+        break;
+      case 1:
+      case '1':
+        *value = 1;
+        break;
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        break;
+      default:
+        return EINVAL;
+    }
+  }
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
-  port_status->pid  = pid;
-  port_status->busy = busy;
+  return EOK;
 }
 
-bool vt1211_pin_check(gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+static int vt1211_pin_write(resmgr_context_t *ctp, io_write_t *msg, vt1211_ocb_t *ocb) {
+  size_t  nbytes  = msg->i.nbytes;
+  size_t  len     = ctp->info.msglen - sizeof(msg->i);
+  uint8_t chunk[64];
+  int     value   = -1;
 
-  uint8_t     pin_id  = port_data->pin;
-  struct hkey pin_key = {&pin_id, sizeof(pin_id)};
+  if (len > nbytes)
+    len = nbytes;
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
+  if (vt1211_pin_parse((uint8_t *) (&msg->i + 1), len, &value) != EOK)
+    return EINVAL;
 
-  return hashmap_contains(port_status->pins, &pin_key);
-}
+  for (size_t offset = len; offset < nbytes; offset += len) {
+    len = nbytes - offset < sizeof(chunk) ? nbytes - offset : sizeof(chunk);
+
+    if (resmgr_msgread(ctp, chunk, len, sizeof(msg->i) + offset) == -1)
+      return errno;
 
-bool vt1211_pin_is_busy(gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+    if (vt1211_pin_parse(chunk, len, &value) != EOK)
+      return EINVAL;
+  }
 
-  uint8_t     pin_id  = port_data->pin;
-  struct hkey pin_key = {&pin_id, sizeof(pin_id)};
+  if (value >= 0)
+    vt1211_pin_set(ocb->port, ocb->pin, value);
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
-  gpio_pin_status_t  *pin_status  = hashmap_get(port_status->pins, &pin_key);
-  return pin_status->busy;
+  _IO_SET_WRITE_NBYTES(ctp, nbytes);
+  return _RESMGR_NPARTS(0);
 }
 
-void vt1211_pin_set_busy(pid_t pid, gpio_data_t *port_data, bool busy) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+/*
+ * /dev/vt1211/stats. The text is made when the descriptor reads from offset
+ * 0 and is read from the snapshot until it's rewound again.
+ */
+static int vt1211_stats_read(resmgr_context_t *ctp, io_read_t *msg, vt1211_ocb_t *ocb) {
+  size_t nbytes = msg->i.nbytes;
 
-  uint8_t     pin_id  = port_data->pin;
-  struct hkey pin_key = {&pin_id, sizeof(pin_id)};
+  if (ocb->hdr.offset == 0) {
+    free(ocb->stats_text);
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
-  gpio_pin_status_t  *pin_status  = hashmap_get(port_status->pins, &pin_key);
+    if ((ocb->stats_text = vt1211_stats_text(&ocb->stats_len)) == NULL)
+      return ENOMEM;
+  }
 
-  pin_status->pid  = pid;
-  pin_status->busy = busy;
-}
+  if (ocb->stats_text == NULL || (size_t) ocb->hdr.offset >= ocb->stats_len) {
+    nbytes = 0;
+  } else if (nbytes > ocb->stats_len - ocb->hdr.offset) {
+    nbytes = ocb->stats_len - ocb->hdr.offset;
+  }
 
-bool vt1211_pin_check_perm(pid_t pid, gpio_data_t *port_data) {
-  uint8_t     port_id   = port_data->port;
-  struct hkey port_key  = {&port_id, sizeof(port_id)};
+  _IO_SET_READ_NBYTES(ctp, nbytes);
 
-  uint8_t     pin_id  = port_data->pin;
-  struct hkey pin_key = {&pin_id, sizeof(pin_id)};
+  if (nbytes == 0)
+    return _RESMGR_PTR(ctp, msg, 0);
 
-  gpio_port_status_t *port_status = hashmap_get(ports_status, &port_key);
-  gpio_pin_status_t  *pin_status  = hashmap_get(port_status->pins, &pin_key);
+  ocb->hdr.offset += nbytes;
+  return _RESMGR_PTR(ctp, ocb->stats_text + ocb->hdr.offset - nbytes, nbytes);
+}
 
-  if (pin_status->pid == pid) {
-    return true;
-  } else {
-    return false;
-  }
+/*
+ * The port and the pin of a bound descriptor were validated by VT1211_BIND
+ * or when the entry was attached, read and write only check that nobody else
+ * owns them. Returns true if they do.
+ */
+static inline bool vt1211_bound_foreign(vt1211_ocb_t *ocb) {
+  if (ocb->bind == VT1211_BIND_PIN)
+    return vt1211_pin_foreign(ocb->port, __builtin_ctz(ocb->pin), ocb);
+
+  return vt1211_port_foreign(ocb->port, ocb);
 }
 
-int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, RESMGR_OCB_T *ocb) {
-  int             rc;
-  int             nbytes;
-  void            *data;
-  pid_t           pid;
-  gpio_data_t     *port_data;
+/*
+ * A descriptor bound to the sampler reads whole gpio_sample_t records, as
+ * many as are available. /dev/vt1211/trace reads gpio_trace_t records the
+ * same way.
+ */
+int io_read(resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb) {
+  int rc;
+
+  if ((rc = iofunc_read_verify(ctp, msg, &ocb->hdr, NULL)) != EOK)
+    return rc;
 
-  data      = _DEVCTL_DATA (msg->i);
-  nbytes    = 0;
-  rc        = ENOSYS;
-  pid       = ctp->info.pid;
-  port_data = (gpio_data_t *) data;
+  if ((msg->i.xtype & _IO_XTYPE_MASK) != _IO_XTYPE_NONE)
+    return ENOSYS;
 
-  debugf("dcmd: %0X from pid: %d\n", msg->i.dcmd, pid);
+  if (ocb->bind == VT1211_BIND_SAMPLER) {
+    uint32_t count = msg->i.nbytes / sizeof(gpio_sample_t);
 
-  switch (msg->i.dcmd) {
-    case VT1211_GET_INFO: {
-      debugf("Action: info\n");
-      gpio_portsinfo_t *info = (gpio_portsinfo_t *) data;
+    if (count > ctp->msg_max_size / sizeof(gpio_sample_t))
+      count = ctp->msg_max_size / sizeof(gpio_sample_t);
 
-      memcpy(info, &ports_info, sizeof(gpio_portsinfo_t));
+    count = vt1211_sampler_read(ocb, (gpio_sample_t *) msg, count);
 
-      nbytes = sizeof(gpio_portsinfo_t);
-      rc = EOK;
-      break;
-    }
-    case VT1211_REQ_PIN: {
-      debugf("Port %d pin %d request. Status: ", port_data->port, port_data->pin);
+    _IO_SET_READ_NBYTES(ctp, count * sizeof(gpio_sample_t));
+    return _RESMGR_PTR(ctp, msg, count * sizeof(gpio_sample_t));
+  }
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  if (ocb->bind == VT1211_BIND_TRACE) {
+    uint32_t count = msg->i.nbytes / sizeof(gpio_trace_t);
 
-      if (!vt1211_pin_check(port_data)) {
-        debugf("Incorrect pin\n");
-        rc = VT1211_ERR_INCRCT_PIN;
-        break;
-      }
+    if (count > ctp->msg_max_size / sizeof(gpio_trace_t))
+      count = ctp->msg_max_size / sizeof(gpio_trace_t);
 
-      if (vt1211_port_is_busy(port_data)) {
-        debugf("Port is busy\n");
-        rc = VT1211_ERR_PORT_BUSY;
-        break;
-      }
+    count = vt1211_trace_read((gpio_trace_t *) msg, count);
 
-      if (vt1211_pin_is_busy(port_data)) {
-        debugf("Pin is busy\n");
-        rc = VT1211_ERR_PIN_BUSY;
-        break;
-      }
+    _IO_SET_READ_NBYTES(ctp, count * sizeof(gpio_trace_t));
+    return _RESMGR_PTR(ctp, msg, count * sizeof(gpio_trace_t));
+  }
 
-      vt1211_pin_set_busy(pid, port_data, true);
+  if (ocb->bind == VT1211_BIND_CAPTURE) {
+    uint32_t count = msg->i.nbytes / sizeof(gpio_edge_t);
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_FREE_PIN: {
-      debugf("Port %d pin %d free request. Status: ", port_data->port, port_data->pin);
-      
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+    if (count > ctp->msg_max_size / sizeof(gpio_edge_t))
+      count = ctp->msg_max_size / sizeof(gpio_edge_t);
 
-      if (!vt1211_pin_check(port_data)) {
-        debugf("Incorrect pin\n");
-        rc = VT1211_ERR_INCRCT_PIN;
-        break;
-      }
+    count = vt1211_capture_read(ocb, (gpio_edge_t *) msg, count);
 
-      if (!vt1211_pin_check_perm(pid, port_data)) {
-        debugf("Only owner can free pin\n"); 
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+    _IO_SET_READ_NBYTES(ctp, count * sizeof(gpio_edge_t));
+    return _RESMGR_PTR(ctp, msg, count * sizeof(gpio_edge_t));
+  }
 
-      if (!vt1211_pin_is_busy(port_data)) {
-        debugf("Already free\n");
-        rc = VT1211_ERR_ALREADY;
-        break;
-      }
+  if (ocb->bind == VT1211_BIND_STATS)
+    return vt1211_stats_read(ctp, msg, ocb);
 
-      vt1211_pin_set_busy(pid, port_data, false);
+  if (ocb->bind == VT1211_BIND_BUS) {
+    vt1211_renew(ocb);
+    return vt1211_bus_read(ctp, msg, ocb);
+  }
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_CONFIG_PIN: {
-      debugf("Config port %d pin %d: ", port_data->port, port_data->pin);
+  if (ocb->bind != VT1211_BIND_PORT && ocb->bind != VT1211_BIND_PIN)
+    return ENXIO;
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  vt1211_renew(ocb);
+  vt1211_lock(1 << ocb->port);
 
-      if (!vt1211_pin_check(port_data)) {
-        debugf("Incorrect pin\n");
-        rc = VT1211_ERR_INCRCT_PIN;
-        break;
-      }
+  if (vt1211_bound_foreign(ocb))
+    rc = VT1211_ERR_PERM;
+  else if (ocb->bind == VT1211_BIND_PIN)
+    rc = vt1211_pin_read(ctp, msg, ocb);
+  else
+    rc = vt1211_stream_read(ctp, msg, ocb->port);
 
-      if (!vt1211_pin_check_perm(pid, port_data) && vt1211_pin_is_busy(port_data)) {
-        debugf("Only owner can configure pin\n"); 
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+  vt1211_unlock(1 << ocb->port);
 
-      vt_pin_mode(port_data->port, port_data->pin, port_data->data);
+  return rc;
+}
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_SET_PIN: { 
-      debugf("Set port %d pin %d data %02X: ", port_data->port, port_data->pin, port_data->data);
+int io_write(resmgr_context_t *ctp, io_write_t *msg, RESMGR_OCB_T *ocb) {
+  int rc;
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  if ((rc = iofunc_write_verify(ctp, msg, &ocb->hdr, NULL)) != EOK)
+    return rc;
 
-      if (!vt1211_pin_check(port_data)) {
-        debugf("Incorrect pin\n");
-        rc = VT1211_ERR_INCRCT_PIN;
-        break;
-      }
+  if ((msg->i.xtype & _IO_XTYPE_MASK) != _IO_XTYPE_NONE)
+    return ENOSYS;
 
-      if (!vt1211_pin_check_perm(pid, port_data) && vt1211_pin_is_busy(port_data)) {
-        debugf("Only owner can set pin\n"); 
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+  if (ocb->bind == VT1211_BIND_BUS) {
+    vt1211_renew(ocb);
+    return vt1211_bus_write(ctp, msg, ocb);
+  }
 
-      vt_pin_set(port_data->port, port_data->pin, port_data->data);
+  if (ocb->bind != VT1211_BIND_PORT && ocb->bind != VT1211_BIND_PIN)
+    return ENXIO;
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_GET_PIN: {
-      debugf("Get port %d pin %d: ", port_data->port, port_data->pin);
+  vt1211_renew(ocb);
+  vt1211_lock(1 << ocb->port);
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  if (vt1211_bound_foreign(ocb))
+    rc = VT1211_ERR_PERM;
+  else if (ocb->bind == VT1211_BIND_PIN)
+    rc = vt1211_pin_write(ctp, msg, ocb);
+  else
+    rc = vt1211_stream_write(ctp, msg, ocb->port);
 
-      if (!vt1211_pin_check(port_data)) {
-        debugf("Incorrect pin\n");
-        rc = VT1211_ERR_INCRCT_PIN;
-        break;
-      }
+  vt1211_unlock(1 << ocb->port);
 
-      if (!vt1211_pin_check_perm(pid, port_data) && vt1211_pin_is_busy(port_data)) {
-        debugf("Only owner can get pin\n"); 
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+  return rc;
+}
 
-      port_data->data = vt_pin_get(port_data->port, port_data->pin);
+/*
+ * The attribute is shared by all the clients, so the default OCB locking
+ * (which locks the attribute) would serialize the whole resource manager.
+ * Only requests on the same descriptor are serialized, the ports have their
+ * own locks.
+ */
+int io_lock_ocb(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb) {
+  return pthread_mutex_lock(&ocb->lock);
+}
 
-      debugf("OK. Data: %02X\n", port_data->data);
-      nbytes = sizeof(gpio_data_t);
-      rc = EOK;
-      break;
-    }
-    case VT1211_REQ_PORT: {
-      debugf("Port %d request. Status: ", port_data->port);
+int io_unlock_ocb(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb) {
+  return pthread_mutex_unlock(&ocb->lock);
+}
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+int io_close_ocb(resmgr_context_t *ctp, void *reserved, RESMGR_OCB_T *ocb) {
+  vt1211_pattern_stop(ocb);
+  vt1211_pwm_remove(ocb);
+  vt1211_release(ocb);
+  vt1211_watch_remove(ocb);
+  vt1211_capture_remove(ocb);
+  iofunc_notify_remove(ctp, ocb->notify);
 
-      if (vt1211_port_is_busy(port_data)) {
-        debugf("Busy\n");
-        rc = VT1211_ERR_PORT_BUSY;
-        break;
-      }
+  return iofunc_close_ocb_default(ctp, reserved, &ocb->hdr);
+}
 
-      vt1211_port_set_busy(pid, port_data, true);
+vt1211_ocb_t *vt1211_ocb_calloc(resmgr_context_t *ctp, iofunc_attr_t *attr) {
+  vt1211_ocb_t *ocb = calloc(1, sizeof(vt1211_ocb_t));
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_FREE_PORT: {
-      debugf("Port %d free request. Status: ", port_data->port);
+  if (ocb != NULL) {
+    pthread_mutex_init(&ocb->lock, NULL);
+    IOFUNC_NOTIFY_INIT(ocb->notify);
+  }
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  return ocb;
+}
 
-      if (!vt1211_port_check_perm(pid, port_data)) {
-        debugf("Only owner can free port\n");
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+void vt1211_ocb_free(vt1211_ocb_t *ocb) {
+  free(ocb->stats_text);
+  pthread_mutex_destroy(&ocb->lock);
+  free(ocb);
+}
 
-      if (!vt1211_port_is_busy(port_data)) {
-        debugf("Already free\n");
-        rc = VT1211_ERR_ALREADY;
-        break;
-      }
+/*
+ * The OCB is bound to the port or the pin of the entry here, once. O_EXCL
+ * also requests the port or the pin for the descriptor, it fails with EBUSY
+ * if somebody else owns it.
+ */
+static int vt1211_open(resmgr_context_t *ctp, io_open_t *msg, vt1211_attr_t *node) {
+  vt1211_ocb_t  *ocb;
+  int           rc;
+
+  if ((rc = iofunc_open(ctp, msg, &node->attr, NULL, NULL)) != EOK)
+    return rc;
 
-      vt1211_port_set_busy(pid, port_data, false);
+  if ((ocb = vt1211_ocb_calloc(ctp, &node->attr)) == NULL)
+    return ENOMEM;
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_CONFIG_PORT: {
-      debugf("Config port %d: ", port_data->port);
+  ocb->bind  = node->bind;
+  ocb->port  = node->port;
+  ocb->pin   = node->pin;
+  ocb->scoid = ctp->info.scoid;
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  if ((node->bind == VT1211_BIND_PORT || node->bind == VT1211_BIND_PIN) && (msg->connect.ioflag & O_EXCL)) {
+    vt1211_renew(ocb);
+    vt1211_lock(1 << node->port);
 
-      if (!vt1211_port_check_perm(pid, port_data) && vt1211_port_is_busy(port_data)) {
-        debugf("Only owner can configure port\n");
-        rc = VT1211_ERR_PERM;
-        break;
-      }
+    if (node->bind == VT1211_BIND_PIN)
+      rc = vt1211_pin_request(ocb, node->port, __builtin_ctz(node->pin), ctp->info.pid);
+    else
+      rc = vt1211_port_request(ocb, node->port, ctp->info.pid);
 
-      vt_port_mode(port_data->port, port_data->data);
+    vt1211_unlock(1 << node->port);
 
-      debugf("OK\n");
-      rc = EOK;
+    if (rc != EOK) {
+      vt1211_ocb_free(ocb);
+      return EBUSY;
     }
-    case VT1211_SET_PORT: {
-      debugf("Set port %d Data %02X: ", port_data->port, port_data->data);
+  }
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  if ((rc = iofunc_ocb_attach(ctp, msg, ocb, &node->attr, NULL)) != EOK) {
+    vt1211_release(ocb);
+    vt1211_ocb_free(ocb);
+  }
 
-      if (!vt1211_port_check_perm(pid, port_data) && vt1211_port_is_busy(port_data)) {
-        debugf("Only owner can set port\n");
-        rc = VT1211_ERR_PERM;
-        break;
-      }      
+  return rc;
+}
 
-      vt_port_write(port_data->port, port_data->data);
+/*
+ * Returns true if a pin of the mask or the port is owned by a descriptor of
+ * another connection
+ */
+static bool vt1211_scoid_foreign(uint8_t port, uint8_t mask, int scoid) {
+  gpio_port_status_t *port_status = &ports_status[port];
 
-      debugf("OK\n");
-      rc = EOK;
-      break;
-    }
-    case VT1211_GET_PORT: {
-      debugf("Get port %d: ", port_data->port);
+  if (port_status->busy && port_status->owner->scoid != scoid && vt1211_port_foreign(port, NULL))
+    return true;
 
-      if (!vt1211_port_check(port_data)) {
-        debugf("Incorrect port\n");
-        rc = VT1211_ERR_INCRCT_PORT;
-        break;
-      }
+  for (uint8_t busy = port_status->pins_busy & mask; busy; busy &= busy - 1) {
+    int pin_index = __builtin_ctz(busy);
 
-      if (!vt1211_port_check_perm(pid, port_data) && vt1211_port_is_busy(port_data)) {
-        debugf("Only owner can set port\n");
-        rc = VT1211_ERR_PERM;
-        break;
-      }   
+    if (port_status->pins_owner[pin_index]->scoid != scoid && vt1211_pin_foreign(port, pin_index, NULL))
+      return true;
+  }
 
-      port_data->data = vt_port_read(port_data->port);
- 
-      debugf("OK. Data: %02X\n", port_data->data);
+  return false;
+}
 
-      nbytes = sizeof(gpio_data_t);
-      rc = EOK;
-      break;
-    }
-    default: {
-      rc = ENOSYS;
-      break;
-    }
+/*
+ * Renews the leases of the descriptors of the connection that hold the port
+ * or a pin of the mask, as a devctl on the descriptor would
+ */
+static void vt1211_scoid_renew(uint8_t port, uint8_t mask, int scoid) {
+  gpio_port_status_t *port_status = &ports_status[port];
+
+  if (port_status->busy && port_status->owner->scoid == scoid)
+    vt1211_renew(port_status->owner);
+
+  for (uint8_t busy = port_status->pins_busy & mask; busy; busy &= busy - 1) {
+    int pin_index = __builtin_ctz(busy);
+
+    if (port_status->pins_owner[pin_index]->scoid == scoid)
+      vt1211_renew(port_status->pins_owner[pin_index]);
   }
+}
 
-  if (rc != EOK)
-    return rc;
+/*
+ * VT1211_PULSE_MODIFY. There is no reply, so the pulse is dropped and counted
+ * if it can't be applied. The sender's connection stands for its descriptors
+ * in the ownership check.
+ */
+static int vt1211_pulse(message_context_t *ctp, int code, unsigned flags, void *handle) {
+  struct _pulse       *pulse        = (struct _pulse *) ctp->msg;
+  uint32_t            value         = pulse->value.sival_int;
+  uint8_t             op            = value >> 24;
+  uint8_t             port          = value >> 16;
+  uint8_t             mask          = value >> 8;
+  gpio_port_status_t  *port_status  = vt1211_port_status(port);
+  int                 rc;
+
+  if (port_status == NULL || (mask & ~port_status->pins) || op > VT1211_MODIFY_ASSIGN) {
+    vt1211_stats_pulse(EINVAL);
+    return 0;
+  }
 
-  memset(&msg->o, 0, sizeof (msg->o));
+  vt1211_lock(1 << port);
 
-  msg->o.ret_val = EOK;
-  msg->o.nbytes  = nbytes;
+  vt1211_scoid_renew(port, mask, pulse->scoid);
+
+  if (vt1211_scoid_foreign(port, mask, pulse->scoid)) {
+    rc = VT1211_ERR_PERM;
+  } else {
+    vt1211_port_modify(port, op, mask, value);
+    rc = EOK;
+  }
 
-  rc = _RESMGR_PTR (ctp, &msg->o, sizeof (msg->o) + nbytes);
+  vt1211_unlock(1 << port);
+
+  vt1211_stats_pulse(rc);
+  return 0;
+}
+
+int io_open(resmgr_context_t *ctp, io_open_t *msg, RESMGR_HANDLE_T *handle, void *extra) {
+  vt1211_attr_t *node = (vt1211_attr_t *) handle;
+  int           rc;
+
+  iofunc_attr_lock(&node->attr);
+  rc = vt1211_open(ctp, msg, node);
+  iofunc_attr_unlock(&node->attr);
 
   return rc;
 }
+
 void params_init(int argc, char **argv) {
   params.verbose  = 0;
   params.ports36  = 0;
+  params.nocache  = 0;
+  params.sample_rate  = 0;
+  params.sample_ports = 0x01;
+  params.refresh_ms   = 0;
+  params.threads      = 2;
+  params.debounce_us  = 1000;
+  params.lease_ms     = 0;
+  params.simulate     = 0;
+  params.trace        = 0;
+  params.config       = NULL;
   params.cir      = 0x002E;
   params.cdr      = 0x002F;
 
@@ -491,6 +1870,53 @@ void params_init(int argc, char **argv) {
         params.verbose = 1;
         break;
       }
+      case 'T': {
+        params.trace = 1;
+        break;
+      }
+      case 'c': {
+        params.config = optarg;
+        break;
+      }
+      case 's': {
+        params.nocache = 1;
+        break;
+      }
+      case 'f': {
+        params.sample_rate = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'm': {
+        params.sample_ports = (uint8_t) strtol(optarg, NULL, 16);
+        break;
+      }
+      case 'u': {
+        params.refresh_ms = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'b': {
+        params.debounce_us = (uint32_t) strtoul(optarg, NULL, 10);
+
+        if (params.debounce_us == 0)
+          params.debounce_us = 1;
+        break;
+      }
+      case 'l': {
+        params.lease_ms = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'S': {
+        params.simulate       = 1;
+        params.sim_latency_ns = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 't': {
+        params.threads = (uint16_t) strtoul(optarg, NULL, 10);
+
+        if (params.threads == 0)
+          params.threads = 1;
+        break;
+      }
       default: {
         break;
       }
@@ -501,10 +1927,16 @@ void params_init(int argc, char **argv) {
 }
 
 int vt1211_init() {
+  if (params.simulate) {
+    vt1211_hw = &vt1211_hw_sim;
+    vt1211_sim_latency(params.sim_latency_ns);
+  }
+
   debugf("==============================================\n");
+  debugf("Backend:\t\t%s\n", vt1211_hw->name);
   debugf("Request I/O privileges:\t");
 
-  if (!io_request()) {
+  if (!vt1211_hw->io_request()) {
     debugf("ERROR\n");
     return EXIT_FAILURE;
   } else {
@@ -517,39 +1949,28 @@ int vt1211_init() {
   int r;
 
   if (params.ports36) {
-    r = vt_init(VT_CONFIG_PORT_1 | VT_CONFIG_PORT_3_6, params.cir, params.cdr);
+    r = vt1211_hw->init(VT1211_HW_PORT_1 | VT1211_HW_PORT_3_6, params.cir, params.cdr);
   } else {
-    r = vt_init(VT_CONFIG_PORT_1, params.cir, params.cdr);
+    r = vt1211_hw->init(VT1211_HW_PORT_1, params.cir, params.cdr);
   }
 
   switch (r) {
-    case VT_INIT_NOT_FOUND: {
+    case VT1211_HW_INIT_NOT_FOUND: {
       debugf("ERROR VT1211 Not found\n");
       debugf("==============================================\n");
       return EXIT_FAILURE;
     }
-    case VT_INIT_NO_PORT: {
+    case VT1211_HW_INIT_NO_PORT: {
       debugf("ERROR No port selected\n");
       debugf("==============================================\n");
       return EXIT_FAILURE;
     }
-    case VT_INIT_OK:
+    case VT1211_HW_INIT_OK:
     default: {
       debugf("OK\n");
     }
   }
 
-  uint8_t pins[8] = {
-    VT1211_PIN_0,
-    VT1211_PIN_1,
-    VT1211_PIN_2,
-    VT1211_PIN_3,
-    VT1211_PIN_4,
-    VT1211_PIN_5,
-    VT1211_PIN_6,
-    VT1211_PIN_7,      
-  };
-
   ports_info.count = 1;
   ports_info.pins_by_port[VT1211_PORT_1] = 8;
   ports_info.pins_by_port[VT1211_PORT_3] = 8;
@@ -561,52 +1982,122 @@ int vt1211_init() {
     ports_info.count = 5;
   }
 
-  ports_status  = hashmap_create();
+  memset(ports_status, 0, sizeof(ports_status));
 
   for (int port = 0; port < ports_info.count; ++port) {
+    ports_status[port].pins = (uint8_t) ((1 << ports_info.pins_by_port[port]) - 1);
+    pthread_mutex_init(&ports_status[port].lock, NULL);
+  }
+
+  uint8_t   vt_id    = vt1211_hw->dev_id();
+  uint8_t   vt_rev   = vt1211_hw->dev_rev();
+  uint16_t  vt_base  = vt1211_hw->baddr();
 
-    gpio_port_status_t *port_status = malloc(sizeof(gpio_port_status_t));
-    uint8_t     port_id   = port;
-    struct hkey port_key  = {&port_id, sizeof(port_id)};
+  debugf("VT1211 ID: %02X, Revision: %02X, Base addr.: %04x\n", vt_id, vt_rev, vt_base);
 
-    port_status->busy = false;
-    port_status->pid  = NULL;
-    port_status->pins = hashmap_create();
+  if (params.config != NULL && vt1211_config_load(params.config) != EOK) {
+    debugf("==============================================\n");
+    return EXIT_FAILURE;
+  }
 
-    for (int i = 0; i < ports_info.pins_by_port[port]; ++i) {
-      uint8_t           pin_id   = pins[i];
-      struct hkey       pin_key  = {&pin_id, sizeof(pin_id)};
-      gpio_pin_status_t *pin     = malloc(sizeof(gpio_pin_status_t));
+  debugf("==============================================\n");
 
-      pin->busy = false;
-      pin->pid  = NULL;
+  return EXIT_SUCCESS;
+}
 
-      hashmap_set(port_status->pins, &pin_key, pin);
-    }
+/*
+ * /dev/vt1211/portN and /dev/vt1211/portN/pinM entries. N is the number of
+ * the GPIO port of the chip (1, 3..6), M is the pin number. And
+ * /dev/vt1211/trace and /dev/vt1211/stats.
+ */
+static int vt1211_attach_nodes(dispatch_t *dpp, resmgr_attr_t *resmgr_attr) {
+  static const uint8_t  names[VT1211_PORTS_MAX] = { 1, 3, 4, 5, 6 };
+  vt1211_attr_t         *node = nodes;
+  char                  path[32];
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    for (int pin = -1; pin < ports_info.pins_by_port[port]; ++pin, ++node) {
+      iofunc_attr_init(&node->attr, S_IFNAM | 0666, 0, 0);
+      node->attr.mount = &mount;
+      node->port = port;
+
+      if (pin < 0) {
+        node->bind = VT1211_BIND_PORT;
+        node->pin  = 0;
+        snprintf(path, sizeof(path), "/dev/vt1211/port%u", names[port]);
+      } else {
+        node->bind = VT1211_BIND_PIN;
+        node->pin  = 1 << pin;
+        snprintf(path, sizeof(path), "/dev/vt1211/port%u/pin%d", names[port], pin);
+      }
 
-    hashmap_set(ports_status, &port_key, port_status);
+      if (resmgr_attach(dpp, resmgr_attr, path, _FTYPE_ANY, 0, &connect_funcs, &io_funcs, node) == -1)
+        return errno;
+    }
   }
 
-  uint8_t   vt_id    = vt_get_dev_id();
-  uint8_t   vt_rev   = vt_get_dev_rev();
-  uint16_t  vt_base  = vt_get_baddr();
+  iofunc_attr_init(&trace_node.attr, S_IFNAM | 0444, 0, 0);
+  trace_node.attr.mount = &mount;
+  trace_node.bind       = VT1211_BIND_TRACE;
 
-  debugf("VT1211 ID: %02X, Revision: %02X, Base addr.: %04x\n", vt_id, vt_rev, vt_base);
-  debugf("==============================================\n");
+  if (resmgr_attach(dpp, resmgr_attr, "/dev/vt1211/trace", _FTYPE_ANY, 0, &connect_funcs, &io_funcs, &trace_node) == -1)
+    return errno;
 
-  return EXIT_SUCCESS;
+  iofunc_attr_init(&stats_node.attr, S_IFNAM | 0444, 0, 0);
+  stats_node.attr.mount = &mount;
+  stats_node.bind       = VT1211_BIND_STATS;
+
+  if (resmgr_attach(dpp, resmgr_attr, "/dev/vt1211/stats", _FTYPE_ANY, 0, &connect_funcs, &io_funcs, &stats_node) == -1)
+    return errno;
+
+  return EOK;
 }
 
 int main(int argc, char **argv) {
   params_init(argc, argv);
 
+  if (vt1211_trace_init() != EOK) {
+    fprintf(stderr, "%s: Unable to set up the trace.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
   if (vt1211_init() != EXIT_SUCCESS) {
     return EXIT_FAILURE;
   }
 
+  if (vt1211_shm_init() != EOK) {
+    fprintf(stderr, "%s: Unable to publish the state in %s.\n", argv[0], VT1211_STATE_SHM);
+  }
+
+  if (vt1211_pattern_start() != EOK) {
+    fprintf(stderr, "%s: Unable to start the pattern player.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (vt1211_pwm_start() != EOK) {
+    fprintf(stderr, "%s: Unable to start the PWM engine.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (vt1211_watch_start() != EOK) {
+    fprintf(stderr, "%s: Unable to start the input scanner.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (vt1211_capture_start() != EOK) {
+    fprintf(stderr, "%s: Unable to start the edge capture.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (params.sample_rate && vt1211_sampler_start() != EOK) {
+    fprintf(stderr, "%s: Unable to start the sampler.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
   resmgr_attr_t        resmgr_attr;
   dispatch_t           *dpp;
-  dispatch_context_t   *ctp;
+  thread_pool_attr_t   pool_attr;
+  thread_pool_t        *tpp;
   int                  id;
 
   if((dpp = dispatch_create()) == NULL) {
@@ -616,12 +2107,27 @@ int main(int argc, char **argv) {
 
   memset(&resmgr_attr, 0, sizeof resmgr_attr);
   resmgr_attr.nparts_max      = 1;
-  resmgr_attr.msg_max_size    = 1024;
+  resmgr_attr.msg_max_size    = sizeof(io_devctl_t) + sizeof(gpio_batch_t) +
+                                VT1211_BATCH_MAX * sizeof(gpio_batch_op_t);
 
   iofunc_func_init(_RESMGR_CONNECT_NFUNCS, &connect_funcs, _RESMGR_IO_NFUNCS, &io_funcs);
-  iofunc_attr_init(&attr, S_IFNAM | 0666, 0, 0);
+  iofunc_attr_init(&attr.attr, S_IFNAM | 0666, 0, 0);
+
+  ocb_funcs.nfuncs      = _IOFUNC_NFUNCS;
+  ocb_funcs.ocb_calloc  = vt1211_ocb_calloc;
+  ocb_funcs.ocb_free    = vt1211_ocb_free;
+  mount.funcs           = &ocb_funcs;
+  attr.attr.mount       = &mount;
 
-  io_funcs.devctl = io_devctl;
+  connect_funcs.open  = io_open;
+
+  io_funcs.devctl     = io_devctl;
+  io_funcs.read       = io_read;
+  io_funcs.write      = io_write;
+  io_funcs.notify     = io_notify;
+  io_funcs.close_ocb  = io_close_ocb;
+  io_funcs.lock_ocb   = io_lock_ocb;
+  io_funcs.unlock_ocb = io_unlock_ocb;
 
   id = resmgr_attach(
             dpp,            /* dispatch handle        */
@@ -638,13 +2144,34 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
 
-  ctp = dispatch_context_alloc(dpp);
+  if (vt1211_attach_nodes(dpp, &resmgr_attr) != EOK) {
+    fprintf(stderr, "%s: Unable to attach the port and pin names.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  while(1) {
-    if((ctp = dispatch_block(ctp)) == NULL) {
-      fprintf(stderr, "block error\n");
-      return EXIT_FAILURE;
-    }
-    dispatch_handler(ctp);
+  if (pulse_attach(dpp, 0, VT1211_PULSE_MODIFY, vt1211_pulse, NULL) == -1) {
+    fprintf(stderr, "%s: Unable to attach the pulse handler.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memset(&pool_attr, 0, sizeof pool_attr);
+  pool_attr.handle        = dpp;
+  pool_attr.context_alloc = dispatch_context_alloc;
+  pool_attr.block_func    = dispatch_block;
+  pool_attr.unblock_func  = dispatch_unblock;
+  pool_attr.handler_func  = dispatch_handler;
+  pool_attr.context_free  = dispatch_context_free;
+  pool_attr.lo_water      = 1;
+  pool_attr.increment     = 1;
+  pool_attr.hi_water      = params.threads;
+  pool_attr.maximum       = params.threads;
+
+  if((tpp = thread_pool_create(&pool_attr, POOL_FLAG_EXIT_SELF)) == NULL) {
+    fprintf(stderr, "%s: Unable to create the thread pool.\n", argv[0]);
+    return EXIT_FAILURE;
   }
+
+  thread_pool_start(tpp);
+
+  return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,240 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+#ifndef VT1211_NTO_H
+#define VT1211_NTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+struct vt1211_ocb;
+#define IOFUNC_OCB_T        struct vt1211_ocb
+#define RESMGR_OCB_T        struct vt1211_ocb
+#define THREAD_POOL_PARAM_T dispatch_context_t
+
+#include <sys/iofunc.h>
+#include <sys/dispatch.h>
+#include "vt1211_ipc.h"
+#include "vt1211_hw.h"
+
+#define VT1211_CHECK_PIN        0x01 // pin must be a valid pin of the port
+#define VT1211_CHECK_PIN_PERM   0x02 // pin must be free or owned by the caller
+#define VT1211_CHECK_PORT_PERM  0x04 // port must be free or owned by the caller
+#define VT1211_CHECK_MASK_PERM  0x08 // every pin of the mask must be free or owned by the caller
+
+typedef struct {
+  uint16_t cir;
+  uint16_t cdr;
+  uint8_t  ports36;
+  uint8_t  verbose;
+  uint8_t  nocache;
+  uint32_t sample_rate;               // sampler rate, Hz. 0 - sampler is off
+  uint8_t  sample_ports;              // sampled ports mask
+  uint32_t refresh_ms;                // published inputs refresh period. 0 - off
+  uint16_t threads;                   // resource manager threads
+  uint32_t debounce_us;               // debounce filter step
+  uint32_t lease_ms;                  // ownership lease. 0 - ownership doesn't expire
+  uint8_t  simulate;                  // simulated chip instead of the hardware
+  uint8_t  trace;                     // request trace is on at start
+  uint32_t sim_latency_ns;            // simulated I/O access latency
+  const char *config;                 // startup configuration file
+} params_t;
+
+/*
+ * Port state. lock serializes the ownership checks and changes, the shadow
+ * and the hardware access of the port. Requests touching several ports take
+ * the locks in ascending port order.
+ */
+typedef struct {
+  pthread_mutex_t   lock;
+  uint8_t           pins;                       // valid pins mask
+  bool              busy;                       // port is requested
+  struct vt1211_ocb *owner;                     // port owner
+  pid_t             pid;                        // process of the port owner
+  uint8_t           pins_busy;                  // requested pins mask
+  struct vt1211_ocb *pins_owner[VT1211_PINS_MAX]; // pin owners, indexed by pin number
+  pid_t             pins_pid[VT1211_PINS_MAX];
+  uint8_t           dir;                        // output pins mask, valid for dir_known pins
+  uint8_t           dir_known;                  // pins configured through the driver
+  uint8_t           latch;                      // shadow of the output latch
+  bool              latch_valid;
+} gpio_port_status_t;
+
+/*
+ * Pathname entry: /dev/vt1211 itself (VT1211_BIND_NONE), /dev/vt1211/portN
+ * or /dev/vt1211/portN/pinM. The port and the pin are valid, they are checked
+ * when the entries are attached.
+ */
+typedef struct {
+  iofunc_attr_t     attr;
+  uint8_t           bind;                       // binding of the descriptors opened here
+  uint8_t           port;
+  uint8_t           pin;
+} vt1211_attr_t;
+
+typedef struct vt1211_ocb {
+  iofunc_ocb_t      hdr;
+  pthread_mutex_t   lock;                       // serializes requests on the descriptor
+  uint8_t           held_pins[VT1211_PORTS_MAX];  // owned pins, guarded by the port locks
+  bool              held_port[VT1211_PORTS_MAX];  // owned ports, guarded by the port locks
+  uint64_t          lease;                      // ownership lease expiry, ns
+  uint8_t           bind;                       // VT1211_BIND_*
+  uint8_t           port;                       // bound port for io_read/io_write
+  uint8_t           pin;                        // bound pin (VT1211_BIND_PIN)
+  uint32_t          sample_tail;                // next sampler record to read
+  uint32_t          sample_overflow;            // records lost since the last read
+  iofunc_notify_t   notify[3];
+  struct vt1211_ocb *watch_next;                // next subscriber of the scanner
+  gpio_watch_t      watch;
+  gpio_events_t     events;                     // pending edges
+  char              *stats_text;                // /dev/vt1211/stats snapshot being read
+  size_t            stats_len;
+  gpio_bus_t        bus;                        // bus master (VT1211_BIND_BUS)
+  int               scoid;                      // connection of the client, identifies its pulses
+  struct vt1211_capture *capture;               // edge capture subscription
+} vt1211_ocb_t;
+
+extern params_t             params;
+extern gpio_port_status_t   ports_status[VT1211_PORTS_MAX];
+extern gpio_portsinfo_t     ports_info;
+
+void vt1211_debugf(const char *format, ... );
+
+// the arguments are evaluated only with -v
+#define debugf(...) do { if (params.verbose) vt1211_debugf(__VA_ARGS__); } while (0)
+
+static inline uint64_t vt1211_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// vt1211_nto.c
+
+void      vt1211_lock(uint8_t ports);
+void      vt1211_unlock(uint8_t ports);
+int       vt1211_check(vt1211_ocb_t *ocb, uint8_t port, uint8_t pin, int flags);
+void      vt1211_release(vt1211_ocb_t *ocb);
+uint8_t   vt1211_port_modify(uint8_t port, uint8_t op, uint8_t mask, uint8_t value);
+void      vt1211_port_dir(uint8_t port, uint8_t mask, uint8_t dir);
+void      vt1211_ports_dir(uint8_t ports, const uint8_t *mask, const uint8_t *dir);
+void      vt1211_reserve(uint8_t port, uint8_t pins);
+uint8_t   vt1211_port_read(uint8_t port);
+void      vt1211_ports_sample(uint8_t ports, uint8_t *values, uint64_t *stamps);
+
+// vt1211_sampler.c
+
+int       vt1211_sampler_start(void);
+void      vt1211_sampler_attach(vt1211_ocb_t *ocb);
+uint32_t  vt1211_sampler_read(vt1211_ocb_t *ocb, gpio_sample_t *samples, uint32_t count);
+
+// vt1211_notify.c
+
+int       vt1211_watch_start(void);
+int       vt1211_watch(vt1211_ocb_t *ocb, gpio_watch_t *watch);
+void      vt1211_watch_events(vt1211_ocb_t *ocb, gpio_events_t *events);
+void      vt1211_watch_remove(vt1211_ocb_t *ocb);
+int       vt1211_debounce(gpio_debounce_t *debounce);
+uint8_t   vt1211_debounce_merge(uint8_t port, uint8_t raw);
+uint8_t   vt1211_debounce_pins(uint8_t port);
+void      vt1211_watch_trigger(vt1211_ocb_t *ocb);
+int       io_notify(resmgr_context_t *ctp, io_notify_t *msg, RESMGR_OCB_T *ocb);
+
+// vt1211_capture.c
+
+int       vt1211_capture_start(void);
+int       vt1211_capture(vt1211_ocb_t *ocb, gpio_capture_t *sub);
+void      vt1211_capture_remove(vt1211_ocb_t *ocb);
+uint32_t  vt1211_capture_read(vt1211_ocb_t *ocb, gpio_edge_t *edges, uint32_t count);
+bool      vt1211_capture_pending(vt1211_ocb_t *ocb);
+void      vt1211_capture_stats(vt1211_ocb_t *ocb, gpio_capture_stats_t *stats);
+
+// vt1211_shm.c
+
+int       vt1211_shm_init(void);
+void      vt1211_shm_publish(uint8_t port);
+void      vt1211_shm_latch(uint8_t port, uint8_t value);
+void      vt1211_shm_input(uint8_t port, uint8_t value);
+
+// vt1211_pattern.c
+
+int       vt1211_pattern_start(void);
+int       vt1211_pattern_play(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb);
+void      vt1211_pattern_take(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins);
+void      vt1211_pattern_status(gpio_pattern_status_t *status);
+int       vt1211_pattern_stop(vt1211_ocb_t *ocb);
+
+// vt1211_pwm.c
+
+int       vt1211_pwm_start(void);
+int       vt1211_pwm_config(vt1211_ocb_t *ocb, gpio_pwm_t *pwm);
+void      vt1211_pwm_release(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins);
+void      vt1211_pwm_take(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins);
+void      vt1211_pwm_remove(vt1211_ocb_t *ocb);
+
+// vt1211_bus.c
+
+int       vt1211_bus_config(vt1211_ocb_t *ocb, gpio_bus_t *bus);
+int       vt1211_bus_transfer(vt1211_ocb_t *ocb, uint8_t addr, uint8_t *data, size_t wlen, size_t rlen);
+int       vt1211_bus_read(resmgr_context_t *ctp, io_read_t *msg, vt1211_ocb_t *ocb);
+int       vt1211_bus_write(resmgr_context_t *ctp, io_write_t *msg, vt1211_ocb_t *ocb);
+
+// vt1211_group.c
+
+int       vt1211_group_verify(const gpio_group_t *group);
+int       vt1211_group_define(gpio_group_t *group);
+int       vt1211_group_find(gpio_group_t *group);
+int       vt1211_group_write(vt1211_ocb_t *ocb, uint32_t id, uint32_t value);
+int       vt1211_group_read(vt1211_ocb_t *ocb, uint32_t id, uint32_t *value);
+
+// vt1211_config.c
+
+int       vt1211_config_load(const char *path);
+
+// vt1211_trace.c
+
+extern bool vt1211_tracing;
+
+int       vt1211_trace_init(void);
+void      vt1211_trace_record(uint32_t dcmd, pid_t pid, uint8_t port, uint8_t pin, uint8_t data, int result);
+uint32_t  vt1211_trace_read(gpio_trace_t *records, uint32_t count);
+
+static inline void vt1211_trace(uint32_t dcmd, pid_t pid, uint8_t port, uint8_t pin, uint8_t data, int result) {
+  if (__atomic_load_n(&vt1211_tracing, __ATOMIC_RELAXED))
+    vt1211_trace_record(dcmd, pid, port, pin, data, result);
+}
+
+// vt1211_stats.c
+
+void      vt1211_stats_record(uint32_t dcmd, bool known, pid_t pid, int rc, uint64_t cycles, uint32_t hw_calls);
+int       vt1211_stats_get(gpio_stats_t *stats);
+void      vt1211_stats_reset(void);
+char     *vt1211_stats_text(size_t *len);
+void      vt1211_stats_pulse(int rc);
+
+#endif
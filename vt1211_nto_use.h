@@ -28,10 +28,28 @@ Options:
  -i   CIR Configuration Index Register (hex). Default is 0x002E
  -d   CDR Configuration Data Register (hex).  Default is 0x002F
  -p   Ports 3..6 enable
+ -s   Disable the shadow register cache
+ -f   Input sampler rate, Hz. Default is 0 (off)
+ -m   Ports sampled by the input sampler (hex mask). Default is 0x01
+ -u   Refresh period of the inputs published in /dev/shmem/vt1211_state, ms.
+      Default is 0 (only the driver's own reads and writes are published)
+ -b   Debounce filter step, us. Default is 1000
+ -l   Ownership lease, ms. A pin or port owner that sends no request for this
+      time loses it to the next client. Default is 0 (no lease, ownership
+      ends with free or close of the descriptor)
+ -S   Run on a simulated chip instead of the hardware, the argument is the
+      latency of a simulated I/O access in ns (e.g. -S 1000)
+ -t   Resource manager threads. Default is 2
+ -T   Start with the request trace on (read it from /dev/vt1211/trace,
+      decode with vt1211_tracedump). VT1211_TRACE turns it on and off
+ -c   Startup configuration file: directions, initial output levels, pin
+      groups and reserved pins, applied before /dev/vt1211 appears
  -v   Verbose
 
 Examples:
 %C -p
 %C -p -v
 %C -p -v -i 0x002E -d 0x002F
+%C -p -f 20000 -m 0x03
+%C -p -c /etc/vt1211.conf
 #endif
@@ -0,0 +1,287 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Waveform/pattern player.
+ *
+ * The client uploads a table of steps once, a high priority thread plays it
+ * against the port on an absolute schedule (start of the run plus the sum of
+ * the delays), so the edges don't carry IPC and scheduling jitter of the
+ * client. The last few microseconds before a step are spun instead of slept
+ * to get below the system tick. The lateness of every step is measured and
+ * reported in the status.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "vt1211_nto.h"
+
+#define VT1211_PATTERN_PRIO     60
+#define VT1211_PATTERN_SPIN_NS  20000
+
+static pthread_mutex_t        pattern_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t         pattern_cond;
+static gpio_pattern_t         *pattern;           // table being played
+static vt1211_ocb_t           *pattern_owner;     // descriptor that started it
+static bool                   pattern_stopping;
+static gpio_pattern_status_t  pattern_state;
+
+/*
+ * Waits until the time (ns) or until the run is stopped, with pattern_lock
+ * held. Returns false if the run is stopped.
+ */
+static bool vt1211_pattern_wait(uint64_t until) {
+  struct timespec ts;
+
+  while (!pattern_stopping) {
+    uint64_t now = vt1211_now();
+
+    if (now >= until)
+      return true;
+
+    if (until - now <= VT1211_PATTERN_SPIN_NS)
+      continue;
+
+    ts.tv_sec   = (until - VT1211_PATTERN_SPIN_NS) / 1000000000ULL;
+    ts.tv_nsec  = (until - VT1211_PATTERN_SPIN_NS) % 1000000000ULL;
+
+    pthread_cond_timedwait(&pattern_cond, &pattern_lock, &ts);
+  }
+
+  return false;
+}
+
+static void vt1211_pattern_run(void) {
+  uint8_t   port  = pattern->port;
+  uint64_t  start = vt1211_now();
+  uint64_t  next  = 0;
+
+  for (uint32_t loop = 0; pattern->repeat == 0 || loop < pattern->repeat; ++loop) {
+    for (uint32_t i = 0; i < pattern->count; ++i) {
+      gpio_pattern_step_t step = pattern->steps[i];
+
+      if (!vt1211_pattern_wait(start + next))
+        return;
+
+      // The port lock is taken before pattern_lock elsewhere
+      pthread_mutex_unlock(&pattern_lock);
+
+      // Pins taken by another descriptor are masked off under the port lock
+      vt1211_lock(1 << port);
+      vt1211_port_modify(port, VT1211_MODIFY_ASSIGN, pattern->steps[i].mask, step.value);
+
+      // The edge is out once the write returns, lock waits count as late
+      uint64_t written = vt1211_now();
+
+      vt1211_unlock(1 << port);
+
+      pthread_mutex_lock(&pattern_lock);
+
+      uint64_t late = written - start - next;
+
+      pattern_state.loop            = loop;
+      pattern_state.step            = i;
+      pattern_state.steps          += 1;
+      pattern_state.total_late_ns  += late;
+      pattern_state.requested_ns    = next;
+      pattern_state.elapsed_ns      = written - start;
+
+      if (late > pattern_state.max_late_ns)
+        pattern_state.max_late_ns = late > UINT32_MAX ? UINT32_MAX : (uint32_t) late;
+
+      next += step.delay_ns;
+    }
+  }
+}
+
+static void *vt1211_pattern_thread(void *arg) {
+  pthread_mutex_lock(&pattern_lock);
+
+  while (1) {
+    while (pattern == NULL) {
+      pthread_cond_wait(&pattern_cond, &pattern_lock);
+    }
+
+    vt1211_pattern_run();
+
+    free(pattern);
+
+    pattern                 = NULL;
+    pattern_owner           = NULL;
+    pattern_stopping        = false;
+    pattern_state.running   = 0;
+
+    pthread_cond_broadcast(&pattern_cond);
+  }
+
+  return NULL;
+}
+
+int vt1211_pattern_start(void) {
+  pthread_condattr_t  cond_attr;
+  pthread_attr_t      attr;
+  struct sched_param  param;
+  pthread_t           thread;
+
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pattern_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  param.sched_priority = VT1211_PATTERN_PRIO;
+  pthread_attr_setschedparam(&attr, &param);
+
+  int rc = pthread_create(&thread, &attr, vt1211_pattern_thread, NULL);
+
+  pthread_attr_destroy(&attr);
+
+  return rc;
+}
+
+/*
+ * VT1211_PLAY_PATTERN. The table is read straight from the client into its
+ * own buffer, so its size is not limited by the receive buffer. Called with
+ * the port locked.
+ */
+int vt1211_pattern_play(resmgr_context_t *ctp, io_devctl_t *msg, vt1211_ocb_t *ocb) {
+  gpio_pattern_t  *header = (gpio_pattern_t *) _DEVCTL_DATA (msg->i);
+  gpio_pattern_t  *table;
+  size_t          size;
+  uint64_t        period  = 0;
+  uint8_t         mask    = 0;
+  int             rc;
+
+  if (msg->i.nbytes < sizeof(gpio_pattern_t) || header->count == 0)
+    return EINVAL;
+
+  if (header->count > VT1211_PATTERN_MAX)
+    return E2BIG;
+
+  size = sizeof(gpio_pattern_t) + header->count * sizeof(gpio_pattern_step_t);
+
+  if (msg->i.nbytes < size)
+    return EINVAL;
+
+  if ((table = malloc(size)) == NULL)
+    return ENOMEM;
+
+  if (resmgr_msgread(ctp, table, size, sizeof(msg->i)) != (int) size) {
+    free(table);
+    return EFAULT;
+  }
+
+  for (uint32_t i = 0; i < table->count; ++i) {
+    mask   |= table->steps[i].mask;
+    period += table->steps[i].delay_ns;
+  }
+
+  // A short table looping at SCHED_FIFO would never leave the CPU
+  if (table->repeat != 1 && period < VT1211_PATTERN_PERIOD) {
+    free(table);
+    return EINVAL;
+  }
+
+  // The port is checked with the request, the pins only once the steps are in
+  if ((rc = vt1211_check(ocb, table->port, mask, VT1211_CHECK_MASK_PERM)) != EOK) {
+    free(table);
+    return rc;
+  }
+
+  pthread_mutex_lock(&pattern_lock);
+
+  if (pattern != NULL) {
+    pthread_mutex_unlock(&pattern_lock);
+    free(table);
+    return EBUSY;
+  }
+
+  memset(&pattern_state, 0, sizeof(pattern_state));
+  pattern_state.running = 1;
+  pattern_state.port    = table->port;
+
+  pattern       = table;
+  pattern_owner = ocb;
+
+  pthread_cond_broadcast(&pattern_cond);
+  pthread_mutex_unlock(&pattern_lock);
+
+  debugf("Pattern on port %d: %u steps, repeat %u\n", table->port, table->count, table->repeat);
+
+  return EOK;
+}
+
+/*
+ * The pins of the port go to the descriptor: a run started by another one
+ * leaves them alone from its next step on. Called with the port locked.
+ */
+void vt1211_pattern_take(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins) {
+  pthread_mutex_lock(&pattern_lock);
+
+  if (pattern != NULL && pattern_owner != ocb && pattern->port == port) {
+    for (uint32_t i = 0; i < pattern->count; ++i) {
+      pattern->steps[i].mask &= ~pins;
+    }
+  }
+
+  pthread_mutex_unlock(&pattern_lock);
+}
+
+void vt1211_pattern_status(gpio_pattern_status_t *status) {
+  pthread_mutex_lock(&pattern_lock);
+  *status = pattern_state;
+  pthread_mutex_unlock(&pattern_lock);
+}
+
+/*
+ * Stops the current run if the descriptor started it and waits for the
+ * player to finish it. Returns EOK or VT1211_ERR_PERM.
+ */
+int vt1211_pattern_stop(vt1211_ocb_t *ocb) {
+  int rc = EOK;
+
+  pthread_mutex_lock(&pattern_lock);
+
+  if (pattern != NULL && pattern_owner != ocb) {
+    rc = VT1211_ERR_PERM;
+  } else if (pattern != NULL) {
+    pattern_stopping = true;
+    pthread_cond_broadcast(&pattern_cond);
+
+    while (pattern != NULL) {
+      pthread_cond_wait(&pattern_cond, &pattern_lock);
+    }
+  }
+
+  pthread_mutex_unlock(&pattern_lock);
+
+  return rc;
+}
@@ -0,0 +1,297 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Software PWM.
+ *
+ * All the channels are run by one thread. Every channel knows the time of
+ * its next edge; the thread sleeps until the earliest one, then collects
+ * every edge that is due, folds them into one set/clear mask per port and
+ * writes each touched port once. A new period/duty is only picked up at the
+ * channel's period boundary, so a change never produces a short or a long
+ * pulse.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "vt1211_nto.h"
+
+#define VT1211_PWM_PRIO   55
+
+typedef struct {
+  bool      active;
+  bool      boundary;           // next edge is a period boundary, otherwise the end of duty
+  uint64_t  period;             // ns, in effect
+  uint64_t  duty;
+  uint64_t  new_period;         // ns, taken at the next boundary
+  uint64_t  new_duty;
+  uint64_t  start;              // start of the current period
+  uint64_t  next;               // time of the next edge
+  vt1211_ocb_t *owner;          // descriptor that configured it, NULL once released
+} vt1211_pwm_t;
+
+static pthread_mutex_t  pwm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   pwm_cond;
+static vt1211_pwm_t     pwm[VT1211_PORTS_MAX][VT1211_PINS_MAX];
+static uint32_t         pwm_active;
+
+/*
+ * Advances the channel over its due edge. Returns 1 if the pin goes high,
+ * 0 if it goes low.
+ */
+static int vt1211_pwm_edge(vt1211_pwm_t *ch, uint64_t now) {
+  if (!ch->boundary) {
+    ch->boundary  = true;
+    ch->next      = ch->start + ch->period;
+    return 0;
+  }
+
+  // Fell more than a period behind, start over from now
+  ch->start   = ch->next + ch->new_period < now ? now : ch->next;
+  ch->period  = ch->new_period;
+  ch->duty    = ch->new_duty;
+
+  if (ch->period == 0) {
+    ch->active = false;
+    pwm_active--;
+    return 0;
+  }
+
+  ch->next = ch->start + ch->period;
+
+  if (ch->duty == 0)
+    return 0;
+
+  if (ch->duty < ch->period) {
+    ch->boundary  = false;
+    ch->next      = ch->start + ch->duty;
+  }
+
+  return 1;
+}
+
+static void *vt1211_pwm_thread(void *arg) {
+  struct timespec ts;
+
+  pthread_mutex_lock(&pwm_lock);
+
+  while (1) {
+    uint64_t next = UINT64_MAX;
+
+    if (pwm_active == 0) {
+      pthread_cond_wait(&pwm_cond, &pwm_lock);
+      continue;
+    }
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      for (uint8_t pin = 0; pin < VT1211_PINS_MAX; ++pin) {
+        if (pwm[port][pin].active && pwm[port][pin].next < next)
+          next = pwm[port][pin].next;
+      }
+    }
+
+    uint64_t now = vt1211_now();
+
+    if (next > now) {
+      ts.tv_sec   = next / 1000000000ULL;
+      ts.tv_nsec  = next % 1000000000ULL;
+
+      // Channels changed, find the earliest edge again
+      if (pthread_cond_timedwait(&pwm_cond, &pwm_lock, &ts) == EOK)
+        continue;
+
+      now = vt1211_now();
+    }
+
+    uint8_t mask[VT1211_PORTS_MAX]  = {0};
+    uint8_t value[VT1211_PORTS_MAX] = {0};
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      for (uint8_t pin = 0; pin < VT1211_PINS_MAX; ++pin) {
+        vt1211_pwm_t *ch = &pwm[port][pin];
+
+        if (!ch->active || ch->next > now)
+          continue;
+
+        mask[port] |= 1 << pin;
+
+        if (vt1211_pwm_edge(ch, now))
+          value[port] |= 1 << pin;
+      }
+    }
+
+    // The port locks are taken before pwm_lock elsewhere
+    pthread_mutex_unlock(&pwm_lock);
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (mask[port] == 0)
+        continue;
+
+      vt1211_lock(1 << port);
+
+      // Drop the edges of the channels released since they were collected
+      pthread_mutex_lock(&pwm_lock);
+
+      for (uint8_t pins = mask[port]; pins; pins &= pins - 1) {
+        if (pwm[port][__builtin_ctz(pins)].owner == NULL)
+          mask[port] &= ~(pins & -pins);
+      }
+
+      pthread_mutex_unlock(&pwm_lock);
+
+      if (mask[port] != 0)
+        vt1211_port_modify(port, VT1211_MODIFY_ASSIGN, mask[port], value[port]);
+
+      vt1211_unlock(1 << port);
+    }
+
+    pthread_mutex_lock(&pwm_lock);
+  }
+
+  return NULL;
+}
+
+int vt1211_pwm_start(void) {
+  pthread_condattr_t  cond_attr;
+  pthread_attr_t      attr;
+  struct sched_param  param;
+  pthread_t           thread;
+
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pwm_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  param.sched_priority = VT1211_PWM_PRIO;
+  pthread_attr_setschedparam(&attr, &param);
+
+  int rc = pthread_create(&thread, &attr, vt1211_pwm_thread, NULL);
+
+  pthread_attr_destroy(&attr);
+
+  return rc;
+}
+
+/*
+ * VT1211_PWM_CONFIG. The port and pin are already checked.
+ */
+int vt1211_pwm_config(vt1211_ocb_t *ocb, gpio_pwm_t *config) {
+  vt1211_pwm_t *ch = &pwm[config->port][__builtin_ctz(config->pin)];
+
+  if (config->duty_us > config->period_us)
+    return EINVAL;
+
+  pthread_mutex_lock(&pwm_lock);
+
+  ch->new_period  = config->period_us * 1000ULL;
+  ch->new_duty    = config->duty_us * 1000ULL;
+  ch->owner       = ocb;
+
+  // A stopped channel starts right away with a period boundary
+  if (!ch->active && ch->new_period != 0) {
+    ch->active    = true;
+    ch->boundary  = true;
+    ch->next      = vt1211_now();
+    pwm_active++;
+
+    pthread_cond_signal(&pwm_cond);
+  }
+
+  pthread_mutex_unlock(&pwm_lock);
+
+  return EOK;
+}
+
+/*
+ * Stops the channels of the pins configured by the descriptor right away,
+ * the pins are left at their level. Called with the port locked.
+ */
+void vt1211_pwm_release(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins) {
+  pthread_mutex_lock(&pwm_lock);
+
+  for (; pins; pins &= pins - 1) {
+    vt1211_pwm_t *ch = &pwm[port][__builtin_ctz(pins)];
+
+    if (ch->owner != ocb)
+      continue;
+
+    if (ch->active) {
+      ch->active = false;
+      pwm_active--;
+    }
+
+    ch->owner = NULL;
+  }
+
+  pthread_cond_signal(&pwm_cond);
+  pthread_mutex_unlock(&pwm_lock);
+}
+
+/*
+ * The pins of the port go to the descriptor: the channels other descriptors
+ * configured on them stop right away. Called with the port locked.
+ */
+void vt1211_pwm_take(vt1211_ocb_t *ocb, uint8_t port, uint8_t pins) {
+  pthread_mutex_lock(&pwm_lock);
+
+  for (; pins; pins &= pins - 1) {
+    vt1211_pwm_t *ch = &pwm[port][__builtin_ctz(pins)];
+
+    if (ch->owner == NULL || ch->owner == ocb)
+      continue;
+
+    if (ch->active) {
+      ch->active = false;
+      pwm_active--;
+    }
+
+    ch->owner = NULL;
+  }
+
+  pthread_cond_signal(&pwm_cond);
+  pthread_mutex_unlock(&pwm_lock);
+}
+
+/*
+ * Stops all the channels of a closing descriptor, including the ones on
+ * pins it didn't own
+ */
+void vt1211_pwm_remove(vt1211_ocb_t *ocb) {
+  uint8_t ports = (1 << ports_info.count) - 1;
+
+  vt1211_lock(ports);
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    vt1211_pwm_release(ocb, port, 0xFF);
+  }
+
+  vt1211_unlock(ports);
+}
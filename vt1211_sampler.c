@@ -0,0 +1,169 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Background input sampler.
+ *
+ * A single thread reads the selected ports at a fixed rate and appends the
+ * samples to a ring. The sampler is the only writer and never waits for the
+ * readers: every client keeps its own read position (in the OCB), and a
+ * client that falls more than a ring behind loses the oldest records and
+ * gets them reported as overflow.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/neutrino.h>
+#include "vt1211_nto.h"
+
+#define VT1211_SAMPLER_RING   16384 // records, power of 2
+#define VT1211_SAMPLER_PRIO   50
+
+static gpio_sample_t  ring[VT1211_SAMPLER_RING];
+static uint32_t       ring_head;    // number of records ever written
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns) {
+  ns          += ts->tv_nsec;
+  ts->tv_sec  += ns / 1000000000;
+  ts->tv_nsec  = ns % 1000000000;
+}
+
+static void *vt1211_sampler_thread(void *arg) {
+  uint64_t        period  = 1000000000ULL / params.sample_rate;
+  uint32_t        head    = 0;
+  struct timespec next;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while (1) {
+    timespec_add_ns(&next, period);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    uint64_t  timestamp = ClockCycles();
+    uint8_t   values[VT1211_PORTS_MAX];
+
+    vt1211_ports_sample(params.sample_ports, values, NULL);
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      if (!(params.sample_ports & (1 << port)))
+        continue;
+
+      gpio_sample_t *sample = &ring[head & (VT1211_SAMPLER_RING - 1)];
+
+      sample->timestamp = timestamp;
+      sample->port      = port;
+      sample->value     = values[port];
+
+      __atomic_store_n(&ring_head, ++head, __ATOMIC_RELEASE);
+    }
+  }
+
+  return NULL;
+}
+
+int vt1211_sampler_start(void) {
+  pthread_attr_t      attr;
+  struct sched_param  param;
+  struct _clockperiod clock;
+  pthread_t           thread;
+  uint32_t            period = 1000000000UL / params.sample_rate;
+
+  if (params.sample_ports >> ports_info.count) {
+    debugf("Sampler:\t\tERROR Incorrect ports mask %02X\n", params.sample_ports);
+    return EINVAL;
+  }
+
+  // The sampler period can't be shorter than the system tick
+  if (ClockPeriod(CLOCK_REALTIME, NULL, &clock, 0) == 0 && clock.nsec > period) {
+    clock.nsec  = period;
+    clock.fract = 0;
+    ClockPeriod(CLOCK_REALTIME, &clock, NULL, 0);
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  param.sched_priority = VT1211_SAMPLER_PRIO;
+  pthread_attr_setschedparam(&attr, &param);
+
+  int rc = pthread_create(&thread, &attr, vt1211_sampler_thread, NULL);
+
+  pthread_attr_destroy(&attr);
+
+  debugf("Sampler:\t\t%u Hz, ports %02X %s\n", params.sample_rate, params.sample_ports, rc == EOK ? "OK" : "ERROR");
+
+  return rc;
+}
+
+void vt1211_sampler_attach(vt1211_ocb_t *ocb) {
+  ocb->sample_tail      = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+  ocb->sample_overflow  = 0;
+}
+
+/*
+ * Copies up to count records not yet seen by the client. The ring is checked
+ * again after the copy, records that were overwritten in the meantime are
+ * dropped and counted as overflow.
+ */
+uint32_t vt1211_sampler_read(vt1211_ocb_t *ocb, gpio_sample_t *samples, uint32_t count) {
+  uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+  uint32_t tail = ocb->sample_tail;
+
+  if (head - tail > VT1211_SAMPLER_RING) {
+    ocb->sample_overflow += head - tail - VT1211_SAMPLER_RING;
+    tail = head - VT1211_SAMPLER_RING;
+  }
+
+  if (count > head - tail)
+    count = head - tail;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    samples[i] = ring[(tail + i) & (VT1211_SAMPLER_RING - 1)];
+  }
+
+  // The slot of record head may be in the middle of being written
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) + 1;
+
+  if (head - tail > VT1211_SAMPLER_RING) {
+    uint32_t lost = head - tail - VT1211_SAMPLER_RING;
+
+    if (lost > count)
+      lost = count;
+
+    memmove(samples, samples + lost, (count - lost) * sizeof(gpio_sample_t));
+
+    ocb->sample_overflow += lost;
+    count -= lost;
+    tail  += lost;
+  }
+
+  ocb->sample_tail = tail + count;
+
+  return count;
+}
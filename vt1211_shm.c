@@ -0,0 +1,186 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Driver state published in shared memory for readers that don't want to
+ * send a message for every read. Every port entry is written under its own
+ * seqlock: seq is made odd before an update and even again after it, readers
+ * retry when they see it odd or changed. The writers of a port hold its port
+ * lock, so the entry needs no lock of its own and the ports are published
+ * independently.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "vt1211_nto.h"
+
+static gpio_state_t     *shm_state;
+
+static inline gpio_port_state_t *vt1211_shm_begin(uint8_t port) {
+  gpio_port_state_t *state = &shm_state->ports[port];
+
+  __atomic_store_n(&state->seq, state->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return state;
+}
+
+static inline void vt1211_shm_end(gpio_port_state_t *state) {
+  state->generation++;
+
+  __atomic_store_n(&state->seq, state->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Publishes the mode and the ownership of the port. Called with the port
+ * locked.
+ */
+void vt1211_shm_publish(uint8_t port) {
+  gpio_port_status_t  *port_status = &ports_status[port];
+  gpio_port_state_t   *state;
+
+  if (shm_state == NULL)
+    return;
+
+  state = vt1211_shm_begin(port);
+
+  if (port_status->latch_valid)
+    state->latch = port_status->latch;
+
+  state->dir        = port_status->dir;
+  state->dir_known  = port_status->dir_known;
+  state->busy       = port_status->busy;
+  state->pins_busy  = port_status->pins_busy;
+  state->port_pid   = port_status->pid;
+
+  memcpy(state->pins_pid, port_status->pins_pid, sizeof(state->pins_pid));
+
+  vt1211_shm_end(state);
+}
+
+/*
+ * Publishes a new output latch, on every write. Called with the port locked.
+ */
+void vt1211_shm_latch(uint8_t port, uint8_t value) {
+  gpio_port_state_t *state;
+
+  if (shm_state == NULL)
+    return;
+
+  state         = vt1211_shm_begin(port);
+  state->latch  = value;
+  vt1211_shm_end(state);
+}
+
+/*
+ * Publishes a hardware read of the port. Called with the port locked.
+ */
+void vt1211_shm_input(uint8_t port, uint8_t value) {
+  gpio_port_state_t *state;
+
+  if (shm_state == NULL)
+    return;
+
+  state         = vt1211_shm_begin(port);
+  state->input  = value;
+  vt1211_shm_end(state);
+}
+
+static void *vt1211_shm_thread(void *arg) {
+  struct timespec next;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while (1) {
+    next.tv_nsec += (params.refresh_ms % 1000) * 1000000;
+    next.tv_sec  += params.refresh_ms / 1000 + next.tv_nsec / 1000000000;
+    next.tv_nsec %= 1000000000;
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    for (uint8_t port = 0; port < ports_info.count; ++port) {
+      vt1211_lock(1 << port);
+      vt1211_shm_input(port, vt1211_hw_port_read(port));
+      vt1211_unlock(1 << port);
+    }
+  }
+
+  return NULL;
+}
+
+int vt1211_shm_init(void) {
+  int fd;
+
+  debugf("State shm:\t\t");
+
+  shm_unlink(VT1211_STATE_SHM);
+
+  if ((fd = shm_open(VT1211_STATE_SHM, O_RDWR | O_CREAT | O_EXCL, 0444)) == -1) {
+    debugf("ERROR %s\n", strerror(errno));
+    return errno;
+  }
+
+  if (ftruncate(fd, sizeof(gpio_state_t)) == -1) {
+    debugf("ERROR %s\n", strerror(errno));
+    close(fd);
+    return errno;
+  }
+
+  shm_state = mmap(NULL, sizeof(gpio_state_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (shm_state == MAP_FAILED) {
+    debugf("ERROR %s\n", strerror(errno));
+    shm_state = NULL;
+    return errno;
+  }
+
+  memset(shm_state, 0, sizeof(gpio_state_t));
+  shm_state->count = ports_info.count;
+
+  for (uint8_t port = 0; port < ports_info.count; ++port) {
+    shm_state->ports[port].input = vt1211_hw_port_read(port);
+    vt1211_shm_publish(port);
+  }
+
+  if (params.refresh_ms) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, vt1211_shm_thread, NULL) != EOK) {
+      debugf("ERROR Unable to start the refresh thread\n");
+      return EAGAIN;
+    }
+
+    pthread_detach(thread);
+  }
+
+  debugf("%s, refresh %u ms OK\n", VT1211_STATE_SHM, params.refresh_ms);
+
+  return EOK;
+}
@@ -0,0 +1,286 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Request statistics: per command counts, errors, backend calls and a log2
+ * histogram of the latency in ClockCycles, error counts by code and request
+ * counts by pid. Everything is a relaxed atomic counter, so recording costs
+ * a few uncontended increments and is left on. A reset while requests are
+ * counted may leave a few of their counts behind.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+#include "vt1211_nto.h"
+
+typedef struct {
+  uint64_t count;
+  uint64_t errors;
+  uint64_t hw_calls;
+  uint64_t cycles;
+  uint32_t latency[VT1211_STATS_BUCKETS];
+} stats_cmd_t;
+
+static stats_cmd_t      cmds[VT1211_STATS_CMDS];
+static uint64_t         error_codes[VT1211_STATS_ERRORS];
+static int32_t          pids[VT1211_STATS_PIDS];          // 0 - free slot
+static uint64_t         pid_counts[VT1211_STATS_PIDS];
+static uint64_t         other_pids;
+static uint64_t         pulses;
+static uint64_t         pulses_rejected;
+static uint64_t         pulses_invalid;
+
+static inline void stats_add(uint64_t *counter, uint64_t value) {
+  __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+/*
+ * Open addressing on the pid, a slot is taken with a CAS and never given
+ * back until the reset
+ */
+static void stats_pid(pid_t pid) {
+  uint32_t slot = (uint32_t) pid % VT1211_STATS_PIDS;
+
+  for (uint32_t i = 0; i < VT1211_STATS_PIDS; ++i, slot = (slot + 1) % VT1211_STATS_PIDS) {
+    int32_t owner = __atomic_load_n(&pids[slot], __ATOMIC_RELAXED);
+
+    if (owner == 0) {
+      int32_t expected = 0;
+
+      if (__atomic_compare_exchange_n(&pids[slot], &expected, pid, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        owner = pid;
+      else
+        owner = expected;
+    }
+
+    if (owner == pid) {
+      stats_add(&pid_counts[slot], 1);
+      return;
+    }
+  }
+
+  stats_add(&other_pids, 1);
+}
+
+/*
+ * Counts a request. Commands that did not match a devctl entry (known is
+ * false) only count in the errors and the pids, so a stray dcmd cannot show
+ * up in the bucket of the command sharing its low byte.
+ */
+void vt1211_stats_record(uint32_t dcmd, bool known, pid_t pid, int rc, uint64_t cycles, uint32_t hw_calls) {
+  if (known && (dcmd & 0xFF) < VT1211_STATS_CMDS) {
+    stats_cmd_t *cmd    = &cmds[dcmd & 0xFF];
+    int         bucket  = 63 - __builtin_clzll(cycles | 1);
+
+    if (bucket >= VT1211_STATS_BUCKETS)
+      bucket = VT1211_STATS_BUCKETS - 1;
+
+    stats_add(&cmd->count, 1);
+    stats_add(&cmd->hw_calls, hw_calls);
+    stats_add(&cmd->cycles, cycles);
+    __atomic_add_fetch(&cmd->latency[bucket], 1, __ATOMIC_RELAXED);
+
+    if (rc != EOK)
+      stats_add(&cmd->errors, 1);
+  }
+
+  if (rc != EOK) {
+    int code = rc - VT1211_ERR_INCRCT_PORT;
+
+    if (code < 0 || code >= VT1211_STATS_ERRORS - 1)
+      code = VT1211_STATS_ERRORS - 1;
+
+    stats_add(&error_codes[code], 1);
+  }
+
+  stats_pid(pid);
+}
+
+/*
+ * Counts a VT1211_PULSE_MODIFY pulse
+ */
+void vt1211_stats_pulse(int rc) {
+  if (rc == EOK)
+    stats_add(&pulses, 1);
+  else if (rc == VT1211_ERR_PERM)
+    stats_add(&pulses_rejected, 1);
+  else
+    stats_add(&pulses_invalid, 1);
+}
+
+int vt1211_stats_get(gpio_stats_t *stats) {
+  if (stats->cmd >= VT1211_STATS_CMDS)
+    return EINVAL;
+
+  stats_cmd_t *cmd  = &cmds[stats->cmd];
+  uint32_t    n     = 0;
+
+  memset(stats->reserved, 0, sizeof(stats->reserved));
+
+  stats->count          = __atomic_load_n(&cmd->count, __ATOMIC_RELAXED);
+  stats->errors         = __atomic_load_n(&cmd->errors, __ATOMIC_RELAXED);
+  stats->hw_calls       = __atomic_load_n(&cmd->hw_calls, __ATOMIC_RELAXED);
+  stats->cycles         = __atomic_load_n(&cmd->cycles, __ATOMIC_RELAXED);
+  stats->cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+  stats->other_pids     = __atomic_load_n(&other_pids, __ATOMIC_RELAXED);
+  stats->pulses           = __atomic_load_n(&pulses, __ATOMIC_RELAXED);
+  stats->pulses_rejected  = __atomic_load_n(&pulses_rejected, __ATOMIC_RELAXED);
+  stats->pulses_invalid   = __atomic_load_n(&pulses_invalid, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < VT1211_STATS_BUCKETS; ++i) {
+    stats->latency[i] = __atomic_load_n(&cmd->latency[i], __ATOMIC_RELAXED);
+  }
+
+  for (int i = 0; i < VT1211_STATS_ERRORS; ++i) {
+    stats->error_codes[i] = __atomic_load_n(&error_codes[i], __ATOMIC_RELAXED);
+  }
+
+  memset(stats->pids, 0, sizeof(stats->pids));
+
+  for (int i = 0; i < VT1211_STATS_PIDS; ++i) {
+    int32_t pid = __atomic_load_n(&pids[i], __ATOMIC_RELAXED);
+
+    if (pid != 0) {
+      stats->pids[n].pid    = pid;
+      stats->pids[n].count  = __atomic_load_n(&pid_counts[i], __ATOMIC_RELAXED);
+      ++n;
+    }
+  }
+
+  return EOK;
+}
+
+void vt1211_stats_reset(void) {
+  for (int i = 0; i < VT1211_STATS_CMDS; ++i) {
+    __atomic_store_n(&cmds[i].count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cmds[i].errors, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cmds[i].hw_calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cmds[i].cycles, 0, __ATOMIC_RELAXED);
+
+    for (int j = 0; j < VT1211_STATS_BUCKETS; ++j) {
+      __atomic_store_n(&cmds[i].latency[j], 0, __ATOMIC_RELAXED);
+    }
+  }
+
+  for (int i = 0; i < VT1211_STATS_ERRORS; ++i) {
+    __atomic_store_n(&error_codes[i], 0, __ATOMIC_RELAXED);
+  }
+
+  for (int i = 0; i < VT1211_STATS_PIDS; ++i) {
+    __atomic_store_n(&pid_counts[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pids[i], 0, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&other_pids, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&pulses, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&pulses_rejected, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&pulses_invalid, 0, __ATOMIC_RELAXED);
+}
+
+#define STATS_TEXT_MAX  (64 * 1024)
+
+typedef struct {
+  char    *buf;
+  size_t  len;
+} stats_text_t;
+
+static void stats_printf(stats_text_t *text, const char *format, ...) {
+  va_list args;
+  int     n;
+
+  va_start(args, format);
+  n = vsnprintf(text->buf + text->len, STATS_TEXT_MAX - text->len, format, args);
+  va_end(args);
+
+  if (n > 0)
+    text->len = text->len + n < STATS_TEXT_MAX ? text->len + n : STATS_TEXT_MAX - 1;
+}
+
+/*
+ * Text form for /dev/vt1211/stats. Returns a malloc'd string and its length
+ * in *len or NULL.
+ */
+char *vt1211_stats_text(size_t *len) {
+  static const char *codes[VT1211_STATS_ERRORS] = {
+    "INCRCT_PORT", "INCRCT_PIN", "PORT_BUSY", "PIN_BUSY", "PERM", "ALREADY", "other"
+  };
+
+  stats_text_t  text  = { malloc(STATS_TEXT_MAX), 0 };
+  gpio_stats_t  stats;
+  double        us_per_cycle;
+
+  if (text.buf == NULL)
+    return NULL;
+
+  stats.cmd = 0;
+  vt1211_stats_get(&stats);
+  us_per_cycle = 1000000.0 / stats.cycles_per_sec;
+
+  stats_printf(&text, "cmd  count       errors      hw/op   avg us   latency (count<upper bound, us)\n");
+
+  for (uint8_t cmd = 0; cmd < VT1211_STATS_CMDS; ++cmd) {
+    stats.cmd = cmd;
+    vt1211_stats_get(&stats);
+
+    if (stats.count == 0)
+      continue;
+
+    stats_printf(&text, "%02X   %-11llu %-11llu %-7.2f %-8.2f", cmd,
+                 (unsigned long long) stats.count, (unsigned long long) stats.errors,
+                 (double) stats.hw_calls / stats.count, stats.cycles * us_per_cycle / stats.count);
+
+    for (int i = 0; i < VT1211_STATS_BUCKETS; ++i) {
+      if (stats.latency[i] != 0)
+        stats_printf(&text, " %u<%.2f", stats.latency[i], (2ULL << i) * us_per_cycle);
+    }
+
+    stats_printf(&text, "\n");
+  }
+
+  stats_printf(&text, "\nerrors:");
+
+  for (int i = 0; i < VT1211_STATS_ERRORS; ++i) {
+    stats_printf(&text, " %s %llu", codes[i], (unsigned long long) stats.error_codes[i]);
+  }
+
+  stats_printf(&text, "\npulses: applied %llu rejected %llu invalid %llu",
+               (unsigned long long) stats.pulses, (unsigned long long) stats.pulses_rejected,
+               (unsigned long long) stats.pulses_invalid);
+
+  stats_printf(&text, "\n\npid         requests\n");
+
+  for (int i = 0; i < VT1211_STATS_PIDS && stats.pids[i].count != 0; ++i) {
+    stats_printf(&text, "%-11d %llu\n", stats.pids[i].pid, (unsigned long long) stats.pids[i].count);
+  }
+
+  if (stats.other_pids != 0)
+    stats_printf(&text, "other       %llu\n", (unsigned long long) stats.other_pids);
+
+  *len = text.len;
+  return text.buf;
+}
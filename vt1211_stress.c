@@ -0,0 +1,294 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Ownership cleanup stress test, run against the driver on the target.
+ * Forks clients that open /dev/vt1211, request random pins and ports, start
+ * PWM channels and patterns on them and never give anything back, and kills
+ * every one of them with SIGKILL after a random delay, in the middle of
+ * whatever request it is in. Once they are all gone, every pin and port
+ * must be free again: the published state shows nothing busy, no pattern
+ * runs and a new client can request everything.
+ *
+ * Usage: vt1211_stress [-n clients] [-j parallel] [-d max_delay_us]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <devctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "vt1211_ipc.h"
+
+#define STRESS_SETTLE_MS  1000
+
+typedef struct {
+  pid_t     pid;
+  uint64_t  deadline;
+} stress_child_t;
+
+static gpio_portsinfo_t info;
+
+static uint64_t stress_now(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void client(unsigned seed) {
+  gpio_data_t   data;
+  gpio_pwm_t    pwm;
+  int           fd;
+  struct {
+    gpio_pattern_t      header;
+    gpio_pattern_step_t steps[2];
+  } pattern;
+
+  srand(seed);
+
+  if ((fd = open("/dev/vt1211", O_RDWR)) == -1)
+    _exit(EXIT_FAILURE);
+
+  for (;;) {
+    memset(&data, 0, sizeof(data));
+    data.port = rand() % info.count;
+    data.pin  = 1 << rand() % info.pins_by_port[data.port];
+    data.data = rand() & 1;
+
+    switch (rand() % 4) {
+      case 0: {
+        devctl(fd, VT1211_REQ_PORT, &data, sizeof(data), NULL);
+        break;
+      }
+      case 1: {
+        if (devctl(fd, VT1211_REQ_PIN, &data, sizeof(data), NULL) == EOK)
+          devctl(fd, VT1211_SET_PIN, &data, sizeof(data), NULL);
+        break;
+      }
+      case 2: {
+        memset(&pwm, 0, sizeof(pwm));
+        pwm.port      = data.port;
+        pwm.pin       = data.pin;
+        pwm.period_us = 1000;
+        pwm.duty_us   = 250;
+        devctl(fd, VT1211_PWM_CONFIG, &pwm, sizeof(pwm), NULL);
+        break;
+      }
+      case 3: {
+        memset(&pattern, 0, sizeof(pattern));
+        pattern.header.port         = data.port;
+        pattern.header.repeat       = 0;
+        pattern.header.count        = 2;
+        pattern.steps[0].mask       = data.pin;
+        pattern.steps[0].value      = data.pin;
+        pattern.steps[0].delay_ns   = VT1211_PATTERN_PERIOD;
+        pattern.steps[1].mask       = data.pin;
+        pattern.steps[1].delay_ns   = VT1211_PATTERN_PERIOD;
+        devctl(fd, VT1211_PLAY_PATTERN, &pattern, sizeof(pattern), NULL);
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Returns the number of ports and pins still busy: in the published state,
+ * and refused to a new client
+ */
+static int leftovers(int fd, const gpio_state_t *shm, int verbose) {
+  gpio_state_t          state;
+  gpio_pattern_status_t status;
+  gpio_data_t           data;
+  int                   busy = 0;
+
+  vt1211_state_read(shm, &state);
+
+  for (uint8_t port = 0; port < info.count; ++port) {
+    if (state.ports[port].busy || state.ports[port].pins_busy) {
+      if (verbose)
+        printf("port %u: busy %u pins %02X (pid %d)\n", port, state.ports[port].busy,
+               state.ports[port].pins_busy, state.ports[port].port_pid);
+      ++busy;
+    }
+
+    memset(&data, 0, sizeof(data));
+    data.port = port;
+
+    if (devctl(fd, VT1211_REQ_PORT, &data, sizeof(data), NULL) != EOK) {
+      if (verbose)
+        printf("port %u: REQ_PORT refused\n", port);
+      ++busy;
+      continue;
+    }
+
+    devctl(fd, VT1211_FREE_PORT, &data, sizeof(data), NULL);
+
+    for (uint8_t pin = 0; pin < info.pins_by_port[port]; ++pin) {
+      data.pin = 1 << pin;
+
+      if (devctl(fd, VT1211_REQ_PIN, &data, sizeof(data), NULL) != EOK) {
+        if (verbose)
+          printf("port %u pin %u: REQ_PIN refused\n", port, pin);
+        ++busy;
+        continue;
+      }
+
+      devctl(fd, VT1211_FREE_PIN, &data, sizeof(data), NULL);
+    }
+  }
+
+  if (devctl(fd, VT1211_PATTERN_STATUS, &status, sizeof(status), NULL) == EOK && status.running) {
+    if (verbose)
+      printf("pattern still running on port %u\n", status.port);
+    ++busy;
+  }
+
+  return busy;
+}
+
+int main(int argc, char **argv) {
+  uint32_t            clients   = 2000;
+  uint32_t            parallel  = 16;
+  uint32_t            delay_us  = 2000;
+  uint32_t            started   = 0;
+  uint32_t            running   = 0;
+  stress_child_t      *children;
+  const gpio_state_t  *shm;
+  struct timespec     pause;
+  int                 shm_fd;
+  int                 fd;
+  int                 opt;
+  int                 busy;
+
+  while ((opt = getopt(argc, argv, "n:j:d:")) != -1) {
+    switch (opt) {
+      case 'n': {
+        clients = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'j': {
+        parallel = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 'd': {
+        delay_us = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      }
+      default: {
+        fprintf(stderr, "usage: %s [-n clients] [-j parallel] [-d max_delay_us]\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (parallel == 0)
+    parallel = 1;
+
+  if (delay_us == 0)
+    delay_us = 1;
+
+  if ((fd = open("/dev/vt1211", O_RDWR)) == -1) {
+    fprintf(stderr, "%s: /dev/vt1211: %s\n", argv[0], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if (devctl(fd, VT1211_GET_INFO, &info, sizeof(info), NULL) != EOK || info.count == 0) {
+    fprintf(stderr, "%s: VT1211_GET_INFO failed\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((shm_fd = shm_open(VT1211_STATE_SHM, O_RDONLY, 0)) == -1 ||
+      (shm = mmap(NULL, sizeof(gpio_state_t), PROT_READ, MAP_SHARED, shm_fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], VT1211_STATE_SHM, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if ((children = calloc(parallel, sizeof(*children))) == NULL) {
+    fprintf(stderr, "%s: Out of memory\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  srand(time(NULL));
+
+  // parallel clients at a time, each killed at its own deadline
+  while (started < clients || running > 0) {
+    uint64_t now  = stress_now();
+    uint64_t next = UINT64_MAX;
+
+    for (uint32_t i = 0; i < parallel; ++i) {
+      if (children[i].pid == 0 && started < clients) {
+        if ((children[i].pid = fork()) == -1) {
+          fprintf(stderr, "%s: fork: %s\n", argv[0], strerror(errno));
+          return EXIT_FAILURE;
+        }
+
+        if (children[i].pid == 0)
+          client(rand());
+
+        children[i].deadline = now + (rand() % delay_us) * 1000ULL;
+        ++started;
+        ++running;
+      }
+
+      if (children[i].pid > 0 && children[i].deadline <= now) {
+        kill(children[i].pid, SIGKILL);
+        waitpid(children[i].pid, NULL, 0);
+        children[i].pid = 0;
+        --running;
+        continue;
+      }
+
+      if (children[i].pid > 0 && children[i].deadline < next)
+        next = children[i].deadline;
+    }
+
+    if (next != UINT64_MAX && next > now) {
+      pause.tv_sec  = (next - now) / 1000000000ULL;
+      pause.tv_nsec = (next - now) % 1000000000ULL;
+      nanosleep(&pause, NULL);
+    }
+  }
+
+  // The driver cleans up on the close of the dead clients' descriptors
+  for (int ms = 0; (busy = leftovers(fd, shm, 0)) != 0 && ms < STRESS_SETTLE_MS; ms += 10) {
+    pause.tv_sec  = 0;
+    pause.tv_nsec = 10000000L;
+    nanosleep(&pause, NULL);
+  }
+
+  if (busy != 0) {
+    leftovers(fd, shm, 1);
+    printf("%u clients killed, %d ports or pins left busy\n", clients, busy);
+    return EXIT_FAILURE;
+  }
+
+  printf("%u clients killed, everything free\n", clients);
+  return EXIT_SUCCESS;
+}
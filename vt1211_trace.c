@@ -0,0 +1,182 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Request trace. Every thread writes fixed size records into a ring of its
+ * own, with no locks and no formatting, so the trace can stay on in
+ * production. The rings are drained by reading /dev/vt1211/trace: whole
+ * gpio_trace_t records from all the rings, as many as fit. A ring the
+ * reader didn't keep up with loses its oldest records, the reader gets a
+ * dcmd 0 record with their number.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "vt1211_nto.h"
+
+#define TRACE_RECORDS   1024  // per thread, power of two
+#define TRACE_THREADS   64
+
+typedef struct {
+  uint32_t      head;                     // next record to write
+  uint32_t      tail;                     // next record to read, guarded by drain_lock
+  bool          free;                     // the thread exited, guarded by ring_lock
+  gpio_trace_t  records[TRACE_RECORDS];
+} trace_ring_t;
+
+bool                          vt1211_tracing;
+
+static trace_ring_t           *rings[TRACE_THREADS];
+static uint32_t               ring_count;
+static uint32_t               lost;             // guarded by drain_lock
+static pthread_mutex_t        ring_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t        drain_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t          ring_key;
+static __thread trace_ring_t  *ring;
+
+static void trace_exit(void *arg) {
+  pthread_mutex_lock(&ring_lock);
+  ((trace_ring_t *) arg)->free = true;
+  pthread_mutex_unlock(&ring_lock);
+}
+
+/*
+ * The ring of the calling thread. A new thread takes over the ring of an
+ * exited one or gets a new ring. Returns NULL if there are no more rings.
+ */
+static trace_ring_t *trace_ring(void) {
+  if (ring != NULL)
+    return ring;
+
+  pthread_mutex_lock(&ring_lock);
+
+  for (uint32_t i = 0; i < ring_count; ++i) {
+    if (rings[i]->free) {
+      rings[i]->free = false;
+      ring = rings[i];
+      break;
+    }
+  }
+
+  if (ring == NULL && ring_count < TRACE_THREADS && (ring = calloc(1, sizeof(trace_ring_t))) != NULL) {
+    rings[ring_count] = ring;
+    __atomic_store_n(&ring_count, ring_count + 1, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&ring_lock);
+
+  if (ring != NULL)
+    pthread_setspecific(ring_key, ring);
+
+  return ring;
+}
+
+int vt1211_trace_init(void) {
+  vt1211_tracing = params.trace;
+
+  return pthread_key_create(&ring_key, trace_exit);
+}
+
+void vt1211_trace_record(uint32_t dcmd, pid_t pid, uint8_t port, uint8_t pin, uint8_t data, int result) {
+  trace_ring_t *r = trace_ring();
+
+  if (r == NULL)
+    return;
+
+  uint32_t      head    = r->head;
+  gpio_trace_t  *record = &r->records[head & (TRACE_RECORDS - 1)];
+
+  record->timestamp = vt1211_now();
+  record->dcmd      = dcmd;
+  record->pid       = pid;
+  record->port      = port;
+  record->pin       = pin;
+  record->data      = data;
+  record->result    = result;
+
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copies the unread records of a ring, at most count. The records the
+ * writer may have overwritten during the copy are dropped and counted as
+ * lost. Returns the number of records copied.
+ */
+static uint32_t trace_drain(trace_ring_t *r, uint8_t index, gpio_trace_t *records, uint32_t count) {
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  uint32_t first;
+  uint32_t n    = 0;
+
+  if (head - r->tail > TRACE_RECORDS) {
+    lost    += head - r->tail - TRACE_RECORDS;
+    r->tail  = head - TRACE_RECORDS;
+  }
+
+  first = r->tail;
+
+  for (; r->tail != head && n < count; ++r->tail, ++n) {
+    records[n]        = r->records[r->tail & (TRACE_RECORDS - 1)];
+    records[n].thread = index;
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  if ((int32_t) (head + 1 - TRACE_RECORDS - first) > 0) {
+    uint32_t torn = head + 1 - TRACE_RECORDS - first;
+
+    if (torn > n)
+      torn = n;
+
+    memmove(records, records + torn, (n - torn) * sizeof(gpio_trace_t));
+    lost  += torn;
+    n     -= torn;
+  }
+
+  return n;
+}
+
+uint32_t vt1211_trace_read(gpio_trace_t *records, uint32_t count) {
+  uint32_t rings_n  = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+  uint32_t n        = 0;
+
+  pthread_mutex_lock(&drain_lock);
+
+  for (uint32_t i = 0; i < rings_n && n < count; ++i) {
+    n += trace_drain(rings[i], i, records + n, count - n);
+  }
+
+  if (lost != 0 && n < count) {
+    memset(&records[n], 0, sizeof(gpio_trace_t));
+    records[n].timestamp  = vt1211_now();
+    records[n].result     = lost;
+    lost = 0;
+    ++n;
+  }
+
+  pthread_mutex_unlock(&drain_lock);
+
+  return n;
+}
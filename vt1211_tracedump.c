@@ -0,0 +1,158 @@
+/*
+ * GPIO Resource manager for VT1211 Super I/O chip
+ *
+ * Copyright 2019 by Roman Serov <roman@serov.co>
+ * 
+ * This file is part of VT1211 GPIO Resource manager.
+ *
+ * VT1211 GPIO Resource manager is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * VT1211 GPIO Resource manager is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with VT1211 GPIO Resource manager. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+*/
+
+/*
+ * Decoder for the request trace of the driver. Reads gpio_trace_t records
+ * (cat /dev/vt1211/trace > file) from a file or stdin and prints them in
+ * time order.
+ *
+ * Usage: vt1211_tracedump [file]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <devctl.h>
+#include "vt1211_ipc.h"
+
+static const char *names[256] = {
+  [VT1211_GET_INFO        & 0xFF] = "GET_INFO",
+  [VT1211_CONFIG_PIN      & 0xFF] = "CONFIG_PIN",
+  [VT1211_SET_PIN         & 0xFF] = "SET_PIN",
+  [VT1211_GET_PIN         & 0xFF] = "GET_PIN",
+  [VT1211_CONFIG_PORT     & 0xFF] = "CONFIG_PORT",
+  [VT1211_SET_PORT        & 0xFF] = "SET_PORT",
+  [VT1211_GET_PORT        & 0xFF] = "GET_PORT",
+  [VT1211_REQ_PORT        & 0xFF] = "REQ_PORT",
+  [VT1211_REQ_PIN         & 0xFF] = "REQ_PIN",
+  [VT1211_FREE_PORT       & 0xFF] = "FREE_PORT",
+  [VT1211_FREE_PIN        & 0xFF] = "FREE_PIN",
+  [VT1211_BATCH           & 0xFF] = "BATCH",
+  [VT1211_GET_ALL         & 0xFF] = "GET_ALL",
+  [VT1211_SET_MULTI       & 0xFF] = "SET_MULTI",
+  [VT1211_RESYNC          & 0xFF] = "RESYNC",
+  [VT1211_MODIFY_PORT     & 0xFF] = "MODIFY_PORT",
+  [VT1211_BIND            & 0xFF] = "BIND",
+  [VT1211_SAMPLER_READ    & 0xFF] = "SAMPLER_READ",
+  [VT1211_WATCH           & 0xFF] = "WATCH",
+  [VT1211_WATCH_EVENTS    & 0xFF] = "WATCH_EVENTS",
+  [VT1211_PLAY_PATTERN    & 0xFF] = "PLAY_PATTERN",
+  [VT1211_PATTERN_STATUS  & 0xFF] = "PATTERN_STATUS",
+  [VT1211_PATTERN_STOP    & 0xFF] = "PATTERN_STOP",
+  [VT1211_PWM_CONFIG      & 0xFF] = "PWM_CONFIG",
+  [VT1211_DEBOUNCE        & 0xFF] = "DEBOUNCE",
+  [VT1211_RENEW           & 0xFF] = "RENEW",
+  [VT1211_TRACE           & 0xFF] = "TRACE",
+  [VT1211_GET_STATS       & 0xFF] = "GET_STATS",
+  [VT1211_STATS_RESET     & 0xFF] = "STATS_RESET",
+  [VT1211_CONFIG_MULTI    & 0xFF] = "CONFIG_MULTI",
+  [VT1211_BUS_CONFIG      & 0xFF] = "BUS_CONFIG",
+  [VT1211_BUS_XFER        & 0xFF] = "BUS_XFER",
+  [VT1211_GROUP_DEFINE    & 0xFF] = "GROUP_DEFINE",
+  [VT1211_GROUP_FIND      & 0xFF] = "GROUP_FIND",
+  [VT1211_GROUP_WRITE     & 0xFF] = "GROUP_WRITE",
+  [VT1211_GROUP_READ      & 0xFF] = "GROUP_READ",
+  [VT1211_CAPTURE         & 0xFF] = "CAPTURE",
+  [VT1211_CAPTURE_STATS   & 0xFF] = "CAPTURE_STATS",
+};
+
+static const char *result_name(int32_t result) {
+  switch (result) {
+    case EOK:                     return "OK";
+    case VT1211_ERR_INCRCT_PORT:  return "ERR_INCRCT_PORT";
+    case VT1211_ERR_INCRCT_PIN:   return "ERR_INCRCT_PIN";
+    case VT1211_ERR_PORT_BUSY:    return "ERR_PORT_BUSY";
+    case VT1211_ERR_PIN_BUSY:     return "ERR_PIN_BUSY";
+    case VT1211_ERR_PERM:         return "ERR_PERM";
+    case VT1211_ERR_ALREADY:      return "ERR_ALREADY";
+    default:                      return strerror(result);
+  }
+}
+
+static int by_time(const void *a, const void *b) {
+  uint64_t ta = ((const gpio_trace_t *) a)->timestamp;
+  uint64_t tb = ((const gpio_trace_t *) b)->timestamp;
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+static void field(char *buf, uint8_t value) {
+  if (value == 0xFF) {
+    strcpy(buf, "--");
+  } else {
+    sprintf(buf, "%02X", value);
+  }
+}
+
+int main(int argc, char **argv) {
+  FILE          *in       = stdin;
+  gpio_trace_t  *records  = NULL;
+  size_t        count     = 0;
+  size_t        size      = 0;
+
+  if (argc > 1 && (in = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  for (;;) {
+    if (count == size) {
+      size    = size ? size * 2 : 1024;
+      records = realloc(records, size * sizeof(gpio_trace_t));
+
+      if (records == NULL) {
+        fprintf(stderr, "%s: Out of memory\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (fread(&records[count], sizeof(gpio_trace_t), 1, in) != 1)
+      break;
+
+    ++count;
+  }
+
+  qsort(records, count, sizeof(gpio_trace_t), by_time);
+
+  for (size_t i = 0; i < count; ++i) {
+    gpio_trace_t  *record = &records[i];
+    double        time    = (record->timestamp - records[0].timestamp) / 1000.0;
+    const char    *name   = names[record->dcmd & 0xFF];
+    char          port[4], pin[4], data[4];
+
+    if (record->dcmd == 0) {
+      printf("%14.3f us  %d records lost\n", time, record->result);
+      continue;
+    }
+
+    field(port, record->port);
+    field(pin, record->pin);
+    field(data, record->data);
+
+    printf("%14.3f us  t%-3u pid %-8d %-15s port %s pin %s data %s  %s\n",
+           time, record->thread, record->pid, name ? name : "?", port, pin, data, result_name(record->result));
+  }
+
+  return EXIT_SUCCESS;
+}